@@ -2,6 +2,10 @@
 # (broken)
 # CC     = g++ -Wall -pedantic
 CFLAGS = -O2 -march=native -ftree-vectorize -ggdb3
+# DOM refcount statistics and event ring, see wfs/dom_trace.h
+# CFLAGS += -DWFS_DOM_TRACE
+# atomic refcounts on frozen documents, see dom_document_freeze()
+# CFLAGS += -DWFS_DOM_ATOMIC_REFCNT
 
 AR     = ar
 RANLIB = ranlib
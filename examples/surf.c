@@ -9,8 +9,7 @@ const char *myfile = "<!-- commento --> <!DOCTYPE html>\n<html lang='fr' yeet sc
 int
 main(int argc, char *argv[])
 {
-  struct dom_document *doc = dom_strong_ref_object(dom_alloc_object( DOM_INTERFACE(document) ));
-  ((struct dom_node *) doc)->children = infra_stack_create();
+  struct dom_document *doc = dom_strong_ref_object(dom_create_document(true));
 
   html_parse(doc, myfile, strlen(myfile));
 
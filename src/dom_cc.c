@@ -0,0 +1,399 @@
+#include <stdbool.h>
+#include <threads.h>
+#include <time.h>
+
+#include <wfs/dom_cc.h>
+#include <wfs/dom_core.h>
+#include <wfs/infra_stack.h>
+
+/* Roots taken from the buffer per batch; the clock is read once per batch */
+static const uint32_t k_cc_batch_size = 64;
+
+struct dom_cc_buffer {
+  InfraStack *candidates; /* slots of unbuffered objects are NULL */
+  uint32_t num_holes;
+};
+
+/* Scratch space of the collection in progress on this thread, if any */
+struct collector {
+  InfraStack *roots;
+  InfraStack *work;
+  InfraStack *black_work;
+  InfraStack *garbage;
+};
+
+static thread_local struct collector *cc;
+
+/* The collector's own stacks must not end up in some document's arena */
+static InfraStack *
+heap_stack(InfraStack **stack)
+{
+  if (*stack == NULL) {
+    InfraArena *previous = infra_arena_enter(NULL);
+    *stack = infra_stack_create();
+    infra_arena_leave(previous);
+  }
+
+  return *stack;
+}
+
+static void
+compact_candidates(struct dom_cc_buffer *buffer)
+{
+  InfraStack *candidates = buffer->candidates;
+  uint32_t j = 0;
+
+  for (uint32_t i = 0; i < candidates->size; i++) {
+    DOMObject *obj = candidates->items[i];
+
+    if (obj == NULL)
+      continue;
+
+    candidates->items[j++] = obj;
+    obj->header.cc_slot = j;
+  }
+
+  candidates->size = j;
+  buffer->num_holes = 0;
+}
+
+void
+dom_cc_buffer(DOMObject *obj)
+{
+  struct dom_cc_buffer **owner = dom_cc_buffer_of(obj);
+  struct dom_cc_buffer *buffer;
+  InfraStack *candidates;
+
+  if (owner == NULL)
+    return;
+
+  if (*owner == NULL) {
+    *owner = infra_arena_alloc(NULL, sizeof (**owner));
+    heap_stack(&(*owner)->candidates);
+  }
+
+  buffer = *owner;
+  candidates = buffer->candidates;
+
+  if (buffer->num_holes > k_cc_batch_size
+   && buffer->num_holes > candidates->size / 2)
+    compact_candidates(buffer);
+
+  infra_stack_push(candidates, obj);
+  obj->header.cc_slot = candidates->size;
+}
+
+void
+dom_cc_unbuffer(DOMObject *obj)
+{
+  struct dom_cc_buffer **owner = dom_cc_buffer_of(obj);
+  struct dom_cc_buffer *buffer = owner != NULL ? *owner : NULL;
+  uint32_t slot = obj->header.cc_slot;
+
+  obj->header.cc_slot = 0;
+
+  /* nothing to undo if the buffer is gone or was never obj's */
+  if (buffer == NULL || slot > buffer->candidates->size
+   || buffer->candidates->items[slot - 1] != obj)
+    return;
+
+  if (slot == buffer->candidates->size) {
+    buffer->candidates->size--;
+  } else {
+    buffer->candidates->items[slot - 1] = NULL;
+    buffer->num_holes++;
+  }
+}
+
+static size_t
+num_candidates(const struct dom_cc_buffer *buffer)
+{
+  return buffer != NULL ? buffer->candidates->size - buffer->num_holes : 0;
+}
+
+size_t
+dom_cc_num_candidates(const struct dom_document *document)
+{
+  return num_candidates(document->cc_buffer);
+}
+
+/*
+ * The three phases below are the recursive MarkGray, Scan and CollectWhite
+ * of the paper, run off explicit worklists so that deep trees cannot
+ * overflow the stack.
+ */
+
+static void
+mark_gray_visit(DOMObject *target, void *ctx)
+{
+  (void) ctx;
+
+  /* shared with other threads, see dom_document_freeze() */
+  if (target->header.frozen)
+    return;
+
+  target->header.strong_refcnt--;
+
+  if (target->header.cc_color != DOM_CC_GRAY) {
+    target->header.cc_color = DOM_CC_GRAY;
+    infra_stack_push(cc->work, target);
+  }
+}
+
+static void
+mark_gray(DOMObject *root)
+{
+  DOMObject *obj;
+
+  if (root->header.cc_color == DOM_CC_GRAY)
+    return;
+
+  root->header.cc_color = DOM_CC_GRAY;
+  infra_stack_push(cc->work, root);
+
+  while ((obj = infra_stack_pop(cc->work)) != NULL)
+    dom_traverse_object(obj, mark_gray_visit, NULL);
+}
+
+static void
+scan_black_visit(DOMObject *target, void *ctx)
+{
+  (void) ctx;
+
+  if (target->header.frozen)
+    return;
+
+  target->header.strong_refcnt++;
+
+  if (target->header.cc_color != DOM_CC_BLACK) {
+    target->header.cc_color = DOM_CC_BLACK;
+    infra_stack_push(cc->black_work, target);
+  }
+}
+
+/* Externally referenced after all: restore the counts below it */
+static void
+scan_black(DOMObject *root)
+{
+  DOMObject *obj;
+
+  root->header.cc_color = DOM_CC_BLACK;
+  infra_stack_push(cc->black_work, root);
+
+  while ((obj = infra_stack_pop(cc->black_work)) != NULL)
+    dom_traverse_object(obj, scan_black_visit, NULL);
+}
+
+static void
+push_visit(DOMObject *target, void *ctx)
+{
+  if (!target->header.frozen)
+    infra_stack_push(ctx, target);
+}
+
+static void
+scan(DOMObject *root)
+{
+  DOMObject *obj;
+
+  infra_stack_push(cc->work, root);
+
+  while ((obj = infra_stack_pop(cc->work)) != NULL) {
+    if (obj->header.cc_color != DOM_CC_GRAY)
+      continue;
+
+    if (obj->header.strong_refcnt > 0) {
+      scan_black(obj);
+    } else {
+      obj->header.cc_color = DOM_CC_WHITE;
+      dom_traverse_object(obj, push_visit, cc->work);
+    }
+  }
+}
+
+static void
+collect_white_visit(DOMObject *target, void *ctx)
+{
+  (void) ctx;
+
+  if (target->header.cc_color != DOM_CC_WHITE)
+    return;
+
+  /* garbage waiting in the buffer is taken along */
+  if (target->header.cc_slot != 0)
+    dom_cc_unbuffer(target);
+
+  target->header.cc_color = DOM_CC_GARBAGE;
+  infra_stack_push(cc->garbage, target);
+  infra_stack_push(cc->work, target);
+}
+
+static void
+collect_white(DOMObject *root)
+{
+  DOMObject *obj;
+
+  collect_white_visit(root, NULL);
+
+  while ((obj = infra_stack_pop(cc->work)) != NULL)
+    dom_traverse_object(obj, collect_white_visit, NULL);
+}
+
+/*
+ * Finalizers drop references between members of the cycle too, so every
+ * member is finalized before any is released; DOM_CC_GARBAGE keeps
+ * dom_strong_unref_object() from freeing them a second time.
+ */
+static size_t
+free_garbage(void)
+{
+  InfraStack *garbage = cc->garbage;
+  size_t count = garbage->size;
+
+  INFRA_STACK_FOREACH(garbage, i) {
+    DOMObject *obj = garbage->items[i];
+    const DOMInterface *interface = dom_get_interface(obj);
+
+    DOM_TRACE(DOM_TRACE_FREE, obj);
+
+    for (uint8_t f = 0; f < interface->num_finalizers; f++)
+      interface->finalizers[f](obj);
+  }
+
+  INFRA_STACK_FOREACH(garbage, i) {
+    DOMObject *obj = garbage->items[i];
+
+    infra_arena_free(obj->header.arena, obj, dom_get_interface(obj)->impl_size);
+  }
+
+  garbage->size = 0;
+  return count;
+}
+
+static bool
+past_deadline(const struct timespec *deadline)
+{
+  struct timespec now;
+
+  timespec_get(&now, TIME_UTC);
+  return (now.tv_sec > deadline->tv_sec
+       || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec));
+}
+
+static enum DOMCollectStatus
+collect(struct dom_cc_buffer *buffer, const DOMCollectBudget *budget,
+        size_t *num_freed)
+{
+  struct timespec deadline = { 0 };
+  size_t nroots = 0;
+  size_t nfreed = 0;
+  enum DOMCollectStatus status = DOM_COLLECT_DONE;
+  struct collector collector = { 0 };
+
+  cc = &collector;
+  heap_stack(&cc->roots);
+  heap_stack(&cc->work);
+  heap_stack(&cc->black_work);
+  heap_stack(&cc->garbage);
+
+  if (budget != NULL && budget->max_nsecs != 0) {
+    timespec_get(&deadline, TIME_UTC);
+    deadline.tv_sec  += budget->max_nsecs / 1000000000;
+    deadline.tv_nsec += budget->max_nsecs % 1000000000;
+
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+
+  while (num_candidates(buffer) != 0)
+  {
+    if (budget != NULL
+     && ((budget->max_roots != 0 && nroots >= budget->max_roots)
+      || (budget->max_nsecs != 0 && nroots != 0 && past_deadline(&deadline)))) {
+      status = DOM_COLLECT_YIELDED;
+      break;
+    }
+
+    /* MarkRoots */
+    while (cc->roots->size < k_cc_batch_size && buffer->candidates->size != 0) {
+      DOMObject *obj = infra_stack_pop(buffer->candidates);
+
+      if (obj == NULL) {
+        buffer->num_holes--;
+        continue;
+      }
+
+      obj->header.cc_slot = 0;
+      nroots++;
+
+      /* otherwise it was reached from an earlier root and found live */
+      if (obj->header.cc_color == DOM_CC_PURPLE) {
+        mark_gray(obj);
+        infra_stack_push(cc->roots, obj);
+      }
+
+      if (budget != NULL && budget->max_roots != 0 && nroots >= budget->max_roots)
+        break;
+    }
+
+    INFRA_STACK_FOREACH(cc->roots, i)
+      scan(cc->roots->items[i]);
+
+    INFRA_STACK_FOREACH(cc->roots, i)
+      collect_white(cc->roots->items[i]);
+
+    cc->roots->size = 0;
+    nfreed += free_garbage();
+  }
+
+  infra_stack_free(cc->roots);
+  infra_stack_free(cc->work);
+  infra_stack_free(cc->black_work);
+  infra_stack_free(cc->garbage);
+  cc = NULL;
+
+  if (num_freed != NULL)
+    *num_freed = nfreed;
+
+  return status;
+}
+
+enum DOMCollectStatus
+dom_cc_collect(struct dom_document *document, const DOMCollectBudget *budget,
+               size_t *num_freed)
+{
+  if (cc != NULL)
+    abort();
+
+  if (document->cc_buffer == NULL) {
+    if (num_freed != NULL)
+      *num_freed = 0;
+    return DOM_COLLECT_DONE;
+  }
+
+  return collect(document->cc_buffer, budget, num_freed);
+}
+
+void
+dom_cc_release(struct dom_cc_buffer *buffer)
+{
+  if (buffer == NULL)
+    return;
+
+  /* a document dying during a collection leaves its cycles be */
+  if (cc == NULL && num_candidates(buffer) != 0)
+    collect(buffer, NULL, NULL);
+
+  /* whatever is left outlives its document; see dom_cc_unbuffer() */
+  INFRA_STACK_FOREACH(buffer->candidates, i) {
+    DOMObject *obj = buffer->candidates->items[i];
+
+    if (obj != NULL)
+      obj->header.cc_slot = 0;
+  }
+
+  infra_stack_free(buffer->candidates);
+  infra_arena_free(NULL, buffer, sizeof (*buffer));
+}
@@ -0,0 +1,438 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include <wfs/dom.h>
+#include <wfs/dom_collection.h>
+#include <wfs/dom_core.h>
+#include <wfs/dom_traversal.h>
+#include <wfs/html_foreign.h>
+#include <wfs/html_tags.h>
+#include <wfs/infra_arena.h>
+#include <wfs/infra_stack.h>
+
+/* START INTERFACES */
+
+static void
+collection_finalizer(DOMObject *obj)
+{
+  struct dom_html_collection *collection = (DOMAny *) obj;
+
+  if (collection->class_names != NULL) {
+    INFRA_STACK_FOREACH(collection->class_names, i)
+      infra_string_free(collection->class_names->items[i]);
+
+    infra_stack_free(collection->class_names);
+  }
+
+  infra_string_unref(collection->name);
+  infra_string_unref(collection->lower_name);
+
+  if (collection->cache != NULL)
+    infra_stack_free(collection->cache);
+
+  dom_strong_unref_object(collection->root);
+}
+
+static void
+collection_traverse(DOMObject *obj, DOMVisitFunc visit, void *ctx)
+{
+  struct dom_html_collection *collection = (DOMAny *) obj;
+
+  visit((DOMObject *) collection->root, ctx);
+}
+
+static struct dom_cc_buffer **
+collection_cc_buffer(DOMObject *obj)
+{
+  struct dom_html_collection *collection = (DOMAny *) obj;
+
+  return dom_cc_buffer_of((DOMObject *) collection->root);
+}
+
+DOM_DEFINE_INTERFACE(html_collection) {
+  .name = "HTMLCollection",
+  DOM_ANCESTRY(html_collection),
+  .impl_size = sizeof (struct dom_html_collection),
+  DOM_FINALIZERS(collection_finalizer),
+  .traverse = collection_traverse,
+  .cc_buffer = collection_cc_buffer,
+};
+
+/* END INTERFACES */
+
+static struct dom_document *
+document_of(struct dom_node *node)
+{
+  if (DOM_IMPLEMENTS(node, document))
+    return (struct dom_document *) node;
+
+  return node->node_document;
+}
+
+static inline bool
+is_ascii_whitespace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\f' || c == '\r';
+}
+
+static const char *
+element_name(const struct dom_element *element, size_t *len)
+{
+  const char *name = NULL;
+
+  if (element->local_name == 0) {
+    if (element->uninterned_local_name == NULL)
+      return NULL;
+
+    *len = element->uninterned_local_name->size;
+    return element->uninterned_local_name->data;
+  }
+
+  switch (element->namespace) {
+    case INFRA_NAMESPACE_HTML:
+      name = k_html_tag_names[element->local_name];
+      break;
+
+    case INFRA_NAMESPACE_SVG:
+      name = k_svg_tag_names[element->local_name];
+      break;
+
+    case INFRA_NAMESPACE_MATHML:
+      name = k_mathml_tag_names[element->local_name];
+      break;
+
+    default:
+      return NULL;
+  }
+
+  *len = strlen(name);
+  return name;
+}
+
+static struct dom_html_collection *
+create_collection(struct dom_node *root)
+{
+  InfraArena *previous = infra_arena_enter(NULL);
+  struct dom_html_collection *collection = DOM_NEW_OBJECT( html_collection );
+
+  collection->root = dom_strong_ref_object(root);
+  collection->cache = infra_stack_create();
+
+  infra_arena_leave(previous);
+
+  return collection;
+}
+
+/* START BY TAG NAME */
+
+static bool
+is_all(const struct dom_html_collection *collection)
+{
+  return collection->name->size == 1 && collection->name->data[0] == '*';
+}
+
+/* 4.2.6 "list of elements with qualified name", for HTML documents */
+static bool
+matches_tag(const struct dom_html_collection *collection,
+            const struct dom_element *element)
+{
+  const InfraString *expected;
+  const char *name;
+  size_t len;
+
+  if (element->local_name != 0) {
+    switch (element->namespace) {
+      case INFRA_NAMESPACE_HTML:
+        return element->local_name == collection->html_tag;
+      case INFRA_NAMESPACE_SVG:
+        return element->local_name == collection->svg_tag;
+      case INFRA_NAMESPACE_MATHML:
+        return element->local_name == collection->mathml_tag;
+      default:
+        break;
+    }
+  }
+
+  if ((name = element_name(element, &len)) == NULL)
+    return false;
+
+  expected = element->namespace == INFRA_NAMESPACE_HTML
+           ? collection->lower_name : collection->name;
+
+  return len == expected->size && memcmp(name, expected->data, len) == 0;
+}
+
+struct merge_source {
+  InfraStack *list;
+  uint32_t pos;
+  bool filter; /* uninterned names, not all of which match */
+};
+
+static void
+add_source(struct merge_source *sources, uint32_t *count, InfraStack *list,
+           bool filter)
+{
+  if (list != NULL)
+    sources[(*count)++] = (struct merge_source) { list, 0, filter };
+}
+
+static struct dom_element *
+source_head(const struct dom_html_collection *collection,
+            struct merge_source *source)
+{
+  while (source->pos < source->list->size) {
+    struct dom_element *element = source->list->items[source->pos];
+
+    if (!source->filter || matches_tag(collection, element))
+      return element;
+
+    source->pos++;
+  }
+
+  return NULL;
+}
+
+/*
+ * Merge the document's lists for every tag the name can stand for. The
+ * lists of uninterned names (usually custom elements) are filtered.
+ */
+static void
+gather_from_tag_index(struct dom_html_collection *collection,
+                      struct dom_document *document)
+{
+  struct merge_source sources[7];
+  uint32_t count = 0;
+
+  if (collection->html_tag != 0)
+    add_source(sources, &count, dom_document_elements_by_tag(document,
+               INFRA_NAMESPACE_HTML, collection->html_tag), false);
+  if (collection->svg_tag != 0)
+    add_source(sources, &count, dom_document_elements_by_tag(document,
+               INFRA_NAMESPACE_SVG, collection->svg_tag), false);
+  if (collection->mathml_tag != 0)
+    add_source(sources, &count, dom_document_elements_by_tag(document,
+               INFRA_NAMESPACE_MATHML, collection->mathml_tag), false);
+
+  add_source(sources, &count, dom_document_elements_by_tag(document,
+             INFRA_NAMESPACE_HTML, 0), true);
+  add_source(sources, &count, dom_document_elements_by_tag(document,
+             INFRA_NAMESPACE_SVG, 0), true);
+  add_source(sources, &count, dom_document_elements_by_tag(document,
+             INFRA_NAMESPACE_MATHML, 0), true);
+  add_source(sources, &count, dom_document_elements_by_tag(document,
+             INFRA_NAMESPACE_NONE, 0), true);
+
+  /* the common case: one list, copied as is */
+  if (count == 1 && !sources[0].filter) {
+    infra_stack_push_n(collection->cache, sources[0].list->items,
+                       sources[0].list->size);
+    return;
+  }
+
+  for (;;) {
+    struct merge_source *best = NULL;
+    struct dom_element *best_head = NULL;
+
+    for (uint32_t i = 0; i < count; i++) {
+      struct dom_element *head = source_head(collection, &sources[i]);
+
+      if (head != NULL
+       && (best_head == NULL
+        || dom_node_precedes((struct dom_node *) head,
+                             (struct dom_node *) best_head))) {
+        best = &sources[i];
+        best_head = head;
+      }
+    }
+
+    if (best == NULL)
+      break;
+
+    infra_stack_push(collection->cache, best_head);
+    best->pos++;
+  }
+}
+
+struct dom_html_collection *
+dom_get_elements_by_tag_name(struct dom_node *root, const char *name,
+                             size_t len)
+{
+  struct dom_html_collection *collection = create_collection(root);
+  InfraArena *previous = infra_arena_enter(NULL);
+  const char *lower;
+  uint16_t tag;
+
+  /* copies, not atoms: the atom table would keep every name queried */
+  collection->name = infra_string_create();
+  collection->lower_name = infra_string_create();
+
+  infra_arena_leave(previous);
+
+  infra_string_append(collection->name, name, len);
+
+  for (size_t i = 0; i < len; i++)
+    infra_string_put_char(collection->lower_name,
+                          name[i] >= 'A' && name[i] <= 'Z'
+                          ? name[i] + 0x20 : name[i]);
+
+  lower = collection->lower_name->data;
+
+  collection->html_tag = html_tag_lookup(lower, len);
+
+  /* foreign tags keep their case, so "clippath" is not clipPath */
+  if ((tag = html_svg_tag_lookup(lower, len)) != 0
+   && strlen(k_svg_tag_names[tag]) == len
+   && memcmp(k_svg_tag_names[tag], name, len) == 0)
+    collection->svg_tag = tag;
+
+  if ((tag = html_mathml_tag_lookup(lower, len)) != 0
+   && strlen(k_mathml_tag_names[tag]) == len
+   && memcmp(k_mathml_tag_names[tag], name, len) == 0)
+    collection->mathml_tag = tag;
+
+  return collection;
+}
+
+/* END BY TAG NAME */
+
+/* START BY CLASS NAME */
+
+static bool
+has_class(const InfraString *classes, const InfraString *name, bool quirks)
+{
+  const char *p = classes->data, *end = p + classes->size;
+
+  while (p < end) {
+    const char *start;
+
+    while (p < end && is_ascii_whitespace(*p))
+      p++;
+
+    for (start = p; p < end && !is_ascii_whitespace(*p); p++)
+      ;
+
+    if ((size_t) (p - start) == name->size && p != start
+     && (quirks ? strncasecmp(start, name->data, name->size) == 0
+                : memcmp(start, name->data, name->size) == 0))
+      return true;
+  }
+
+  return false;
+}
+
+static bool
+matches_classes(const struct dom_html_collection *collection,
+                const struct dom_element *element, bool quirks)
+{
+  InfraString *classes = dom_element_get_attribute(element, "class", 5);
+
+  if (classes == NULL)
+    return false;
+
+  INFRA_STACK_FOREACH(collection->class_names, i)
+    if (!has_class(classes, collection->class_names->items[i], quirks))
+      return false;
+
+  return true;
+}
+
+struct dom_html_collection *
+dom_get_elements_by_class_name(struct dom_node *root, const char *names,
+                               size_t len)
+{
+  struct dom_html_collection *collection = create_collection(root);
+  const char *p = names, *end = names + len;
+  InfraArena *previous = infra_arena_enter(NULL);
+
+  collection->class_names = infra_stack_create();
+
+  infra_arena_leave(previous);
+
+  while (p < end) {
+    const char *start;
+
+    while (p < end && is_ascii_whitespace(*p))
+      p++;
+
+    for (start = p; p < end && !is_ascii_whitespace(*p); p++)
+      ;
+
+    if (p != start) {
+      InfraString *class_name;
+
+      previous = infra_arena_enter(NULL);
+      class_name = infra_string_create();
+      infra_arena_leave(previous);
+
+      infra_string_append(class_name, start, p - start);
+      infra_stack_push(collection->class_names, class_name);
+    }
+  }
+
+  return collection;
+}
+
+/* END BY CLASS NAME */
+
+static void
+gather(struct dom_html_collection *collection, struct dom_document *document)
+{
+  struct dom_node *root = collection->root;
+  bool quirks = document != NULL && document->mode == DOM_DOCUMENT_MODE_QUIRKS;
+
+  collection->cache->size = 0;
+
+  if (collection->name != NULL && !is_all(collection)
+   && (struct dom_node *) document == root) {
+    gather_from_tag_index(collection, document);
+    return;
+  }
+
+  /* no class names: empty */
+  if (collection->class_names != NULL && collection->class_names->size == 0)
+    return;
+
+  DOM_FOREACH_PREORDER(root, node) {
+    struct dom_element *element = (DOMAny *) node;
+
+    if (node == root || !DOM_IMPLEMENTS(node, element))
+      continue;
+
+    if (collection->name != NULL ? is_all(collection)
+                                   || matches_tag(collection, element)
+                                 : matches_classes(collection, element, quirks))
+      infra_stack_push(collection->cache, element);
+  }
+}
+
+static InfraStack *
+cached_items(struct dom_html_collection *collection)
+{
+  struct dom_document *document = document_of(collection->root);
+  uint64_t version = document != NULL ? document->version : 0;
+
+  if (!collection->cache_valid || collection->cache_version != version) {
+    gather(collection, document);
+    collection->cache_version = version;
+    collection->cache_valid = true;
+  }
+
+  return collection->cache;
+}
+
+uint32_t
+dom_html_collection_length(struct dom_html_collection *collection)
+{
+  return cached_items(collection)->size;
+}
+
+struct dom_element *
+dom_html_collection_item(struct dom_html_collection *collection,
+                         uint32_t index)
+{
+  InfraStack *items = cached_items(collection);
+
+  return index < items->size ? items->items[index] : NULL;
+}
@@ -1,40 +1,156 @@
 #include <wfs/dom_core.h>
+#include <wfs/dom_mutation.h>
+#include <wfs/dom_traversal.h>
+#include <wfs/html_foreign.h>
+#include <wfs/html_tags.h>
+#include <wfs/infra_atom.h>
 #include <stdlib.h>
+#include <string.h>
+#include <threads.h>
 
 /* START INTERFACES */
 
 DOM_DEFINE_INTERFACE(event_target) {
   .name = "EventTarget",
+  DOM_ANCESTRY(event_target),
   .impl_size = sizeof (struct dom_event_target),
 };
 
-static void
-node_finalizer(DOMObject *obj)
+/*
+ * Children whose last reference was held by a dying parent, linked through
+ * next_sibling. The outermost dom_node_finalizer() frees them in a loop, so
+ * teardown takes constant stack however deep the tree is.
+ */
+static thread_local struct dom_node *dying_nodes;
+static thread_local bool draining_dying_nodes;
+
+void
+dom_node_finalizer(DOMObject *obj)
 {
   struct dom_node *node = (DOMAny *) obj;
 
+  struct dom_node *child = node->first_child;
+
   dom_weak_unref_object(node->node_document);
   dom_weak_unref_object(node->parent);
 
-  if (node->children != NULL) {
-    INFRA_STACK_FOREACH(node->children, i)
-      dom_strong_unref_object(node->children->items[i]);
+  /*
+   * Children kept alive elsewhere become roots. Their weak references to
+   * node die with it, so they are dropped without touching its count.
+   */
+  while (child != NULL) {
+    struct dom_node *next = child->next_sibling;
+    DOMHeader *hdr = &((DOMObject *) child)->header;
+    int_least32_t refcnt;
+
+    child->parent = NULL;
+    child->prev_sibling = NULL;
+    child->next_sibling = NULL;
+
+    if (hdr->frozen) {
+      refcnt = DOM_FROZEN_DEC(hdr->strong_refcnt);
+    } else {
+      refcnt = --hdr->strong_refcnt;
+      DOM_TRACE(DOM_TRACE_UNREF, child);
+    }
+
+    if (refcnt > 0) {
+      dom_cc_possible_root((DOMObject *) child);
+    } else if (hdr->cc_color != DOM_CC_GARBAGE) {
+      if (hdr->cc_slot != 0)
+        dom_cc_unbuffer((DOMObject *) child);
+
+      child->next_sibling = dying_nodes;
+      dying_nodes = child;
+    }
+
+    child = next;
+  }
+
+  if (node->child_index != NULL)
+    infra_stack_free(node->child_index);
+
+  if (draining_dying_nodes)
+    return;
+
+  draining_dying_nodes = true;
 
-    infra_stack_free(node->children);
+  while (dying_nodes != NULL) {
+    struct dom_node *dying = dying_nodes;
+
+    dying_nodes = dying->next_sibling;
+    dying->next_sibling = NULL;
+
+    dom_free_object((DOMObject *) dying);
   }
+
+  draining_dying_nodes = false;
+}
+
+static void
+node_traverse(DOMObject *obj, DOMVisitFunc visit, void *ctx)
+{
+  DOM_NODE_FOREACH_CHILD((struct dom_node *) obj, child)
+    visit((DOMObject *) child, ctx);
+}
+
+static struct dom_cc_buffer **
+node_cc_buffer(DOMObject *obj)
+{
+  struct dom_node *node = (DOMAny *) obj;
+  struct dom_document *document = DOM_IMPLEMENTS(node, document)
+    ? (struct dom_document *) node : node->node_document;
+
+  return document != NULL ? &document->cc_buffer : NULL;
 }
 
 DOM_DEFINE_INTERFACE(node) {
   .name = "Node",
   .parent_interface = DOM_INTERFACE(event_target),
+  DOM_ANCESTRY(event_target, node),
   .impl_size = sizeof (struct dom_node),
-  .finalizer = node_finalizer,
+  DOM_FINALIZERS(dom_node_finalizer),
+  .traverse = node_traverse,
+  .cc_buffer = node_cc_buffer,
 };
 
+static void id_index_free(struct dom_id_index *index);
+static void tag_index_free(struct dom_tag_index *index);
+
+static void
+document_finalizer(DOMObject *obj)
+{
+  struct dom_document *document = (DOMAny *) obj;
+
+  if (document->arena == NULL && document->id_index != NULL)
+    id_index_free(document->id_index);
+
+  if (document->arena == NULL && document->tag_index != NULL)
+    tag_index_free(document->tag_index);
+
+  /* O(chunks): skip the per-node teardown in dom_node_finalizer() */
+  if (document->arena != NULL) {
+    infra_arena_destroy(document->arena);
+    ((struct dom_node *) document)->first_child = NULL;
+    ((struct dom_node *) document)->last_child = NULL;
+  }
+
+  dom_source_unref(document->source);
+  dom_mutation_release(document);
+
+  /* the tree goes first, so that the cycles it leaves can be collected */
+  dom_node_finalizer(obj);
+  dom_cc_release(document->cc_buffer);
+  document->cc_buffer = NULL;
+}
+
+/* document_finalizer() runs dom_node_finalizer() itself */
 DOM_DEFINE_INTERFACE(document) {
   .name = "Document",
   .parent_interface = DOM_INTERFACE(node),
+  DOM_ANCESTRY(event_target, node, document),
   .impl_size = sizeof (struct dom_document),
+  DOM_FINALIZERS(document_finalizer),
 };
 
 static void
@@ -50,8 +166,9 @@ document_type_finalizer(DOMObject *obj)
 DOM_DEFINE_INTERFACE(document_type) {
   .name = "DocumentType",
   .parent_interface = DOM_INTERFACE(node),
+  DOM_ANCESTRY(event_target, node, document_type),
   .impl_size = sizeof (struct dom_document_type),
-  .finalizer = document_type_finalizer,
+  DOM_FINALIZERS(document_type_finalizer, dom_node_finalizer),
 };
 
 static void
@@ -62,30 +179,65 @@ document_fragment_finalizer(DOMObject *obj)
   dom_strong_unref_object(fragment->host);
 }
 
+static void
+document_fragment_traverse(DOMObject *obj, DOMVisitFunc visit, void *ctx)
+{
+  struct dom_document_fragment *fragment = (DOMAny *) obj;
+
+  if (fragment->host != NULL)
+    visit((DOMObject *) fragment->host, ctx);
+}
+
 DOM_DEFINE_INTERFACE(document_fragment) {
   .name = "DocumentFragment",
   .parent_interface = DOM_INTERFACE(node),
+  DOM_ANCESTRY(event_target, node, document_fragment),
   .impl_size = sizeof (struct dom_document_fragment),
-  .finalizer = document_fragment_finalizer,
+  DOM_FINALIZERS(document_fragment_finalizer, dom_node_finalizer),
+  .traverse = document_fragment_traverse,
 };
 
-static void
-element_finalizer(DOMObject *obj)
+void
+dom_element_finalizer(DOMObject *obj)
 {
   struct dom_element *elem = (DOMAny *) obj;
 
-  if (elem->attrs != NULL)
-  {
-    INFRA_STACK_FOREACH(elem->attrs, i)
-      dom_strong_unref_object(elem->attrs->items[i]);
+  for (uint32_t i = 0; i < elem->num_attrs; i++) {
+    struct dom_attr_slot *slot = &elem->attrs[i];
+
+    infra_string_unref(slot->value);
+
+    if (slot->node != NULL) {
+      /* as for children in dom_node_finalizer() */
+      slot->node->element = NULL;
+      dom_strong_unref_object(slot->node);
+    }
   }
+
+  if (elem->attrs != NULL)
+    infra_arena_free(((DOMObject *) elem)->header.arena, elem->attrs,
+                     elem->attrs_cap * sizeof (*elem->attrs));
+
+  infra_string_unref(elem->uninterned_local_name);
+}
+
+static void
+element_traverse(DOMObject *obj, DOMVisitFunc visit, void *ctx)
+{
+  struct dom_element *elem = (DOMAny *) obj;
+
+  for (uint32_t i = 0; i < elem->num_attrs; i++)
+    if (elem->attrs[i].node != NULL)
+      visit((DOMObject *) elem->attrs[i].node, ctx);
 }
 
 DOM_DEFINE_INTERFACE(element) {
   .name = "Element",
   .parent_interface = DOM_INTERFACE(node),
+  DOM_ANCESTRY(event_target, node, element),
   .impl_size = sizeof (struct dom_element),
-  .finalizer = element_finalizer,
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
+  .traverse = element_traverse,
 };
 
 static void
@@ -101,115 +253,1363 @@ attr_finalizer(DOMObject *obj)
 DOM_DEFINE_INTERFACE(attr) {
   .name = "Attr",
   .parent_interface = DOM_INTERFACE(node),
+  DOM_ANCESTRY(event_target, node, attr),
   .impl_size = sizeof (struct dom_attr),
-  .finalizer = attr_finalizer,
+  DOM_FINALIZERS(attr_finalizer, dom_node_finalizer),
 };
 
-static void
-character_data_finalizer(DOMObject *obj)
+void
+dom_character_data_finalizer(DOMObject *obj)
 {
   struct dom_character_data *cd = (DOMAny *) obj;
 
   infra_string_unref(cd->data);
+
+  if (cd->borrowed != NULL && obj->header.arena == NULL)
+    dom_source_unref(cd->source);
 }
 
 DOM_DEFINE_INTERFACE(character_data) {
   .name = "CharacterData",
   .parent_interface = DOM_INTERFACE(node),
+  DOM_ANCESTRY(event_target, node, character_data),
   .impl_size = sizeof (struct dom_character_data),
-  .finalizer = character_data_finalizer,
+  DOM_FINALIZERS(dom_character_data_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(text) {
   .name = "Text",
   .parent_interface = DOM_INTERFACE(character_data),
+  DOM_ANCESTRY(event_target, node, character_data, text),
   .impl_size = sizeof (struct dom_text),
+  DOM_FINALIZERS(dom_character_data_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(comment) {
   .name = "Comment",
   .parent_interface = DOM_INTERFACE(character_data),
+  DOM_ANCESTRY(event_target, node, character_data, comment),
   .impl_size = sizeof (struct dom_comment),
+  DOM_FINALIZERS(dom_character_data_finalizer, dom_node_finalizer),
 };
 
 /* END INTERFACES */
 
 /* START ALGORITHMS */
-struct dom_node *
-dom_pre_insert_node(struct dom_node *parent,
-                    struct dom_node *node,
-                    struct dom_node *child)
+
+/* Fills node->child_index if a mutation emptied it */
+static InfraStack *
+build_child_index(struct dom_node *node)
 {
-  /* XXX Do some safety checks */
-  dom_insert_node(parent, node, child, false);
-  return node;
+  if (node->child_index == NULL) {
+    InfraArena *previous = infra_arena_enter(
+      ((DOMObject *) node)->header.arena);
+    node->child_index = infra_stack_create();
+    infra_arena_leave(previous);
+  }
+
+  if (node->child_index->size == 0) {
+    infra_stack_reserve(node->child_index, node->num_children);
+
+    DOM_NODE_FOREACH_CHILD(node, child)
+      infra_stack_push(node->child_index, child);
+  }
+
+  return node->child_index;
 }
 
-void
-dom_insert_node(struct dom_node *parent,
-                struct dom_node *node,
-                struct dom_node *child,
-                bool suppress_observers)
+/* Spreads the positions of node's children as far apart as they go */
+static void
+order_children(struct dom_node *node)
 {
-  /* XXX handle document fragments */
-  /* XXX adopt node */
-  (void) suppress_observers;
+  uint64_t step = UINT64_MAX / ((uint64_t) node->num_children + 1);
+  uint64_t position = 0;
+
+  DOM_NODE_FOREACH_CHILD(node, child)
+    child->child_position = position += step;
+
+  node->children_ordered = true;
+}
+
+/*
+ * Gives node, just inserted into an ordered parent, a position between its
+ * siblings'. Without room there, the smallest window around node, doubled
+ * each time, that leaves more than one unused position per child for each
+ * child in it is respread; asking larger windows for more room keeps the
+ * renumbering amortized logarithmic, even for inserts in one place.
+ */
+static void
+order_inserted_child(struct dom_node *node)
+{
+  struct dom_node *first = node, *last = node;
+  uint64_t count = 1, lo, hi, step;
+
+  for (;;) {
+    lo = first->prev_sibling != NULL ? first->prev_sibling->child_position : 0;
+    hi = last->next_sibling != NULL ? last->next_sibling->child_position
+                                    : UINT64_MAX;
+    step = (hi - lo) / (count + 1);
+
+    if (step > count
+     || (first->prev_sibling == NULL && last->next_sibling == NULL))
+      break;
+
+    for (uint64_t i = count; i > 0; i--) {
+      if (first->prev_sibling != NULL) {
+        first = first->prev_sibling;
+        count++;
+      }
+      if (last->next_sibling != NULL) {
+        last = last->next_sibling;
+        count++;
+      }
+    }
+  }
+
+  for (struct dom_node *n = first; n != last->next_sibling; n = n->next_sibling)
+    n->child_position = lo += step;
+}
+
+bool
+dom_node_precedes(const struct dom_node *a, const struct dom_node *b)
+{
+  struct dom_node *parent;
+  uint32_t depth_a = 0, depth_b = 0;
+
+  for (const struct dom_node *n = a; n->parent != NULL; n = n->parent)
+    depth_a++;
+  for (const struct dom_node *n = b; n->parent != NULL; n = n->parent)
+    depth_b++;
+
+  /* an ancestor comes before its descendants */
+  for (; depth_a > depth_b; depth_a--)
+    if ((a = a->parent) == b)
+      return false;
+  for (; depth_b > depth_a; depth_b--)
+    if ((b = b->parent) == a)
+      return true;
+
+  if (a == b)
+    return false;
+
+  while (a->parent != b->parent) {
+    a = a->parent;
+    b = b->parent;
+  }
+
+  /* siblings compare by position, unless frozen without one (freeze_visit) */
+  parent = a->parent;
+
+  if (!parent->children_ordered && !dom_is_frozen(parent))
+    order_children(parent);
+
+  if (parent->children_ordered)
+    return a->child_position < b->child_position;
+
+  for (const struct dom_node *n = a->next_sibling; n != NULL; n = n->next_sibling)
+    if (n == b)
+      return true;
+
+  return false;
+}
+
+/* START TREE ORDER LISTS */
+
+/*
+ * Element lists kept in tree order, as the indexes below need. at_end says
+ * element is known to follow everything already listed, which is what the
+ * parser almost always produces; otherwise both directions binary-search.
+ */
+static void
+ordered_insert(InfraStack *list, struct dom_element *element, bool at_end)
+{
+  uint32_t lo = 0, hi = list->size;
 
-  if (child == NULL) {
-    node->parent = dom_weak_ref_object(parent);
-    infra_stack_push(parent->children,
-      dom_strong_ref_object(node));
+  if (at_end)
+    lo = hi;
+
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+
+    if (dom_node_precedes((struct dom_node *) element, list->items[mid]))
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  infra_stack_push(list, element);
+  memmove(&list->items[lo + 1], &list->items[lo],
+          (list->size - 1 - lo) * sizeof (void *));
+  list->items[lo] = element;
+}
+
+/*
+ * Removes the elements from first to last, inclusive, so that disconnecting
+ * a subtree erases its run from each list once instead of element by element.
+ */
+static void
+ordered_remove_range(InfraStack *list, const struct dom_node *first,
+                     const struct dom_node *last)
+{
+  uint32_t lo = 0, hi = list->size, end;
+
+  if (first == last && hi != 0 && list->items[hi - 1] == first) {
+    list->size--;
     return;
   }
 
-  abort();
-  /* ... */
-  /* Yikes! */
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+
+    if (dom_node_precedes(list->items[mid], first))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  for (end = lo, hi = list->size; end < hi; ) {
+    uint32_t mid = end + (hi - end) / 2;
+
+    if (dom_node_precedes(last, list->items[mid]))
+      hi = mid;
+    else
+      end = mid + 1;
+  }
+
+  if (end > lo)
+    infra_stack_erase(list, lo, end - lo);
 }
 
-void
-dom_append_node(struct dom_node *parent, struct dom_node *node)
+/* END TREE ORDER LISTS */
+
+/* START ID INDEX */
+
+/*
+ * Open addressing over ids. Entries whose list empties stay until the next
+ * resize, so removals never have to move anything.
+ */
+struct dom_id_entry {
+  InfraString *id; /* the index's own copy of the key; NULL if unused */
+  InfraStack *elements; // -> phantom references, in tree order
+};
+
+struct dom_id_index {
+  struct dom_id_entry *entries;
+  uint32_t cap; /* power of two */
+  uint32_t count;
+};
+
+static const uint32_t k_id_index_initial_cap = 16;
+
+static bool
+is_id_attr(const struct dom_attr_slot *attr)
 {
-  dom_pre_insert_node(parent, node, NULL);
+  return attr->namespace == INFRA_NAMESPACE_NONE
+      && attr->local_name->size == 2
+      && memcmp(attr->local_name->data, "id", 2) == 0;
+}
+
+static InfraString *
+element_id(const struct dom_element *element)
+{
+  for (uint32_t i = 0; i < element->num_attrs; i++)
+    if (is_id_attr(&element->attrs[i]))
+      return element->attrs[i].value;
+
+  return NULL;
+}
+
+static struct dom_id_entry *
+id_index_slot(struct dom_id_index *index, const char *id, size_t len,
+              uint32_t hash)
+{
+  for (uint32_t i = hash; ; i++) {
+    struct dom_id_entry *entry = &index->entries[i & (index->cap - 1)];
+
+    if (entry->id == NULL
+     || (entry->id->size == len && memcmp(entry->id->data, id, len) == 0))
+      return entry;
+  }
+}
+
+static void
+id_index_free(struct dom_id_index *index)
+{
+  for (uint32_t i = 0; i < index->cap; i++)
+    if (index->entries[i].id != NULL) {
+      infra_string_free(index->entries[i].id);
+      infra_stack_free(index->entries[i].elements);
+    }
+
+  infra_arena_free(NULL, index->entries, index->cap * sizeof (*index->entries));
+  infra_arena_free(NULL, index, sizeof (*index));
+}
+
+static void
+id_index_grow(struct dom_document *document)
+{
+  struct dom_id_index *index = document->id_index;
+  struct dom_id_entry *old_entries = index->entries;
+  uint32_t old_cap = index->cap, live = 0, cap = k_id_index_initial_cap;
+
+  for (uint32_t i = 0; i < old_cap; i++)
+    if (old_entries[i].id != NULL && old_entries[i].elements->size != 0)
+      live++;
+
+  while (cap < 2 * (live + 1))
+    cap *= 2;
+
+  index->entries = infra_arena_alloc(document->arena, cap * sizeof (*index->entries));
+  index->cap = cap;
+  index->count = 0;
+
+  for (uint32_t i = 0; i < old_cap; i++) {
+    struct dom_id_entry *entry = &old_entries[i];
+
+    if (entry->id == NULL)
+      continue;
+
+    if (entry->elements->size == 0) {
+      infra_string_free(entry->id);
+      infra_stack_free(entry->elements);
+      continue;
+    }
+
+    *id_index_slot(index, entry->id->data, entry->id->size,
+                   infra_string_hash(entry->id)) = *entry;
+    index->count++;
+  }
+
+  infra_arena_free(document->arena, old_entries, old_cap * sizeof (*old_entries));
+}
+
+static void
+id_index_add(struct dom_document *document, struct dom_element *element,
+             InfraString *value, bool at_end)
+{
+  struct dom_id_entry *entry;
+
+  if (value->size == 0)
+    return;
+
+  if (document->id_index == NULL)
+    document->id_index = infra_arena_alloc(document->arena,
+                                           sizeof (*document->id_index));
+
+  if (2 * (document->id_index->count + 1) > document->id_index->cap)
+    id_index_grow(document);
+
+  entry = id_index_slot(document->id_index, value->data, value->size,
+                        infra_string_hash(value));
+
+  if (entry->id == NULL) {
+    InfraArena *previous = infra_arena_enter(document->arena);
+
+    entry->id = infra_string_create();
+    infra_string_append(entry->id, value->data, value->size);
+    entry->elements = infra_stack_create();
+    document->id_index->count++;
+
+    infra_arena_leave(previous);
+  }
+
+  ordered_insert(entry->elements, element, at_end);
+}
+
+/* Removes element, and any later element up to last with the same id */
+static void
+id_index_remove(struct dom_document *document, struct dom_element *element,
+                InfraString *value, const struct dom_node *last)
+{
+  struct dom_id_entry *entry;
+
+  if (document->id_index == NULL || value->size == 0)
+    return;
+
+  entry = id_index_slot(document->id_index, value->data, value->size,
+                        infra_string_hash(value));
+
+  if (entry->id == NULL)
+    return;
+
+  ordered_remove_range(entry->elements, (struct dom_node *) element, last);
 }
 
-/* XXX Add uninterned version */
 struct dom_element *
-dom_create_element_interned(struct dom_document *document, uint16_t local_name,
-                            enum InfraNamespace namespace,
-                            const void *prefix, const void *is,
-                            bool sync_custom_elements)
+dom_document_get_element_by_id(struct dom_document *document,
+                               const char *id, size_t len)
 {
-  struct dom_element *result = NULL;
+  struct dom_id_entry *entry;
 
-  (void) prefix;
-  (void) is;
-  (void) sync_custom_elements;
+  if (document->id_index == NULL || len == 0)
+    return NULL;
 
-  /* XXX custom elements */
-  /* XXX non-HTML elements */
+  entry = id_index_slot(document->id_index, id, len, infra_hash_bytes(id, len));
 
-  /*
-   * XXX: currently, this section only involves the third case in the spec,
-   * where there is no custom element definition for the tag name.
-   */
+  if (entry->id == NULL || entry->elements->size == 0)
+    return NULL;
 
-  /* otherwise: */ {
-    /* XXX: CIRCULAR DEPENDENCY */
-    extern const DOMInterface *k_html_element_interfaces[];
+  return entry->elements->items[0];
+}
 
-    const DOMInterface *interface = k_html_element_interfaces[local_name];
+/* END ID INDEX */
 
-    result = dom_alloc_object( interface );
+/* START TAG INDEX */
 
-    result->namespace  = namespace;
-    result->local_name = local_name;
+/* One list per interned tag and namespace, allocated on first use */
+struct dom_tag_index {
+  InfraStack *html[NUM_HTML_TAG]; // -> phantom references, in tree order
+  InfraStack *svg[NUM_SVG_TAG];
+  InfraStack *mathml[NUM_MATHML_TAG];
+  InfraStack *other; /* every other namespace */
+};
 
-    ((struct dom_node *) result)->node_document = dom_weak_ref_object(document);
-    ((struct dom_node *) result)->children = infra_stack_create();
+static InfraStack **
+tag_index_slot(struct dom_tag_index *index, enum InfraNamespace namespace,
+               uint16_t local_name)
+{
+  switch (namespace) {
+    case INFRA_NAMESPACE_HTML:
+      return local_name < NUM_HTML_TAG ? &index->html[local_name] : NULL;
+
+    case INFRA_NAMESPACE_SVG:
+      return local_name < NUM_SVG_TAG ? &index->svg[local_name] : NULL;
+
+    case INFRA_NAMESPACE_MATHML:
+      return local_name < NUM_MATHML_TAG ? &index->mathml[local_name] : NULL;
+
+    default:
+      return &index->other;
   }
+}
 
-  return result;
+static void
+tag_index_free(struct dom_tag_index *index)
+{
+  InfraStack **lists = (InfraStack **) index;
+
+  for (size_t i = 0; i < sizeof (*index) / sizeof (*lists); i++)
+    if (lists[i] != NULL)
+      infra_stack_free(lists[i]);
+
+  infra_arena_free(NULL, index, sizeof (*index));
 }
 
-/* END ALGORITHMS */
+static void
+tag_index_add(struct dom_document *document, struct dom_element *element,
+              bool at_end)
+{
+  InfraStack **slot;
+
+  if (document->tag_index == NULL)
+    document->tag_index = infra_arena_alloc(document->arena,
+                                            sizeof (*document->tag_index));
+
+  slot = tag_index_slot(document->tag_index, element->namespace,
+                        element->local_name);
+
+  if (slot == NULL)
+    return;
+
+  if (*slot == NULL) {
+    InfraArena *previous = infra_arena_enter(document->arena);
+    *slot = infra_stack_create();
+    infra_arena_leave(previous);
+  }
+
+  ordered_insert(*slot, element, at_end);
+}
+
+/* Removes element, and any later element up to last with the same name */
+static void
+tag_index_remove(struct dom_document *document, struct dom_element *element,
+                 const struct dom_node *last)
+{
+  InfraStack **slot;
+
+  if (document->tag_index == NULL)
+    return;
+
+  slot = tag_index_slot(document->tag_index, element->namespace,
+                        element->local_name);
+
+  if (slot != NULL && *slot != NULL)
+    ordered_remove_range(*slot, (struct dom_node *) element, last);
+}
+
+InfraStack *
+dom_document_elements_by_tag(struct dom_document *document,
+                             enum InfraNamespace namespace, uint16_t local_name)
+{
+  InfraStack **slot;
+
+  if (document->tag_index == NULL)
+    return NULL;
+
+  slot = tag_index_slot(document->tag_index, namespace, local_name);
+
+  if (slot == NULL || *slot == NULL || (*slot)->size == 0)
+    return NULL;
+
+  return *slot;
+}
+
+/* END TAG INDEX */
+
+/* START CONNECTEDNESS */
+
+/* Last node in tree order, found again after removals */
+static struct dom_node *
+document_tail(struct dom_document *document)
+{
+  struct dom_node *tail = document->tree_tail;
+
+  if (tail == NULL) {
+    tail = (struct dom_node *) document;
+
+    while (tail->last_child != NULL)
+      tail = tail->last_child;
+
+    document->tree_tail = tail;
+  }
+
+  return tail;
+}
+
+/*
+ * Whether appending to parent puts the new nodes after everything else in
+ * document, i.e. parent is an inclusive ancestor of the tail. The parser
+ * appends to the current node, which is at most a few end tags above it.
+ */
+static bool
+appends_at_end(struct dom_document *document, struct dom_node *parent)
+{
+  for (struct dom_node *n = document_tail(document); n != NULL; n = n->parent)
+    if (n == parent)
+      return true;
+
+  return false;
+}
+
+/* node was just inserted into, or is about to leave, document's tree */
+static void
+set_connected(struct dom_document *document, struct dom_node *node,
+              bool connected, bool at_end)
+{
+  struct dom_node *last = node;
+
+  while (last->last_child != NULL)
+    last = last->last_child;
+
+  DOM_FOREACH_PREORDER(node, n) {
+    struct dom_element *element = (DOMAny *) n;
+    InfraString *id;
+
+    n->is_connected = connected;
+
+    if (!DOM_IMPLEMENTS(n, element))
+      continue;
+
+    if (connected)
+      tag_index_add(document, element, at_end);
+    else
+      tag_index_remove(document, element, last);
+
+    if ((id = element_id(element)) == NULL)
+      continue;
+
+    if (connected)
+      id_index_add(document, element, id, at_end);
+    else
+      id_index_remove(document, element, id, last);
+  }
+}
+
+static struct dom_document *
+document_of(struct dom_node *node)
+{
+  if (DOM_IMPLEMENTS(node, document))
+    return (struct dom_document *) node;
+
+  return node->node_document;
+}
+
+/* END CONNECTEDNESS */
+
+struct dom_node *
+dom_pre_insert_node(struct dom_node *parent,
+                    struct dom_node *node,
+                    struct dom_node *child)
+{
+  /* XXX Do some safety checks */
+  dom_insert_node(parent, node, child, false);
+  return node;
+}
+
+void
+dom_insert_node(struct dom_node *parent,
+                struct dom_node *node,
+                struct dom_node *child,
+                bool suppress_observers)
+{
+  struct dom_document *document = document_of(parent);
+  struct dom_node *prev;
+  bool at_end = false;
+
+  /* XXX handle document fragments */
+  /* XXX adopt node */
+
+  if (dom_is_frozen(parent) || dom_is_frozen(node))
+    abort();
+
+  if (child == node)
+    child = node->next_sibling;
+
+  dom_strong_ref_object(node);
+
+  if (node->parent != NULL)
+    dom_remove_node(node, suppress_observers);
+
+  if (parent->is_connected && child == NULL)
+    at_end = appends_at_end(document, parent);
+
+  prev = child != NULL ? child->prev_sibling : parent->last_child;
+
+  node->parent = dom_weak_ref_object(parent);
+  node->prev_sibling = prev;
+  node->next_sibling = child;
+
+  if (prev != NULL)
+    prev->next_sibling = node;
+  else
+    parent->first_child = node;
+
+  if (child != NULL)
+    child->prev_sibling = node;
+  else
+    parent->last_child = node;
+
+  parent->num_children++;
+
+  if (parent->child_index != NULL)
+    parent->child_index->size = 0;
+
+  /* removals keep the order, so only inserts need a position */
+  if (parent->children_ordered)
+    order_inserted_child(node);
+
+  if (document != NULL)
+    document->version++;
+
+  if (parent->is_connected) {
+    if (at_end) {
+      struct dom_node *tail = node;
+
+      while (tail->last_child != NULL)
+        tail = tail->last_child;
+
+      document->tree_tail = tail;
+    }
+
+    set_connected(document, node, true, at_end);
+  }
+
+  if (!suppress_observers && document != NULL && document->mutation != NULL)
+    dom_mutation_queue_child_list(document, parent, node, NULL, prev, child);
+}
+
+void
+dom_append_node(struct dom_node *parent, struct dom_node *node)
+{
+  dom_pre_insert_node(parent, node, NULL);
+}
+
+void
+dom_remove_node(struct dom_node *node, bool suppress_observers)
+{
+  struct dom_node *parent = node->parent;
+  struct dom_node *prev = node->prev_sibling;
+  struct dom_node *next = node->next_sibling;
+  struct dom_document *document;
+
+  /* XXX live ranges */
+
+  if (parent == NULL)
+    return;
+
+  document = document_of(parent);
+
+  if (dom_is_frozen(node))
+    abort();
+
+  if (node->node_document != NULL && node->node_document->node_iterators != NULL)
+    dom_node_iterators_pre_remove(node->node_document, node);
+
+  if (node->is_connected) {
+    set_connected(document, node, false, false);
+    document->tree_tail = NULL;
+  }
+
+  if (node->node_document != NULL)
+    node->node_document->version++;
+
+  if (node->prev_sibling != NULL)
+    node->prev_sibling->next_sibling = node->next_sibling;
+  else
+    parent->first_child = node->next_sibling;
+
+  if (node->next_sibling != NULL)
+    node->next_sibling->prev_sibling = node->prev_sibling;
+  else
+    parent->last_child = node->prev_sibling;
+
+  parent->num_children--;
+
+  if (parent->child_index != NULL)
+    parent->child_index->size = 0;
+
+  node->parent = NULL;
+  node->prev_sibling = NULL;
+  node->next_sibling = NULL;
+
+  if (!suppress_observers && document != NULL && document->mutation != NULL)
+    dom_mutation_queue_child_list(document, parent, NULL, node, prev, next);
+
+  dom_weak_unref_object(parent);
+  dom_strong_unref_object(node);
+}
+
+enum DOMNodeType
+dom_node_type(const struct dom_node *node)
+{
+  if (DOM_IMPLEMENTS(node, element))
+    return DOM_ELEMENT_NODE;
+  if (DOM_IMPLEMENTS(node, text))
+    return DOM_TEXT_NODE;
+  if (DOM_IMPLEMENTS(node, comment))
+    return DOM_COMMENT_NODE;
+  if (DOM_IMPLEMENTS(node, attr))
+    return DOM_ATTRIBUTE_NODE;
+  if (DOM_IMPLEMENTS(node, document))
+    return DOM_DOCUMENT_NODE;
+  if (DOM_IMPLEMENTS(node, document_type))
+    return DOM_DOCUMENT_TYPE_NODE;
+
+  return DOM_DOCUMENT_FRAGMENT_NODE;
+}
+
+struct dom_node *
+dom_node_child_at(struct dom_node *node, uint32_t index)
+{
+  if (index >= node->num_children)
+    return NULL;
+
+  /* readers of a frozen tree must not build the index behind each other's back */
+  if (dom_is_frozen(node)
+   && (node->child_index == NULL || node->child_index->size == 0)) {
+    DOM_NODE_FOREACH_CHILD(node, child)
+      if (index-- == 0)
+        return child;
+  }
+
+  return build_child_index(node)->items[index];
+}
+
+struct dom_document *
+dom_create_document(bool arena_backed)
+{
+  InfraArena *previous = infra_arena_enter(NULL);
+  struct dom_document *document = DOM_NEW_OBJECT( document );
+
+  if (arena_backed)
+    document->arena = infra_arena_create();
+
+  ((struct dom_node *) document)->is_connected = true;
+
+  infra_arena_leave(previous);
+
+  return document;
+}
+
+/* Nodes with fewer children are searched linearly once frozen */
+static const uint32_t k_frozen_index_min_children = 8;
+
+static void
+freeze_visit(DOMObject *target, void *ctx)
+{
+  struct dom_node *node = (DOMAny *) target;
+
+  if (target->header.frozen)
+    return;
+
+  /* the collector must not touch the counts of a shared tree */
+  if (target->header.cc_slot != 0)
+    dom_cc_unbuffer(target);
+
+  /* last chance to build the index and order the children */
+  if (DOM_IMPLEMENTS(target, node)
+   && node->num_children >= k_frozen_index_min_children) {
+    dom_node_child_at(node, 0);
+
+    if (!node->children_ordered)
+      order_children(node);
+  }
+
+  target->header.frozen = true;
+  infra_stack_push(ctx, target);
+}
+
+static void
+thaw_visit(DOMObject *target, void *ctx)
+{
+  if (!target->header.frozen)
+    return;
+
+  target->header.frozen = false;
+  infra_stack_push(ctx, target);
+}
+
+/* Apply visit to document and everything strongly reachable from it */
+static void
+walk_document(struct dom_document *document, DOMVisitFunc visit)
+{
+  InfraArena *previous = infra_arena_enter(NULL);
+  InfraStack *work = infra_stack_create();
+  DOMObject *obj;
+
+  infra_arena_leave(previous);
+
+  visit((DOMObject *) document, work);
+
+  while ((obj = infra_stack_pop(work)) != NULL)
+    dom_traverse_object(obj, visit, work);
+
+  infra_stack_free(work);
+}
+
+void
+dom_document_freeze(struct dom_document *document)
+{
+  walk_document(document, freeze_visit);
+}
+
+void
+dom_document_thaw(struct dom_document *document)
+{
+  walk_document(document, thaw_visit);
+}
+
+struct dom_element *
+dom_create_element_interned(struct dom_document *document, uint16_t local_name,
+                            enum InfraNamespace namespace,
+                            const void *prefix, const void *is,
+                            bool sync_custom_elements)
+{
+  struct dom_element *result = NULL;
+  InfraArena *previous = infra_arena_enter(document->arena);
+
+  (void) prefix;
+  (void) is;
+  (void) sync_custom_elements;
+
+  /* XXX custom elements */
+
+  /*
+   * XXX: currently, this section only involves the third case in the spec,
+   * where there is no custom element definition for the tag name.
+   */
+
+  /* otherwise: */ {
+    /* XXX: CIRCULAR DEPENDENCY */
+    extern const DOMInterface *k_html_element_interfaces[];
+    DOM_DECLARE_INTERFACE(html_unknown_element);
+    DOM_DECLARE_INTERFACE(svg_element);
+    DOM_DECLARE_INTERFACE(mathml_element);
+
+    const DOMInterface *interface;
+
+    switch (namespace) {
+      case INFRA_NAMESPACE_HTML:
+        interface = local_name != 0
+                  ? k_html_element_interfaces[local_name]
+                  : DOM_INTERFACE(html_unknown_element);
+        break;
+
+      case INFRA_NAMESPACE_SVG:
+        interface = DOM_INTERFACE(svg_element);
+        break;
+
+      case INFRA_NAMESPACE_MATHML:
+        interface = DOM_INTERFACE(mathml_element);
+        break;
+
+      default:
+        interface = DOM_INTERFACE(element);
+        break;
+    }
+
+    result = dom_alloc_object( interface );
+
+    result->namespace  = namespace;
+    result->local_name = local_name;
+
+    ((struct dom_node *) result)->node_document = dom_weak_ref_object(document);
+  }
+
+  infra_arena_leave(previous);
+
+  return result;
+}
+
+/*
+ * A reference to string for a node allocated from arena. Heap strings are
+ * copied in: nothing would release them when the arena goes away.
+ */
+static InfraString *
+arena_string(InfraArena *arena, InfraString *string)
+{
+  InfraArena *previous;
+  InfraString *copy;
+
+  if (arena == NULL || string == NULL || string->is_atom
+   || string->arena == arena)
+    return infra_string_ref(string);
+
+  previous = infra_arena_enter(arena);
+  copy = infra_string_create();
+  infra_string_append(copy, string->data, string->size);
+  infra_arena_leave(previous);
+
+  return copy;
+}
+
+struct dom_element *
+dom_create_element(struct dom_document *document, InfraString *local_name,
+                   enum InfraNamespace namespace,
+                   const void *prefix, const void *is,
+                   bool sync_custom_elements)
+{
+  /* XXX valid custom element names get HTMLElement, not HTMLUnknownElement */
+  struct dom_element *result = dom_create_element_interned(document, 0,
+                                namespace, prefix, is, sync_custom_elements);
+
+  result->uninterned_local_name = arena_string(
+    ((DOMObject *) result)->header.arena, local_name);
+
+  return result;
+}
+
+static const uint32_t k_attrs_initial_cap = 4;
+
+static struct dom_attr_slot *
+find_attr(const struct dom_element *element, const char *name, size_t len)
+{
+  for (uint32_t i = 0; i < element->num_attrs; i++) {
+    struct dom_attr_slot *attr = &element->attrs[i];
+
+    if (attr->namespace == INFRA_NAMESPACE_NONE
+     && attr->local_name->size == len
+     && memcmp(attr->local_name->data, name, len) == 0)
+      return attr;
+  }
+
+  return NULL;
+}
+
+void
+dom_element_reserve_attributes(struct dom_element *element, uint32_t count)
+{
+  InfraArena *arena = ((DOMObject *) element)->header.arena;
+
+  if (count <= element->attrs_cap)
+    return;
+
+  if (element->attrs == NULL)
+    element->attrs = infra_arena_alloc(arena,
+                                       count * sizeof (*element->attrs));
+  else
+    element->attrs = infra_arena_realloc(arena, element->attrs,
+                       element->attrs_cap * sizeof (*element->attrs),
+                       count * sizeof (*element->attrs));
+
+  element->attrs_cap = count;
+}
+
+void
+dom_element_append_attribute(struct dom_element *element,
+                             InfraString *local_name, InfraString *value,
+                             enum InfraNamespace namespace, const char *prefix)
+{
+  if (element->num_attrs == element->attrs_cap)
+    dom_element_reserve_attributes(element, element->attrs_cap != 0
+                                   ? element->attrs_cap * 2
+                                   : k_attrs_initial_cap);
+
+  element->attrs[element->num_attrs++] = (struct dom_attr_slot) {
+    .local_name = infra_string_ref(local_name),
+    .value      = arena_string(((DOMObject *) element)->header.arena, value),
+    .namespace  = namespace,
+    .prefix     = prefix,
+  };
+}
+
+InfraString *
+dom_element_get_attribute(const struct dom_element *element,
+                          const char *name, size_t len)
+{
+  struct dom_attr_slot *attr = find_attr(element, name, len);
+
+  return attr != NULL ? attr->value : NULL;
+}
+
+void
+dom_element_set_attribute(struct dom_element *element,
+                          InfraString *name, InfraString *value)
+{
+  struct dom_node *node = (struct dom_node *) element;
+  struct dom_attr_slot *attr = find_attr(element, name->data, name->size);
+  struct dom_document *document = node->node_document;
+
+  if (dom_is_frozen(element))
+    abort();
+
+  if (document != NULL && document->mutation != NULL)
+    dom_mutation_queue_attribute(document, element,
+                                 attr != NULL ? attr->local_name
+                                              : infra_atom_from_string(name),
+                                 attr != NULL ? attr->value : NULL);
+
+  if (attr == NULL) {
+    dom_element_append_attribute(element, infra_atom_from_string(name), value,
+                                 INFRA_NAMESPACE_NONE, NULL);
+    attr = &element->attrs[element->num_attrs - 1];
+  } else {
+    if (node->is_connected && is_id_attr(attr))
+      id_index_remove(document, element, attr->value,
+                    (struct dom_node *) element);
+
+    InfraString *old_value = attr->value;
+
+    attr->value = arena_string(((DOMObject *) element)->header.arena, value);
+    infra_string_unref(old_value);
+
+    if (attr->node != NULL) {
+      infra_string_unref(attr->node->value);
+      attr->node->value = infra_string_ref(attr->value);
+    }
+  }
+
+  if (node->is_connected && is_id_attr(attr))
+    id_index_add(document, element, attr->value, false);
+
+  if (document != NULL)
+    document->version++;
+}
+
+bool
+dom_element_remove_attribute(struct dom_element *element,
+                             const char *name, size_t len)
+{
+  struct dom_node *node = (struct dom_node *) element;
+  struct dom_attr_slot *attr = find_attr(element, name, len);
+  struct dom_attr *attr_node;
+  struct dom_document *document = node->node_document;
+
+  if (attr == NULL)
+    return false;
+
+  if (dom_is_frozen(element))
+    abort();
+
+  if (document != NULL && document->mutation != NULL)
+    dom_mutation_queue_attribute(document, element,
+                                 attr->local_name, attr->value);
+
+  if (node->is_connected && is_id_attr(attr))
+    id_index_remove(document, element, attr->value,
+                    (struct dom_node *) element);
+
+  infra_string_unref(attr->value);
+  attr_node = attr->node;
+
+  memmove(attr, attr + 1,
+          (&element->attrs[--element->num_attrs] - attr) * sizeof (*attr));
+
+  if (document != NULL)
+    document->version++;
+
+  /* the node keeps its copy of the value */
+  if (attr_node != NULL) {
+    dom_weak_unref_object(attr_node->element);
+    attr_node->element = NULL;
+    dom_strong_unref_object(attr_node);
+  }
+
+  return true;
+}
+
+/*
+ * Readers of a frozen document may race to create the same Attr node, and
+ * share the arena it comes from, so they take this lock and publish it.
+ */
+static mtx_t frozen_attr_lock;
+static once_flag frozen_attr_once = ONCE_FLAG_INIT;
+
+static void
+init_frozen_attr_lock(void)
+{
+  mtx_init(&frozen_attr_lock, mtx_plain);
+}
+
+/* The node outlives the freeze, so its weak references count for real */
+static DOMAny *
+weak_ref_frozen(DOMAny *obj)
+{
+  if (obj != NULL)
+    __atomic_add_fetch(&((DOMObject *) obj)->header.weak_refcnt, 1,
+                       __ATOMIC_RELAXED);
+
+  return obj;
+}
+
+static struct dom_attr *
+create_attr_node(struct dom_element *element, struct dom_attr_slot *slot)
+{
+  struct dom_node *element_node = (struct dom_node *) element;
+  bool frozen = dom_is_frozen(element);
+  struct dom_attr *attr;
+  InfraArena *previous;
+
+  previous = infra_arena_enter(((DOMObject *) element)->header.arena);
+  attr = dom_strong_ref_object(DOM_NEW_OBJECT( attr ));
+  infra_arena_leave(previous);
+
+  if (frozen) {
+    ((struct dom_node *) attr)->node_document =
+      weak_ref_frozen(element_node->node_document);
+    attr->element = weak_ref_frozen(element);
+  } else {
+    ((struct dom_node *) attr)->node_document =
+      dom_weak_ref_object(element_node->node_document);
+    attr->element = dom_weak_ref_object(element);
+  }
+
+  attr->local_name = slot->local_name;
+  attr->value      = infra_string_ref(slot->value);
+  attr->namespace  = slot->namespace;
+  attr->prefix     = slot->prefix;
+
+  ((DOMObject *) attr)->header.frozen = frozen;
+
+  return attr;
+}
+
+struct dom_attr *
+dom_element_attribute_node(struct dom_element *element, uint32_t index)
+{
+  struct dom_attr_slot *slot;
+  struct dom_attr *attr;
+
+  if (index >= element->num_attrs)
+    return NULL;
+
+  slot = &element->attrs[index];
+  attr = __atomic_load_n(&slot->node, __ATOMIC_ACQUIRE);
+
+  if (attr != NULL)
+    return attr;
+
+  if (!dom_is_frozen(element))
+    return slot->node = create_attr_node(element, slot);
+
+  call_once(&frozen_attr_once, init_frozen_attr_lock);
+  mtx_lock(&frozen_attr_lock);
+
+  if ((attr = slot->node) == NULL) {
+    attr = create_attr_node(element, slot);
+    __atomic_store_n(&slot->node, attr, __ATOMIC_RELEASE);
+  }
+
+  mtx_unlock(&frozen_attr_lock);
+
+  return attr;
+}
+
+struct dom_attr *
+dom_element_get_attribute_node(struct dom_element *element,
+                               const char *name, size_t len)
+{
+  struct dom_attr_slot *slot = find_attr(element, name, len);
+
+  if (slot == NULL)
+    return NULL;
+
+  return dom_element_attribute_node(element, slot - element->attrs);
+}
+
+/* END ALGORITHMS */
+
+/* START SOURCES */
+
+DOMSource *
+dom_source_create(const char *data, size_t len,
+                  void (*release) (void *, const char *, size_t),
+                  void *user_data)
+{
+  DOMSource *source = infra_arena_alloc(NULL, sizeof (*source));
+
+  *source = (DOMSource) {
+    .data      = data,
+    .len       = len,
+    .release   = release,
+    .user_data = user_data,
+    .refcnt    = 1,
+  };
+
+  return source;
+}
+
+DOMSource *
+dom_source_ref(DOMSource *source)
+{
+  if (source != NULL)
+    source->refcnt++;
+
+  return source;
+}
+
+void
+dom_source_unref(DOMSource *source)
+{
+  if (source == NULL || --source->refcnt > 0)
+    return;
+
+  if (source->release != NULL)
+    source->release(source->user_data, source->data, source->len);
+
+  infra_arena_free(NULL, source, sizeof (*source));
+}
+
+void
+dom_document_set_source(struct dom_document *document, DOMSource *source)
+{
+  if (document->source != NULL)
+    abort();
+
+  document->source = dom_source_ref(source);
+}
+
+static void
+unborrow(struct dom_character_data *cd)
+{
+  if (cd->borrowed != NULL && ((DOMObject *) cd)->header.arena == NULL)
+    dom_source_unref(cd->source);
+
+  cd->borrowed = NULL;
+  cd->source = NULL;
+}
+
+const char *
+dom_character_data_get(const struct dom_character_data *cd, size_t *len)
+{
+  if (cd->borrowed != NULL) {
+    *len = cd->borrowed_len;
+    return cd->borrowed;
+  }
+
+  if (cd->data == NULL || cd->data->size == 0) {
+    *len = 0;
+    return NULL;
+  }
+
+  *len = cd->data->size;
+  return cd->data->data;
+}
+
+static void
+touch(struct dom_character_data *cd)
+{
+  struct dom_document *document = ((struct dom_node *) cd)->node_document;
+
+  if (dom_is_frozen(cd))
+    abort();
+
+  if (document != NULL)
+    document->version++;
+
+  /* before the change, for the old value */
+  if (document != NULL && document->mutation != NULL)
+    dom_mutation_queue_character_data(document, cd);
+}
+
+static void
+append(struct dom_character_data *cd, const char *data, size_t len)
+{
+  InfraArena *previous;
+
+  if (len == 0)
+    return;
+
+  if (cd->borrowed != NULL
+   && data == cd->borrowed + cd->borrowed_len
+   && data + len <= cd->source->data + cd->source->len) {
+    cd->borrowed_len += len;
+    return;
+  }
+
+  if (cd->data == NULL) {
+    previous = infra_arena_enter(((DOMObject *) cd)->header.arena);
+    cd->data = infra_string_create();
+    infra_arena_leave(previous);
+  }
+
+  /* copy on write */
+  if (cd->borrowed != NULL) {
+    infra_string_append(cd->data, cd->borrowed, cd->borrowed_len);
+    unborrow(cd);
+  }
+
+  infra_string_append(cd->data, data, len);
+}
+
+void
+dom_character_data_set(struct dom_character_data *cd,
+                       const char *data, size_t len)
+{
+  touch(cd);
+  unborrow(cd);
+
+  if (cd->data != NULL)
+    infra_string_clear(cd->data);
+
+  append(cd, data, len);
+}
+
+void
+dom_character_data_append(struct dom_character_data *cd,
+                          const char *data, size_t len)
+{
+  touch(cd);
+  append(cd, data, len);
+}
+
+void
+dom_character_data_borrow(struct dom_character_data *cd,
+                          DOMSource *source,
+                          const char *data, size_t len)
+{
+  touch(cd);
+
+  if (cd->borrowed != NULL || (cd->data != NULL && cd->data->size != 0))
+    abort();
+
+  /* arena nodes die with the document, which holds source already */
+  if (data != NULL && ((DOMObject *) cd)->header.arena == NULL)
+    dom_source_ref(source);
+
+  cd->source = source;
+  cd->borrowed = data;
+  cd->borrowed_len = len;
+}
+
+/* END SOURCES */
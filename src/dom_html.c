@@ -4,144 +4,190 @@
 DOM_DEFINE_INTERFACE(html_element) {
   .name = "HTMLElement",
   .parent_interface = DOM_INTERFACE(element),
+  DOM_ANCESTRY(event_target, node, element, html_element),
   .impl_size = sizeof (struct dom_html_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_unknown_element) {
   .name = "HTMLUnknownElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_unknown_element),
   .impl_size = sizeof (struct dom_html_unknown_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 /* 4.1 The document element */
 DOM_DEFINE_INTERFACE(html_html_element) {
   .name = "HTMLHtmlElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_html_element),
   .impl_size = sizeof (struct dom_html_html_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 /* 4.2 Document metadata */
 DOM_DEFINE_INTERFACE(html_head_element) {
   .name = "HTMLHeadElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_head_element),
   .impl_size = sizeof (struct dom_html_head_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_title_element) {
   .name = "HTMLTitleElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_title_element),
   .impl_size = sizeof (struct dom_html_title_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_base_element) {
   .name = "HTMLBaseElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_base_element),
   .impl_size = sizeof (struct dom_html_base_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_link_element) {
   .name = "HTMLLinkElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_link_element),
   .impl_size = sizeof (struct dom_html_link_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_meta_element) {
   .name = "HTMLMetaElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_meta_element),
   .impl_size = sizeof (struct dom_html_meta_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_style_element) {
   .name = "HTMLStyleElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_style_element),
   .impl_size = sizeof (struct dom_html_style_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 /* 4.3 Sections */
 DOM_DEFINE_INTERFACE(html_body_element) {
   .name = "HTMLBodyElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_body_element),
   .impl_size = sizeof (struct dom_html_body_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_heading_element) {
   .name = "HTMLHeadingElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_heading_element),
   .impl_size = sizeof (struct dom_html_heading_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 /* 4.4 Grouping content */
 DOM_DEFINE_INTERFACE(html_paragraph_element) {
   .name = "HTMLParagraphElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_paragraph_element),
   .impl_size = sizeof (struct dom_html_paragraph_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_hr_element) {
   .name = "HTMLHRElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_hr_element),
   .impl_size = sizeof (struct dom_html_hr_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_pre_element) {
   .name = "HTMLPreElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_pre_element),
   .impl_size = sizeof (struct dom_html_pre_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_quote_element) {
   .name = "HTMLQuoteElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_quote_element),
   .impl_size = sizeof (struct dom_html_quote_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_olist_element) {
   .name = "HTMLOListElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_olist_element),
   .impl_size = sizeof (struct dom_html_olist_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_ulist_element) {
   .name = "HTMLUListElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_ulist_element),
   .impl_size = sizeof (struct dom_html_ulist_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_menu_element) {
   .name = "HTMLMenuElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_menu_element),
   .impl_size = sizeof (struct dom_html_menu_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_li_element) {
   .name = "HTMLLIElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_li_element),
   .impl_size = sizeof(struct dom_html_li_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_dlist_element) {
   .name = "HTMLDListElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_dlist_element),
   .impl_size = sizeof (struct dom_html_dlist_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_div_element) {
   .name = "HTMLDivElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_div_element),
   .impl_size = sizeof (struct dom_html_div_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 /* 4.5 Text-level semantics */
 DOM_DEFINE_INTERFACE(html_anchor_element) {
   .name = "HTMLAnchorElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_anchor_element),
   .impl_size = sizeof (struct dom_html_anchor_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 DOM_DEFINE_INTERFACE(html_span_element) {
   .name = "HTMLSpanElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_span_element),
   .impl_size = sizeof (struct dom_html_span_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 /* 4.7 Edits */
@@ -150,18 +196,40 @@ DOM_DEFINE_INTERFACE(html_span_element) {
 /* 4.8 Embedded content */
 /* ... */
 
+/* 4.8.15 MathML */
+DOM_DEFINE_INTERFACE(mathml_element) {
+  .name = "MathMLElement",
+  .parent_interface = DOM_INTERFACE(element),
+  DOM_ANCESTRY(event_target, node, element, mathml_element),
+  .impl_size = sizeof (struct dom_mathml_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
+};
+
+/* 4.8.16 SVG */
+DOM_DEFINE_INTERFACE(svg_element) {
+  .name = "SVGElement",
+  .parent_interface = DOM_INTERFACE(element),
+  DOM_ANCESTRY(event_target, node, element, svg_element),
+  .impl_size = sizeof (struct dom_svg_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
+};
+
 /* 4.9 Tabular data */
 DOM_DEFINE_INTERFACE(html_table_element) {
   .name = "HTMLTableElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_table_element),
   .impl_size = sizeof (struct dom_html_table_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 /* 4.10 Forms */
 DOM_DEFINE_INTERFACE(html_form_element) {
   .name = "HTMLFormElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_form_element),
   .impl_size = sizeof (struct dom_html_form_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
 /* 4.11 Interactive elements */
@@ -171,13 +239,37 @@ DOM_DEFINE_INTERFACE(html_form_element) {
 DOM_DEFINE_INTERFACE(html_script_element) {
   .name = "HTMLScriptElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_script_element),
   .impl_size = sizeof (struct dom_html_script_element),
+  DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer),
 };
 
+static void
+html_template_element_finalizer(DOMObject *obj)
+{
+  struct dom_html_template_element *template = (DOMAny *) obj;
+
+  dom_strong_unref_object(template->template_contents);
+}
+
+/* template_contents' host points back here: the cycle dom_cc_collect() breaks */
+static void
+html_template_element_traverse(DOMObject *obj, DOMVisitFunc visit, void *ctx)
+{
+  struct dom_html_template_element *template = (DOMAny *) obj;
+
+  if (template->template_contents != NULL)
+    visit((DOMObject *) template->template_contents, ctx);
+}
+
 DOM_DEFINE_INTERFACE(html_template_element) {
   .name = "HTMLTemplateElement",
   .parent_interface = DOM_INTERFACE(html_element),
+  DOM_ANCESTRY(event_target, node, element, html_element, html_template_element),
   .impl_size = sizeof (struct dom_html_template_element),
+  DOM_FINALIZERS(html_template_element_finalizer, dom_element_finalizer,
+                 dom_node_finalizer),
+  .traverse = html_template_element_traverse,
 };
 
 /* 16 Obsolete features */
@@ -0,0 +1,531 @@
+#include <wfs/dom_mutation.h>
+#include <stdlib.h>
+
+/* DOM_OBSERVE_* bits that select record types */
+#define OBSERVE_TYPES (DOM_OBSERVE_CHILD_LIST | DOM_OBSERVE_ATTRIBUTES \
+                       | DOM_OBSERVE_CHARACTER_DATA)
+
+struct registration {
+  DOMMutationObserver *observer;
+  struct dom_node *node; // strong reference
+  uint32_t options;
+};
+
+struct DOMMutationObserver_s {
+  struct dom_document *document;
+  DOMMutationCallback callback;
+  void *user_data;
+
+  InfraStack *queue; // -> DOMMutationRecord
+
+  /* scratch for dom_mutation_queue_*() */
+  uint32_t stamp;
+  bool wants_old_value;
+};
+
+struct dom_mutation_state {
+  InfraStack *observers; // in creation order
+  InfraStack *registrations; // -> struct registration
+  uint32_t num_parser_registrations;
+
+  InfraStack *pool; // -> DOMMutationRecord, released
+  InfraStack *interested; // -> DOMMutationObserver, scratch
+  InfraStack *spare; // swapped with the queue being delivered
+
+  uint32_t stamp;
+  bool delivering;
+};
+
+static InfraStack *
+heap_stack(void)
+{
+  InfraArena *previous = infra_arena_enter(NULL);
+  InfraStack *stack = infra_stack_create();
+
+  infra_arena_leave(previous);
+
+  return stack;
+}
+
+static InfraString *
+heap_string(void)
+{
+  InfraArena *previous = infra_arena_enter(NULL);
+  InfraString *string = infra_string_create();
+
+  infra_arena_leave(previous);
+
+  return string;
+}
+
+static struct dom_document *
+document_of(struct dom_node *node)
+{
+  if (DOM_IMPLEMENTS(node, document))
+    return (struct dom_document *) node;
+
+  return node->node_document;
+}
+
+/* START RECORDS */
+
+static DOMMutationRecord *
+take_record(struct dom_mutation_state *state, enum DOMMutationType type,
+            struct dom_node *target, bool by_parser)
+{
+  DOMMutationRecord *record = infra_stack_pop(state->pool);
+
+  if (record == NULL) {
+    record = infra_arena_alloc(NULL, sizeof (*record));
+    record->added_nodes = heap_stack();
+    record->removed_nodes = heap_stack();
+  }
+
+  record->type = type;
+  record->by_parser = by_parser;
+  record->target = dom_strong_ref_object(target);
+  record->previous_sibling = NULL;
+  record->next_sibling = NULL;
+  record->attribute_name = NULL;
+  record->old_value = NULL;
+
+  return record;
+}
+
+static void
+release_record(struct dom_mutation_state *state, DOMMutationRecord *record)
+{
+  INFRA_STACK_FOREACH(record->added_nodes, i)
+    dom_strong_unref_object(record->added_nodes->items[i]);
+  INFRA_STACK_FOREACH(record->removed_nodes, i)
+    dom_strong_unref_object(record->removed_nodes->items[i]);
+
+  record->added_nodes->size = 0;
+  record->removed_nodes->size = 0;
+
+  dom_strong_unref_object(record->target);
+  dom_strong_unref_object(record->previous_sibling);
+  dom_strong_unref_object(record->next_sibling);
+  infra_string_unref(record->old_value);
+
+  infra_stack_push(state->pool, record);
+}
+
+static void
+free_record(DOMMutationRecord *record)
+{
+  infra_stack_free(record->added_nodes);
+  infra_stack_free(record->removed_nodes);
+  infra_arena_free(NULL, record, sizeof (*record));
+}
+
+static void
+drop_queue(struct dom_mutation_state *state, DOMMutationObserver *observer)
+{
+  INFRA_STACK_FOREACH(observer->queue, i)
+    release_record(state, observer->queue->items[i]);
+
+  observer->queue->size = 0;
+}
+
+/* END RECORDS */
+
+/* START QUEUEING */
+
+/*
+ * 4.3.2 "queue a mutation record", first half: collect the observers
+ * interested in a record of the given type on target into
+ * state->interested, noting which of them want the old value.
+ */
+static bool
+collect_interested(struct dom_document *document, struct dom_node *target,
+                   uint32_t type, uint32_t old_value)
+{
+  struct dom_mutation_state *state = document->mutation;
+  bool by_parser = document->parsing;
+
+  if (by_parser && state->num_parser_registrations == 0)
+    return false;
+
+  state->interested->size = 0;
+  state->stamp++;
+
+  for (struct dom_node *node = target; node != NULL; node = node->parent) {
+    if (!node->observed)
+      continue;
+
+    INFRA_STACK_FOREACH(state->registrations, i) {
+      struct registration *reg = state->registrations->items[i];
+      DOMMutationObserver *observer = reg->observer;
+
+      if (reg->node != node
+       || (node != target && (reg->options & DOM_OBSERVE_SUBTREE) == 0)
+       || (reg->options & type) == 0
+       || (by_parser && (reg->options & DOM_OBSERVE_PARSER) == 0))
+        continue;
+
+      if (observer->stamp != state->stamp) {
+        observer->stamp = state->stamp;
+        observer->wants_old_value = false;
+        infra_stack_push(state->interested, observer);
+      }
+
+      if (reg->options & old_value)
+        observer->wants_old_value = true;
+    }
+  }
+
+  return state->interested->size != 0;
+}
+
+/* The observer's last record, if one like this may continue it */
+static DOMMutationRecord *
+last_record(DOMMutationObserver *observer, enum DOMMutationType type,
+            struct dom_node *target, bool by_parser)
+{
+  DOMMutationRecord *last = infra_stack_peek(observer->queue);
+
+  if (last == NULL || last->type != type || last->target != target
+   || last->by_parser != by_parser)
+    return NULL;
+
+  return last;
+}
+
+void
+dom_mutation_queue_child_list(struct dom_document *document,
+                              struct dom_node *target,
+                              struct dom_node *added,
+                              struct dom_node *removed,
+                              struct dom_node *previous_sibling,
+                              struct dom_node *next_sibling)
+{
+  struct dom_mutation_state *state = document->mutation;
+  bool by_parser = document->parsing;
+
+  if (!collect_interested(document, target, DOM_OBSERVE_CHILD_LIST, 0))
+    return;
+
+  INFRA_STACK_FOREACH(state->interested, i) {
+    DOMMutationObserver *observer = state->interested->items[i];
+    DOMMutationRecord *last = last_record(observer, DOM_MUTATION_CHILD_LIST,
+                                          target, by_parser);
+    DOMMutationRecord *record;
+
+    /* inserted right after the last one's added nodes */
+    if (last != NULL && added != NULL && last->removed_nodes->size == 0
+     && last->next_sibling == next_sibling
+     && infra_stack_peek(last->added_nodes) == previous_sibling) {
+      infra_stack_push(last->added_nodes, dom_strong_ref_object(added));
+      continue;
+    }
+
+    /* removed from right after the last one's removed nodes */
+    if (last != NULL && removed != NULL && last->added_nodes->size == 0
+     && last->previous_sibling == previous_sibling
+     && last->next_sibling == removed) {
+      infra_stack_push(last->removed_nodes, dom_strong_ref_object(removed));
+      last->next_sibling = dom_strong_ref_object(next_sibling);
+      dom_strong_unref_object(removed);
+      continue;
+    }
+
+    record = take_record(state, DOM_MUTATION_CHILD_LIST, target, by_parser);
+    record->previous_sibling = dom_strong_ref_object(previous_sibling);
+    record->next_sibling = dom_strong_ref_object(next_sibling);
+
+    if (added != NULL)
+      infra_stack_push(record->added_nodes, dom_strong_ref_object(added));
+    if (removed != NULL)
+      infra_stack_push(record->removed_nodes, dom_strong_ref_object(removed));
+
+    infra_stack_push(observer->queue, record);
+  }
+}
+
+void
+dom_mutation_queue_attribute(struct dom_document *document,
+                             struct dom_element *element,
+                             InfraString *name, InfraString *old_value)
+{
+  struct dom_mutation_state *state = document->mutation;
+  struct dom_node *target = (struct dom_node *) element;
+  bool by_parser = document->parsing;
+
+  if (!collect_interested(document, target, DOM_OBSERVE_ATTRIBUTES,
+                          DOM_OBSERVE_ATTRIBUTE_OLD_VALUE))
+    return;
+
+  INFRA_STACK_FOREACH(state->interested, i) {
+    DOMMutationObserver *observer = state->interested->items[i];
+    DOMMutationRecord *last = last_record(observer, DOM_MUTATION_ATTRIBUTES,
+                                          target, by_parser);
+    DOMMutationRecord *record;
+
+    /* the first old value stands */
+    if (last != NULL && last->attribute_name == name)
+      continue;
+
+    record = take_record(state, DOM_MUTATION_ATTRIBUTES, target, by_parser);
+    record->attribute_name = name;
+
+    /* attribute values are replaced, never changed in place */
+    if (observer->wants_old_value)
+      record->old_value = infra_string_ref(old_value);
+
+    infra_stack_push(observer->queue, record);
+  }
+}
+
+void
+dom_mutation_queue_character_data(struct dom_document *document,
+                                  struct dom_character_data *cd)
+{
+  struct dom_mutation_state *state = document->mutation;
+  struct dom_node *target = (struct dom_node *) cd;
+  bool by_parser = document->parsing;
+  InfraString *old_value = NULL;
+
+  if (!collect_interested(document, target, DOM_OBSERVE_CHARACTER_DATA,
+                          DOM_OBSERVE_CHARACTER_DATA_OLD_VALUE))
+    return;
+
+  INFRA_STACK_FOREACH(state->interested, i) {
+    DOMMutationObserver *observer = state->interested->items[i];
+    DOMMutationRecord *record;
+
+    if (last_record(observer, DOM_MUTATION_CHARACTER_DATA,
+                    target, by_parser) != NULL)
+      continue;
+
+    record = take_record(state, DOM_MUTATION_CHARACTER_DATA,
+                         target, by_parser);
+
+    /* copied once, shared by every record that wants it */
+    if (observer->wants_old_value) {
+      if (old_value == NULL) {
+        const char *data;
+        size_t len;
+
+        old_value = heap_string();
+        data = dom_character_data_get(cd, &len);
+        infra_string_append(old_value, data, len);
+      }
+
+      record->old_value = infra_string_ref(old_value);
+    }
+
+    infra_stack_push(observer->queue, record);
+  }
+
+  infra_string_unref(old_value);
+}
+
+/* END QUEUEING */
+
+/* START OBSERVERS */
+
+static struct dom_mutation_state *
+get_state(struct dom_document *document)
+{
+  struct dom_mutation_state *state = document->mutation;
+
+  if (state != NULL)
+    return state;
+
+  state = infra_arena_alloc(NULL, sizeof (*state));
+  *state = (struct dom_mutation_state) {
+    .observers     = heap_stack(),
+    .registrations = heap_stack(),
+    .pool          = heap_stack(),
+    .interested    = heap_stack(),
+    .spare         = heap_stack(),
+  };
+
+  return document->mutation = state;
+}
+
+DOMMutationObserver *
+dom_mutation_observer_create(struct dom_document *document,
+                             DOMMutationCallback callback, void *user_data)
+{
+  struct dom_mutation_state *state = get_state(document);
+  DOMMutationObserver *observer = infra_arena_alloc(NULL, sizeof (*observer));
+
+  *observer = (DOMMutationObserver) {
+    .document  = document,
+    .callback  = callback,
+    .user_data = user_data,
+    .queue     = heap_stack(),
+  };
+
+  infra_stack_push(state->observers, observer);
+
+  return observer;
+}
+
+void
+dom_mutation_observer_free(DOMMutationObserver *observer)
+{
+  struct dom_mutation_state *state = observer->document->mutation;
+
+  if (state->delivering)
+    abort();
+
+  dom_mutation_observer_disconnect(observer);
+
+  INFRA_STACK_FOREACH(state->observers, i) {
+    if (state->observers->items[i] == observer) {
+      infra_stack_erase(state->observers, i, 1);
+      break;
+    }
+  }
+
+  infra_stack_free(observer->queue);
+  infra_arena_free(NULL, observer, sizeof (*observer));
+}
+
+void
+dom_mutation_observer_observe(DOMMutationObserver *observer,
+                              struct dom_node *target, uint32_t options)
+{
+  struct dom_mutation_state *state = observer->document->mutation;
+  struct registration *reg = NULL;
+
+  if (options & DOM_OBSERVE_ATTRIBUTE_OLD_VALUE)
+    options |= DOM_OBSERVE_ATTRIBUTES;
+  if (options & DOM_OBSERVE_CHARACTER_DATA_OLD_VALUE)
+    options |= DOM_OBSERVE_CHARACTER_DATA;
+
+  /* the spec's TypeErrors */
+  if ((options & OBSERVE_TYPES) == 0 || document_of(target) != observer->document)
+    abort();
+
+  INFRA_STACK_FOREACH(state->registrations, i) {
+    struct registration *candidate = state->registrations->items[i];
+
+    if (candidate->observer == observer && candidate->node == target) {
+      reg = candidate;
+      break;
+    }
+  }
+
+  if (reg == NULL) {
+    reg = infra_arena_alloc(NULL, sizeof (*reg));
+    *reg = (struct registration) {
+      .observer = observer,
+      .node     = dom_strong_ref_object(target),
+    };
+
+    infra_stack_push(state->registrations, reg);
+    target->observed = true;
+  } else if (reg->options & DOM_OBSERVE_PARSER) {
+    state->num_parser_registrations--;
+  }
+
+  if (options & DOM_OBSERVE_PARSER)
+    state->num_parser_registrations++;
+
+  reg->options = options;
+}
+
+void
+dom_mutation_observer_disconnect(DOMMutationObserver *observer)
+{
+  struct dom_mutation_state *state = observer->document->mutation;
+  InfraStack *regs = state->registrations;
+  uint32_t kept = 0;
+
+  /* clear the marks on this observer's targets, then restore the others' */
+  INFRA_STACK_FOREACH(regs, i) {
+    struct registration *reg = regs->items[i];
+
+    if (reg->observer == observer)
+      reg->node->observed = false;
+  }
+
+  INFRA_STACK_FOREACH(regs, i) {
+    struct registration *reg = regs->items[i];
+
+    if (reg->observer != observer) {
+      reg->node->observed = true;
+      regs->items[kept++] = reg;
+      continue;
+    }
+
+    if (reg->options & DOM_OBSERVE_PARSER)
+      state->num_parser_registrations--;
+
+    dom_strong_unref_object(reg->node);
+    infra_arena_free(NULL, reg, sizeof (*reg));
+  }
+
+  regs->size = kept;
+
+  drop_queue(state, observer);
+}
+
+void
+dom_mutation_checkpoint(struct dom_document *document)
+{
+  struct dom_mutation_state *state = document->mutation;
+  bool delivered;
+
+  if (state == NULL || state->delivering)
+    return;
+
+  state->delivering = true;
+
+  /* callbacks may queue more records */
+  do {
+    delivered = false;
+
+    INFRA_STACK_FOREACH(state->observers, i) {
+      DOMMutationObserver *observer = state->observers->items[i];
+      InfraStack *batch = observer->queue;
+
+      if (batch->size == 0)
+        continue;
+
+      observer->queue = state->spare;
+      observer->callback(observer, (DOMMutationRecord *const *) batch->items,
+                         batch->size, observer->user_data);
+
+      INFRA_STACK_FOREACH(batch, j)
+        release_record(state, batch->items[j]);
+
+      batch->size = 0;
+      state->spare = batch;
+      delivered = true;
+    }
+  } while (delivered);
+
+  state->delivering = false;
+}
+
+void
+dom_mutation_release(struct dom_document *document)
+{
+  struct dom_mutation_state *state = document->mutation;
+
+  if (state == NULL)
+    return;
+
+  /* observers must be gone by now */
+  if (state->observers->size != 0)
+    abort();
+
+  INFRA_STACK_FOREACH(state->pool, i)
+    free_record(state->pool->items[i]);
+
+  infra_stack_free(state->observers);
+  infra_stack_free(state->registrations);
+  infra_stack_free(state->pool);
+  infra_stack_free(state->interested);
+  infra_stack_free(state->spare);
+  infra_arena_free(NULL, state, sizeof (*state));
+
+  document->mutation = NULL;
+}
+
+/* END OBSERVERS */
@@ -0,0 +1,1909 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <threads.h>
+
+#include <wfs/dom.h>
+#include <wfs/dom_core.h>
+#include <wfs/dom_selector.h>
+#include <wfs/html_foreign.h>
+#include <wfs/html_tags.h>
+#include <wfs/infra_arena.h>
+#include <wfs/infra_stack.h>
+#include <wfs/infra_string.h>
+
+/* Nesting of :not(), :is() and :where() */
+#define MAX_SELECTOR_DEPTH 32
+#define MAX_ANCESTOR_HASHES 4
+
+enum Combinator : uint8_t {
+  COMBINATOR_NONE = 0,
+  COMBINATOR_DESCENDANT,
+  COMBINATOR_CHILD,
+  COMBINATOR_NEXT_SIBLING,
+  COMBINATOR_SUBSEQUENT_SIBLING,
+};
+
+enum TestKind : uint8_t {
+  TEST_CLASS = 0,
+  TEST_ID,                /* #a#b: every id after the compound's first */
+  TEST_ATTR_EXISTS,
+  TEST_ATTR_EQUALS,       /* [a=v] */
+  TEST_ATTR_INCLUDES,     /* [a~=v] */
+  TEST_ATTR_DASH_MATCH,   /* [a|=v] */
+  TEST_ATTR_PREFIX,       /* [a^=v] */
+  TEST_ATTR_SUFFIX,       /* [a$=v] */
+  TEST_ATTR_SUBSTRING,    /* [a*=v] */
+  TEST_ROOT,
+  TEST_EMPTY,
+  TEST_NTH_CHILD,
+  TEST_NTH_LAST_CHILD,
+  TEST_NTH_OF_TYPE,
+  TEST_NTH_LAST_OF_TYPE,
+  TEST_NOT,
+  TEST_IS,
+};
+
+struct selector_test {
+  enum TestKind kind;
+  bool ignore_case; /* the i flag */
+
+  InfraString *name; /* class, or attribute name as written */
+  InfraString *lower_name; /* attribute name for HTML elements */
+  InfraString *value;
+
+  int32_t a, b; /* an+b */
+  DOMSelector *inner; /* :not(), :is() */
+};
+
+struct compound {
+  /* how the next compound, to the left, relates to this one */
+  enum Combinator combinator;
+
+  /* type selector; NULL is universal */
+  InfraString *name;
+  InfraString *lower_name;
+  uint16_t html_tag;
+  uint16_t svg_tag;
+  uint16_t mathml_tag;
+
+  InfraString *id;
+  InfraStack *tests; // -> struct selector_test
+};
+
+struct complex_selector {
+  InfraStack *compounds; // -> struct compound, subject first
+
+  /* tags, ids and classes some ancestor must have; 0 ends the list */
+  uint32_t ancestor_hashes[MAX_ANCESTOR_HASHES];
+};
+
+struct DOMSelector_s {
+  InfraStack *complexes; // -> struct complex_selector
+  bool uses_bloom;
+};
+
+static InfraStack *
+heap_stack(void)
+{
+  InfraArena *previous = infra_arena_enter(NULL);
+  InfraStack *stack = infra_stack_create();
+
+  infra_arena_leave(previous);
+
+  return stack;
+}
+
+static InfraString *
+heap_string(void)
+{
+  InfraArena *previous = infra_arena_enter(NULL);
+  InfraString *string = infra_string_create();
+
+  infra_arena_leave(previous);
+
+  return string;
+}
+
+static inline bool
+is_ascii_whitespace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\f' || c == '\r';
+}
+
+static inline char
+to_ascii_lower(char c)
+{
+  return c >= 'A' && c <= 'Z' ? c + 0x20 : c;
+}
+
+/* A lowercased heap copy; names are not interned, atoms are never freed */
+static InfraString *
+lower_copy(const InfraString *string)
+{
+  InfraString *lower = heap_string();
+
+  for (size_t i = 0; i < string->size; i++)
+    infra_string_put_char(lower, to_ascii_lower(string->data[i]));
+
+  return lower;
+}
+
+/* START BLOOM FILTER */
+
+/*
+ * Counting Bloom filter over the ancestors of the node being matched.
+ * Each key sets two counters; saturated counters are never decremented.
+ * Keys fold ASCII case, so quirks mode needs nothing special.
+ */
+#define BLOOM_BITS 12
+#define BLOOM_MASK ((1u << BLOOM_BITS) - 1)
+
+static const uint32_t k_salt_tag = 0x2545F491u;
+static const uint32_t k_salt_id = 0x9E3779B9u;
+static const uint32_t k_salt_class = 0x85EBCA6Bu;
+
+struct ancestor_filter {
+  uint8_t counters[1u << BLOOM_BITS];
+
+  /* the keys each pushed element added, then their count */
+  uint32_t *keys;
+  size_t num_keys;
+  size_t cap_keys;
+};
+
+static uint32_t
+bloom_key(const char *ptr, size_t len, uint32_t salt)
+{
+  uint32_t h = 2166136261u ^ salt;
+
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char) to_ascii_lower(ptr[i]);
+    h *= 16777619u;
+  }
+
+  /* murmur3 finalizer: both halves must be usable */
+  h ^= h >> 16;
+  h *= 0x85EBCA6Bu;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35u;
+  h ^= h >> 16;
+
+  return h != 0 ? h : 1;
+}
+
+static inline bool
+bloom_may_contain(const struct ancestor_filter *filter, uint32_t key)
+{
+  return filter->counters[key & BLOOM_MASK] != 0
+      && filter->counters[(key >> BLOOM_BITS) & BLOOM_MASK] != 0;
+}
+
+static void
+push_key(struct ancestor_filter *filter, uint32_t key)
+{
+  if (filter->num_keys == filter->cap_keys) {
+    filter->cap_keys = filter->cap_keys != 0 ? 2 * filter->cap_keys : 64;
+    filter->keys = realloc(filter->keys, filter->cap_keys * sizeof (uint32_t));
+
+    if (filter->keys == NULL)
+      abort();
+  }
+
+  filter->keys[filter->num_keys++] = key;
+}
+
+static void
+filter_add_key(struct ancestor_filter *filter, uint32_t key)
+{
+  uint8_t *c1 = &filter->counters[key & BLOOM_MASK];
+  uint8_t *c2 = &filter->counters[(key >> BLOOM_BITS) & BLOOM_MASK];
+
+  if (*c1 != UINT8_MAX)
+    (*c1)++;
+  if (*c2 != UINT8_MAX)
+    (*c2)++;
+
+  push_key(filter, key);
+}
+
+static void
+filter_remove_key(struct ancestor_filter *filter, uint32_t key)
+{
+  uint8_t *c1 = &filter->counters[key & BLOOM_MASK];
+  uint8_t *c2 = &filter->counters[(key >> BLOOM_BITS) & BLOOM_MASK];
+
+  if (*c1 != UINT8_MAX)
+    (*c1)--;
+  if (*c2 != UINT8_MAX)
+    (*c2)--;
+}
+
+static uint32_t k_html_tag_keys[NUM_HTML_TAG];
+static uint32_t k_svg_tag_keys[NUM_SVG_TAG];
+static uint32_t k_mathml_tag_keys[NUM_MATHML_TAG];
+static once_flag tag_keys_once = ONCE_FLAG_INIT;
+
+static void
+build_tag_keys(void)
+{
+  for (size_t i = 1; i < NUM_HTML_TAG; i++)
+    k_html_tag_keys[i] = bloom_key(k_html_tag_names[i],
+                                   strlen(k_html_tag_names[i]), k_salt_tag);
+  for (size_t i = 1; i < NUM_SVG_TAG; i++)
+    k_svg_tag_keys[i] = bloom_key(k_svg_tag_names[i],
+                                  strlen(k_svg_tag_names[i]), k_salt_tag);
+  for (size_t i = 1; i < NUM_MATHML_TAG; i++)
+    k_mathml_tag_keys[i] = bloom_key(k_mathml_tag_names[i],
+                                     strlen(k_mathml_tag_names[i]), k_salt_tag);
+}
+
+static uint32_t
+element_tag_key(const struct dom_element *element)
+{
+  if (element->local_name != 0) {
+    switch (element->namespace) {
+      case INFRA_NAMESPACE_HTML:
+        return k_html_tag_keys[element->local_name];
+      case INFRA_NAMESPACE_SVG:
+        return k_svg_tag_keys[element->local_name];
+      case INFRA_NAMESPACE_MATHML:
+        return k_mathml_tag_keys[element->local_name];
+      default:
+        return 0;
+    }
+  }
+
+  if (element->uninterned_local_name == NULL)
+    return 0;
+
+  return bloom_key(element->uninterned_local_name->data,
+                   element->uninterned_local_name->size, k_salt_tag);
+}
+
+static void
+filter_push(struct ancestor_filter *filter, const struct dom_element *element)
+{
+  size_t start = filter->num_keys;
+  uint32_t key = element_tag_key(element);
+  InfraString *id = dom_element_get_attribute(element, "id", 2);
+  InfraString *classes = dom_element_get_attribute(element, "class", 5);
+
+  if (key != 0)
+    filter_add_key(filter, key);
+
+  if (id != NULL && id->size != 0)
+    filter_add_key(filter, bloom_key(id->data, id->size, k_salt_id));
+
+  if (classes != NULL) {
+    const char *p = classes->data, *end = p + classes->size;
+
+    while (p < end) {
+      const char *token;
+
+      while (p < end && is_ascii_whitespace(*p))
+        p++;
+
+      for (token = p; p < end && !is_ascii_whitespace(*p); p++)
+        ;
+
+      if (p != token)
+        filter_add_key(filter, bloom_key(token, p - token, k_salt_class));
+    }
+  }
+
+  push_key(filter, (uint32_t) (filter->num_keys - start));
+}
+
+static void
+filter_pop(struct ancestor_filter *filter)
+{
+  uint32_t count = filter->keys[--filter->num_keys];
+
+  while (count-- != 0)
+    filter_remove_key(filter, filter->keys[--filter->num_keys]);
+}
+
+/* END BLOOM FILTER */
+
+/* START COMPILATION */
+
+struct parser {
+  const char *p;
+  const char *end;
+  uint32_t depth;
+};
+
+static void test_free(struct selector_test *test);
+static void compound_free(struct compound *compound);
+static DOMSelector *parse_selector_list(struct parser *ps, bool nested);
+
+static inline char
+peek(const struct parser *ps)
+{
+  return ps->p < ps->end ? *ps->p : '\0';
+}
+
+static bool
+skip_whitespace(struct parser *ps)
+{
+  const char *start = ps->p;
+
+  while (ps->p < ps->end && is_ascii_whitespace(*ps->p))
+    ps->p++;
+
+  return ps->p != start;
+}
+
+static inline bool
+is_name_start(char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'
+      || (unsigned char) c >= 0x80;
+}
+
+static inline bool
+is_name_char(char c)
+{
+  return is_name_start(c) || (c >= '0' && c <= '9') || c == '-';
+}
+
+static inline int
+hex_value(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+    return (c | 0x20) - 'a' + 10;
+
+  return -1;
+}
+
+/* CSS Syntax 4.3.7 "consume an escaped code point"; past the backslash */
+static bool
+consume_escape(struct parser *ps, InfraString *out)
+{
+  uint32_t c = 0;
+  int n = 0;
+
+  if (ps->p >= ps->end || *ps->p == '\n')
+    return false;
+
+  if (hex_value(*ps->p) < 0) {
+    infra_string_put_char(out, *ps->p++);
+    return true;
+  }
+
+  for (; n < 6 && ps->p < ps->end && hex_value(*ps->p) >= 0; n++)
+    c = 16 * c + hex_value(*ps->p++);
+
+  if (ps->p < ps->end && is_ascii_whitespace(*ps->p))
+    ps->p++;
+
+  if (c == 0 || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+    c = 0xFFFD;
+
+  infra_string_put_codepoint(out, c);
+
+  return true;
+}
+
+static bool
+starts_identifier(const struct parser *ps)
+{
+  const char *p = ps->p;
+
+  if (p < ps->end && *p == '-')
+    p++;
+
+  if (p >= ps->end)
+    return false;
+
+  return *p == '-' || is_name_start(*p)
+      || (*p == '\\' && p + 1 < ps->end && p[1] != '\n');
+}
+
+/* NULL if there is no identifier here */
+static InfraString *
+parse_identifier(struct parser *ps)
+{
+  InfraString *ident;
+
+  if (!starts_identifier(ps))
+    return NULL;
+
+  ident = heap_string();
+
+  while (ps->p < ps->end) {
+    char c = *ps->p;
+
+    if (c == '\\') {
+      ps->p++;
+
+      if (!consume_escape(ps, ident)) {
+        infra_string_free(ident);
+        return NULL;
+      }
+    } else if (is_name_char(c)) {
+      infra_string_put_char(ident, c);
+      ps->p++;
+    } else {
+      break;
+    }
+  }
+
+  return ident;
+}
+
+static InfraString *
+parse_string(struct parser *ps)
+{
+  char quote = *ps->p++;
+  InfraString *string = heap_string();
+
+  while (ps->p < ps->end) {
+    char c = *ps->p++;
+
+    if (c == quote)
+      return string;
+
+    if (c == '\n')
+      break;
+
+    if (c != '\\') {
+      infra_string_put_char(string, c);
+    } else if (ps->p < ps->end && *ps->p == '\n') {
+      ps->p++;
+    } else if (!consume_escape(ps, string)) {
+      break;
+    }
+  }
+
+  infra_string_free(string);
+  return NULL;
+}
+
+static struct selector_test *
+new_test(enum TestKind kind)
+{
+  struct selector_test *test = infra_arena_alloc(NULL, sizeof (*test));
+
+  test->kind = kind;
+
+  return test;
+}
+
+/* Takes name */
+static void
+set_type(struct compound *compound, InfraString *name)
+{
+  uint16_t tag;
+
+  compound->name = name;
+  compound->lower_name = lower_copy(name);
+  compound->html_tag = html_tag_lookup(compound->lower_name->data, name->size);
+
+  /* foreign tags keep their case, so "clippath" is not clipPath */
+  if ((tag = html_svg_tag_lookup(compound->lower_name->data, name->size)) != 0
+   && strcmp(k_svg_tag_names[tag], name->data) == 0)
+    compound->svg_tag = tag;
+
+  if ((tag = html_mathml_tag_lookup(compound->lower_name->data, name->size)) != 0
+   && strcmp(k_mathml_tag_names[tag], name->data) == 0)
+    compound->mathml_tag = tag;
+}
+
+/* After the '[' */
+static struct selector_test *
+parse_attribute(struct parser *ps)
+{
+  struct selector_test *test;
+  InfraString *name;
+
+  skip_whitespace(ps);
+
+  if ((name = parse_identifier(ps)) == NULL)
+    return NULL;
+
+  test = new_test(TEST_ATTR_EXISTS);
+  test->name = name;
+  test->lower_name = lower_copy(name);
+
+  skip_whitespace(ps);
+
+  if (peek(ps) == ']') {
+    ps->p++;
+    return test;
+  }
+
+  switch (peek(ps)) {
+    case '=': test->kind = TEST_ATTR_EQUALS;     break;
+    case '~': test->kind = TEST_ATTR_INCLUDES;   break;
+    case '|': test->kind = TEST_ATTR_DASH_MATCH; break;
+    case '^': test->kind = TEST_ATTR_PREFIX;     break;
+    case '$': test->kind = TEST_ATTR_SUFFIX;     break;
+    case '*': test->kind = TEST_ATTR_SUBSTRING;  break;
+    default: goto fail;
+  }
+
+  if (test->kind != TEST_ATTR_EQUALS) {
+    if (ps->p + 1 >= ps->end || ps->p[1] != '=')
+      goto fail;
+    ps->p++;
+  }
+
+  ps->p++;
+  skip_whitespace(ps);
+
+  if (peek(ps) == '"' || peek(ps) == '\'')
+    test->value = parse_string(ps);
+  else
+    test->value = parse_identifier(ps);
+
+  if (test->value == NULL)
+    goto fail;
+
+  skip_whitespace(ps);
+
+  if ((peek(ps) | 0x20) == 'i' || (peek(ps) | 0x20) == 's') {
+    test->ignore_case = (peek(ps) | 0x20) == 'i';
+    ps->p++;
+    skip_whitespace(ps);
+  }
+
+  if (peek(ps) != ']')
+    goto fail;
+
+  ps->p++;
+  return test;
+
+fail:
+  test_free(test);
+  return NULL;
+}
+
+/* an+b, up to and including the ')' */
+static bool
+parse_nth(struct parser *ps, int32_t *a, int32_t *b)
+{
+  int32_t sign = 1, num = 0;
+  bool digits = false;
+
+  skip_whitespace(ps);
+
+  if (ps->end - ps->p >= 3 && strncasecmp(ps->p, "odd", 3) == 0) {
+    ps->p += 3;
+    *a = 2;
+    *b = 1;
+  } else if (ps->end - ps->p >= 4 && strncasecmp(ps->p, "even", 4) == 0) {
+    ps->p += 4;
+    *a = 2;
+    *b = 0;
+  } else {
+    if (peek(ps) == '+' || peek(ps) == '-')
+      sign = *ps->p++ == '-' ? -1 : 1;
+
+    for (; peek(ps) >= '0' && peek(ps) <= '9' && num < 100000000; digits = true)
+      num = 10 * num + (*ps->p++ - '0');
+
+    if ((peek(ps) | 0x20) != 'n') {
+      if (!digits)
+        return false;
+
+      *a = 0;
+      *b = sign * num;
+    } else {
+      ps->p++;
+      *a = sign * (digits ? num : 1);
+      *b = 0;
+
+      skip_whitespace(ps);
+
+      if (peek(ps) == '+' || peek(ps) == '-') {
+        sign = *ps->p++ == '-' ? -1 : 1;
+        skip_whitespace(ps);
+
+        for (num = 0, digits = false;
+             peek(ps) >= '0' && peek(ps) <= '9' && num < 100000000; digits = true)
+          num = 10 * num + (*ps->p++ - '0');
+
+        if (!digits)
+          return false;
+
+        *b = sign * num;
+      }
+    }
+  }
+
+  skip_whitespace(ps);
+
+  if (peek(ps) != ')')
+    return false;
+
+  ps->p++;
+  return true;
+}
+
+static void
+add_nth(struct compound *compound, enum TestKind kind, int32_t a, int32_t b)
+{
+  struct selector_test *test = new_test(kind);
+
+  test->a = a;
+  test->b = b;
+  infra_stack_push(compound->tests, test);
+}
+
+/* After the ':' */
+static bool
+parse_pseudo_class(struct parser *ps, struct compound *compound)
+{
+  static const struct {
+    const char *name;
+    enum TestKind kind;
+    bool only; /* also counted from the end */
+  } k_nth_shorthands[] = {
+    { "first-child",   TEST_NTH_CHILD,        false },
+    { "last-child",    TEST_NTH_LAST_CHILD,   false },
+    { "only-child",    TEST_NTH_CHILD,        true },
+    { "first-of-type", TEST_NTH_OF_TYPE,      false },
+    { "last-of-type",  TEST_NTH_LAST_OF_TYPE, false },
+    { "only-of-type",  TEST_NTH_OF_TYPE,      true },
+  };
+  static const struct {
+    const char *name;
+    enum TestKind kind;
+  } k_functions[] = {
+    { "nth-child",        TEST_NTH_CHILD },
+    { "nth-last-child",   TEST_NTH_LAST_CHILD },
+    { "nth-of-type",      TEST_NTH_OF_TYPE },
+    { "nth-last-of-type", TEST_NTH_LAST_OF_TYPE },
+    { "not",              TEST_NOT },
+    { "is",               TEST_IS },
+    { "where",            TEST_IS },
+  };
+
+  InfraString *name = parse_identifier(ps);
+  bool ok = false;
+
+  if (name == NULL)
+    return false;
+
+  if (peek(ps) != '(') {
+    if (strcasecmp(name->data, "root") == 0) {
+      infra_stack_push(compound->tests, new_test(TEST_ROOT));
+      ok = true;
+    } else if (strcasecmp(name->data, "empty") == 0) {
+      infra_stack_push(compound->tests, new_test(TEST_EMPTY));
+      ok = true;
+    }
+
+    for (size_t i = 0; !ok && i < sizeof (k_nth_shorthands) / sizeof (*k_nth_shorthands); i++) {
+      if (strcasecmp(name->data, k_nth_shorthands[i].name) != 0)
+        continue;
+
+      add_nth(compound, k_nth_shorthands[i].kind, 0, 1);
+      if (k_nth_shorthands[i].only)
+        add_nth(compound, k_nth_shorthands[i].kind == TEST_NTH_CHILD
+                          ? TEST_NTH_LAST_CHILD : TEST_NTH_LAST_OF_TYPE, 0, 1);
+      ok = true;
+    }
+
+    infra_string_free(name);
+    return ok;
+  }
+
+  ps->p++;
+
+  for (size_t i = 0; i < sizeof (k_functions) / sizeof (*k_functions); i++) {
+    enum TestKind kind = k_functions[i].kind;
+    struct selector_test *test;
+
+    if (strcasecmp(name->data, k_functions[i].name) != 0)
+      continue;
+
+    test = new_test(kind);
+    infra_stack_push(compound->tests, test);
+
+    if (kind == TEST_NOT || kind == TEST_IS) {
+      test->inner = parse_selector_list(ps, true);
+      ok = test->inner != NULL;
+
+      if (ok)
+        ps->p++;
+    } else {
+      ok = parse_nth(ps, &test->a, &test->b);
+    }
+
+    break;
+  }
+
+  infra_string_free(name);
+  return ok;
+}
+
+static struct compound *
+parse_compound(struct parser *ps)
+{
+  struct compound *compound = infra_arena_alloc(NULL, sizeof (*compound));
+  bool empty = true;
+  InfraString *ident;
+
+  compound->tests = heap_stack();
+
+  if (peek(ps) == '*') {
+    ps->p++;
+    empty = false;
+  } else if ((ident = parse_identifier(ps)) != NULL) {
+    set_type(compound, ident);
+    empty = false;
+  }
+
+  /* no namespace prefixes */
+  if (peek(ps) == '|')
+    goto fail;
+
+  for (;; empty = false) {
+    struct selector_test *test;
+
+    switch (peek(ps)) {
+      case '#':
+        ps->p++;
+
+        if ((ident = parse_identifier(ps)) == NULL)
+          goto fail;
+
+        if (compound->id == NULL) {
+          compound->id = ident;
+          continue;
+        }
+
+        /* #a#a still matches id="a"; #a#b never matches */
+        test = new_test(TEST_ID);
+        test->value = ident;
+        infra_stack_push(compound->tests, test);
+        continue;
+
+      case '.':
+        ps->p++;
+
+        if ((ident = parse_identifier(ps)) == NULL)
+          goto fail;
+
+        test = new_test(TEST_CLASS);
+        test->name = ident;
+        infra_stack_push(compound->tests, test);
+        continue;
+
+      case '[':
+        ps->p++;
+
+        if ((test = parse_attribute(ps)) == NULL)
+          goto fail;
+
+        infra_stack_push(compound->tests, test);
+        continue;
+
+      case ':':
+        ps->p++;
+
+        if (!parse_pseudo_class(ps, compound))
+          goto fail;
+
+        continue;
+
+      default:
+        break;
+    }
+
+    break;
+  }
+
+  if (empty)
+    goto fail;
+
+  return compound;
+
+fail:
+  compound_free(compound);
+  return NULL;
+}
+
+static void
+add_ancestor_hash(struct complex_selector *complex, uint32_t *count,
+                  uint32_t key)
+{
+  if (*count < MAX_ANCESTOR_HASHES)
+    complex->ancestor_hashes[(*count)++] = key;
+}
+
+/*
+ * Compounds left of a descendant or child combinator must be on ancestors
+ * of the subject. One left of a sibling combinator after that is only on
+ * an ancestor's sibling, so collecting stops at the first such combinator.
+ */
+static void
+collect_ancestor_hashes(struct complex_selector *complex)
+{
+  InfraStack *compounds = complex->compounds;
+  uint32_t count = 0;
+  bool above = false;
+
+  for (uint32_t i = 1; i < compounds->size; i++) {
+    const struct compound *right = compounds->items[i - 1];
+    const struct compound *compound = compounds->items[i];
+
+    if (right->combinator == COMBINATOR_DESCENDANT
+     || right->combinator == COMBINATOR_CHILD)
+      above = true;
+    else if (above)
+      break;
+
+    if (!above)
+      continue;
+
+    if (compound->name != NULL)
+      add_ancestor_hash(complex, &count, bloom_key(compound->lower_name->data,
+                        compound->lower_name->size, k_salt_tag));
+
+    if (compound->id != NULL)
+      add_ancestor_hash(complex, &count, bloom_key(compound->id->data,
+                        compound->id->size, k_salt_id));
+
+    INFRA_STACK_FOREACH(compound->tests, t) {
+      const struct selector_test *test = compound->tests->items[t];
+
+      if (test->kind == TEST_CLASS)
+        add_ancestor_hash(complex, &count, bloom_key(test->name->data,
+                          test->name->size, k_salt_class));
+    }
+  }
+}
+
+static void
+complex_free(struct complex_selector *complex)
+{
+  INFRA_STACK_FOREACH(complex->compounds, i)
+    compound_free(complex->compounds->items[i]);
+
+  infra_stack_free(complex->compounds);
+  infra_arena_free(NULL, complex, sizeof (*complex));
+}
+
+static struct complex_selector *
+parse_complex(struct parser *ps)
+{
+  InfraStack *parsed = heap_stack(); /* left to right */
+  struct complex_selector *complex;
+  enum Combinator combinator = COMBINATOR_NONE;
+
+  for (;;) {
+    struct compound *compound = parse_compound(ps);
+    bool spaces;
+
+    if (compound == NULL) {
+      INFRA_STACK_FOREACH(parsed, i)
+        compound_free(parsed->items[i]);
+      infra_stack_free(parsed);
+      return NULL;
+    }
+
+    compound->combinator = combinator;
+    infra_stack_push(parsed, compound);
+
+    spaces = skip_whitespace(ps);
+
+    switch (peek(ps)) {
+      case '>': combinator = COMBINATOR_CHILD;              break;
+      case '+': combinator = COMBINATOR_NEXT_SIBLING;       break;
+      case '~': combinator = COMBINATOR_SUBSEQUENT_SIBLING; break;
+
+      case ',': case ')': case '\0':
+        combinator = COMBINATOR_NONE;
+        break;
+
+      default:
+        combinator = spaces ? COMBINATOR_DESCENDANT : COMBINATOR_NONE;
+        break;
+    }
+
+    if (combinator == COMBINATOR_NONE)
+      break;
+
+    if (combinator != COMBINATOR_DESCENDANT) {
+      ps->p++;
+      skip_whitespace(ps);
+    }
+  }
+
+  /*
+   * Each compound holds the combinator on its left, which once reversed
+   * is the one leading on from it; the leftmost one has none.
+   */
+  complex = infra_arena_alloc(NULL, sizeof (*complex));
+  complex->compounds = heap_stack();
+
+  for (uint32_t i = parsed->size; i-- > 0; )
+    infra_stack_push(complex->compounds, parsed->items[i]);
+
+  infra_stack_free(parsed);
+  collect_ancestor_hashes(complex);
+
+  return complex;
+}
+
+static DOMSelector *
+parse_selector_list(struct parser *ps, bool nested)
+{
+  DOMSelector *selector = infra_arena_alloc(NULL, sizeof (*selector));
+
+  selector->complexes = heap_stack();
+
+  if (++ps->depth > MAX_SELECTOR_DEPTH)
+    goto fail;
+
+  for (;;) {
+    struct complex_selector *complex;
+
+    skip_whitespace(ps);
+
+    if ((complex = parse_complex(ps)) == NULL)
+      goto fail;
+
+    infra_stack_push(selector->complexes, complex);
+
+    if (complex->ancestor_hashes[0] != 0)
+      selector->uses_bloom = true;
+
+    if (peek(ps) != ',')
+      break;
+
+    ps->p++;
+  }
+
+  ps->depth--;
+
+  if (nested ? peek(ps) != ')' : ps->p != ps->end)
+    goto fail;
+
+  return selector;
+
+fail:
+  dom_selector_free(selector);
+  return NULL;
+}
+
+static void
+test_free(struct selector_test *test)
+{
+  infra_string_unref(test->name);
+  infra_string_unref(test->lower_name);
+  infra_string_unref(test->value);
+
+  if (test->inner != NULL)
+    dom_selector_free(test->inner);
+
+  infra_arena_free(NULL, test, sizeof (*test));
+}
+
+static void
+compound_free(struct compound *compound)
+{
+  INFRA_STACK_FOREACH(compound->tests, i)
+    test_free(compound->tests->items[i]);
+
+  infra_string_unref(compound->name);
+  infra_string_unref(compound->lower_name);
+  infra_string_unref(compound->id);
+  infra_stack_free(compound->tests);
+  infra_arena_free(NULL, compound, sizeof (*compound));
+}
+
+DOMSelector *
+dom_selector_compile(const char *text, size_t len)
+{
+  struct parser ps = { .p = text, .end = text + len };
+
+  call_once(&tag_keys_once, build_tag_keys);
+
+  return parse_selector_list(&ps, false);
+}
+
+void
+dom_selector_free(DOMSelector *selector)
+{
+  INFRA_STACK_FOREACH(selector->complexes, i)
+    complex_free(selector->complexes->items[i]);
+
+  infra_stack_free(selector->complexes);
+  infra_arena_free(NULL, selector, sizeof (*selector));
+}
+
+/* END COMPILATION */
+
+/* START MATCHING */
+
+struct match_context {
+  bool quirks;
+
+  /* holds every ancestor of the candidate when non-NULL */
+  const struct ancestor_filter *filter;
+};
+
+static bool match_list(const DOMSelector *selector, struct dom_element *element,
+                       const struct match_context *ctx);
+
+static inline struct dom_element *
+parent_element(const struct dom_node *node)
+{
+  struct dom_node *parent = node->parent;
+
+  return parent != NULL && DOM_IMPLEMENTS(parent, element) ? (DOMAny *) parent : NULL;
+}
+
+static struct dom_element *
+sibling_element(const struct dom_node *node, bool next)
+{
+  for (node = next ? node->next_sibling : node->prev_sibling; node != NULL;
+       node = next ? node->next_sibling : node->prev_sibling)
+    if (DOM_IMPLEMENTS(node, element))
+      return (DOMAny *) node;
+
+  return NULL;
+}
+
+static bool
+bytes_equal(const char *a, const char *b, size_t len, bool ignore_case)
+{
+  return ignore_case ? strncasecmp(a, b, len) == 0 : memcmp(a, b, len) == 0;
+}
+
+static bool
+matches_type(const struct compound *compound, const struct dom_element *element)
+{
+  const InfraString *name = element->uninterned_local_name;
+  const InfraString *expected;
+
+  if (element->local_name != 0) {
+    switch (element->namespace) {
+      case INFRA_NAMESPACE_HTML:
+        return element->local_name == compound->html_tag;
+      case INFRA_NAMESPACE_SVG:
+        return element->local_name == compound->svg_tag;
+      case INFRA_NAMESPACE_MATHML:
+        return element->local_name == compound->mathml_tag;
+      default:
+        return false;
+    }
+  }
+
+  if (name == NULL)
+    return false;
+
+  expected = element->namespace == INFRA_NAMESPACE_HTML
+           ? compound->lower_name : compound->name;
+
+  return name->size == expected->size
+      && memcmp(name->data, expected->data, name->size) == 0;
+}
+
+static bool
+same_type(const struct dom_element *a, const struct dom_element *b)
+{
+  if (a->namespace != b->namespace || a->local_name != b->local_name)
+    return false;
+
+  if (a->local_name != 0)
+    return true;
+
+  return a->uninterned_local_name != NULL && b->uninterned_local_name != NULL
+      && a->uninterned_local_name->size == b->uninterned_local_name->size
+      && memcmp(a->uninterned_local_name->data, b->uninterned_local_name->data,
+                a->uninterned_local_name->size) == 0;
+}
+
+static bool
+has_token(const InfraString *list, const char *token, size_t len,
+          bool ignore_case)
+{
+  const char *p = list->data, *end = p + list->size;
+
+  while (p < end) {
+    const char *start;
+
+    while (p < end && is_ascii_whitespace(*p))
+      p++;
+
+    for (start = p; p < end && !is_ascii_whitespace(*p); p++)
+      ;
+
+    if ((size_t) (p - start) == len && len != 0
+     && bytes_equal(start, token, len, ignore_case))
+      return true;
+  }
+
+  return false;
+}
+
+static const InfraString *
+find_attribute(const struct dom_element *element, const struct selector_test *test)
+{
+  const InfraString *name = element->namespace == INFRA_NAMESPACE_HTML
+                        ? test->lower_name : test->name;
+
+  return dom_element_get_attribute(element, name->data, name->size);
+}
+
+static bool
+matches_attribute(const struct selector_test *test, const InfraString *value)
+{
+  const InfraString *expected = test->value;
+  bool icase = test->ignore_case;
+
+  switch (test->kind) {
+    case TEST_ATTR_EXISTS:
+      return true;
+
+    case TEST_ATTR_EQUALS:
+      return value->size == expected->size
+          && bytes_equal(value->data, expected->data, value->size, icase);
+
+    case TEST_ATTR_INCLUDES:
+      return has_token(value, expected->data, expected->size, icase);
+
+    case TEST_ATTR_DASH_MATCH:
+      return value->size >= expected->size
+          && bytes_equal(value->data, expected->data, expected->size, icase)
+          && (value->size == expected->size || value->data[expected->size] == '-');
+
+    case TEST_ATTR_PREFIX:
+      return expected->size != 0 && value->size >= expected->size
+          && bytes_equal(value->data, expected->data, expected->size, icase);
+
+    case TEST_ATTR_SUFFIX:
+      return expected->size != 0 && value->size >= expected->size
+          && bytes_equal(value->data + value->size - expected->size,
+                         expected->data, expected->size, icase);
+
+    case TEST_ATTR_SUBSTRING:
+      if (expected->size == 0)
+        return false;
+
+      for (size_t i = 0; i + expected->size <= value->size; i++)
+        if (bytes_equal(value->data + i, expected->data, expected->size, icase))
+          return true;
+
+      return false;
+
+    default:
+      return false;
+  }
+}
+
+/* Whether some n >= 0 has a*n + b == index (1-based) */
+static bool
+matches_nth(int32_t a, int32_t b, uint32_t index)
+{
+  int64_t diff = (int64_t) index - b;
+
+  if (a == 0)
+    return diff == 0;
+
+  return diff / a >= 0 && diff % a == 0;
+}
+
+static uint32_t
+nth_index(const struct dom_element *element, bool from_end, bool of_type)
+{
+  const struct dom_node *node = (const struct dom_node *) element;
+  uint32_t index = 1;
+
+  for (const struct dom_element *e = sibling_element(node, from_end); e != NULL;
+       e = sibling_element((const struct dom_node *) e, from_end))
+    if (!of_type || same_type(e, element))
+      index++;
+
+  return index;
+}
+
+static bool
+is_empty(const struct dom_node *node)
+{
+  DOM_NODE_FOREACH_CHILD(node, child) {
+    if (DOM_IMPLEMENTS(child, element))
+      return false;
+
+    if (DOM_IMPLEMENTS(child, text)) {
+      size_t len;
+
+      if (dom_character_data_get((const struct dom_character_data *) child,
+                                 &len) != NULL)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+/* Ids compare ASCII case-insensitively in quirks mode */
+static bool
+matches_id(const struct dom_element *element, const InfraString *expected,
+           bool quirks)
+{
+  const InfraString *id = dom_element_get_attribute(element, "id", 2);
+
+  return id != NULL && id->size == expected->size
+      && bytes_equal(id->data, expected->data, id->size, quirks);
+}
+
+static bool
+matches_test(const struct selector_test *test, struct dom_element *element,
+             const struct match_context *ctx)
+{
+  const struct dom_node *node = (const struct dom_node *) element;
+  const InfraString *value;
+
+  switch (test->kind) {
+    case TEST_CLASS:
+      value = dom_element_get_attribute(element, "class", 5);
+      return value != NULL
+          && has_token(value, test->name->data, test->name->size, ctx->quirks);
+
+    case TEST_ID:
+      return matches_id(element, test->value, ctx->quirks);
+
+    case TEST_ROOT:
+      return node->parent != NULL && DOM_IMPLEMENTS(node->parent, document);
+
+    case TEST_EMPTY:
+      return is_empty(node);
+
+    case TEST_NTH_CHILD:
+    case TEST_NTH_LAST_CHILD:
+    case TEST_NTH_OF_TYPE:
+    case TEST_NTH_LAST_OF_TYPE:
+      /* parentless elements still count as the first and only child */
+      return matches_nth(test->a, test->b, nth_index(element,
+                         test->kind == TEST_NTH_LAST_CHILD
+                          || test->kind == TEST_NTH_LAST_OF_TYPE,
+                         test->kind == TEST_NTH_OF_TYPE
+                          || test->kind == TEST_NTH_LAST_OF_TYPE));
+
+    case TEST_NOT:
+      return !match_list(test->inner, element, ctx);
+
+    case TEST_IS:
+      return match_list(test->inner, element, ctx);
+
+    default:
+      return (value = find_attribute(element, test)) != NULL
+          && matches_attribute(test, value);
+  }
+}
+
+static bool
+matches_compound(const struct compound *compound, struct dom_element *element,
+                 const struct match_context *ctx)
+{
+  if (compound->name != NULL && !matches_type(compound, element))
+    return false;
+
+  if (compound->id != NULL && !matches_id(element, compound->id, ctx->quirks))
+    return false;
+
+  INFRA_STACK_FOREACH(compound->tests, i)
+    if (!matches_test(compound->tests->items[i], element, ctx))
+      return false;
+
+  return true;
+}
+
+/*
+ * Right to left from compound index. Recursion is bounded by the number of
+ * compounds; the tree is climbed by loops.
+ */
+static bool
+matches_from(const struct complex_selector *complex, uint32_t index,
+             struct dom_element *element, const struct match_context *ctx)
+{
+  const struct compound *compound = complex->compounds->items[index];
+  struct dom_node *node = (struct dom_node *) element;
+  struct dom_element *e;
+
+  if (!matches_compound(compound, element, ctx))
+    return false;
+
+  if (index + 1 == complex->compounds->size)
+    return true;
+
+  switch (compound->combinator) {
+    case COMBINATOR_CHILD:
+      return (e = parent_element(node)) != NULL
+          && matches_from(complex, index + 1, e, ctx);
+
+    case COMBINATOR_DESCENDANT:
+      for (e = parent_element(node); e != NULL;
+           e = parent_element((struct dom_node *) e))
+        if (matches_from(complex, index + 1, e, ctx))
+          return true;
+
+      return false;
+
+    case COMBINATOR_NEXT_SIBLING:
+      return (e = sibling_element(node, false)) != NULL
+          && matches_from(complex, index + 1, e, ctx);
+
+    case COMBINATOR_SUBSEQUENT_SIBLING:
+      for (e = sibling_element(node, false); e != NULL;
+           e = sibling_element((struct dom_node *) e, false))
+        if (matches_from(complex, index + 1, e, ctx))
+          return true;
+
+      return false;
+
+    default:
+      return false;
+  }
+}
+
+static bool
+match_complex(const struct complex_selector *complex,
+              struct dom_element *element, const struct match_context *ctx)
+{
+  if (ctx->filter != NULL)
+    for (uint32_t i = 0; i < MAX_ANCESTOR_HASHES && complex->ancestor_hashes[i] != 0; i++)
+      if (!bloom_may_contain(ctx->filter, complex->ancestor_hashes[i]))
+        return false;
+
+  return matches_from(complex, 0, element, ctx);
+}
+
+static bool
+match_list(const DOMSelector *selector, struct dom_element *element,
+           const struct match_context *ctx)
+{
+  INFRA_STACK_FOREACH(selector->complexes, i)
+    if (matches_from(selector->complexes->items[i], 0, element, ctx))
+      return true;
+
+  return false;
+}
+
+static bool
+is_quirky(const struct dom_node *node)
+{
+  const struct dom_document *document = DOM_IMPLEMENTS(node, document)
+                                      ? (const DOMAny *) node : node->node_document;
+
+  return document != NULL && document->mode == DOM_DOCUMENT_MODE_QUIRKS;
+}
+
+bool
+dom_selector_matches(const DOMSelector *selector, struct dom_element *element)
+{
+  struct match_context ctx = { .quirks = is_quirky((struct dom_node *) element) };
+
+  INFRA_STACK_FOREACH(selector->complexes, i)
+    if (match_complex(selector->complexes->items[i], element, &ctx))
+      return true;
+
+  return false;
+}
+
+/* END MATCHING */
+
+/* START QUERIES */
+
+/* Return true to stop the walk */
+typedef bool (*VisitFunc) (struct dom_element *element,
+                           const struct match_context *ctx, void *user_data);
+
+/* Preorder over root's descendants, keeping the filter in step */
+static void
+walk(struct dom_node *root, bool use_filter, VisitFunc visit, void *user_data)
+{
+  struct match_context ctx = { .quirks = is_quirky(root) };
+  struct ancestor_filter *filter = NULL;
+  struct dom_node *node = root->first_child;
+
+  if (use_filter) {
+    InfraStack *chain = heap_stack();
+
+    filter = infra_arena_alloc(NULL, sizeof (*filter));
+
+    for (struct dom_node *n = root; n != NULL; n = n->parent)
+      if (DOM_IMPLEMENTS(n, element))
+        infra_stack_push(chain, n);
+
+    while (chain->size != 0)
+      filter_push(filter, infra_stack_pop(chain));
+
+    infra_stack_free(chain);
+    ctx.filter = filter;
+  }
+
+  while (node != NULL) {
+    bool is_element = DOM_IMPLEMENTS(node, element);
+
+    if (is_element && visit((DOMAny *) node, &ctx, user_data))
+      break;
+
+    if (node->first_child != NULL) {
+      if (filter != NULL && is_element)
+        filter_push(filter, (DOMAny *) node);
+
+      node = node->first_child;
+      continue;
+    }
+
+    for (;;) {
+      if (node->next_sibling != NULL) {
+        node = node->next_sibling;
+        break;
+      }
+
+      if ((node = node->parent) == root) {
+        node = NULL;
+        break;
+      }
+
+      if (filter != NULL && DOM_IMPLEMENTS(node, element))
+        filter_pop(filter);
+    }
+  }
+
+  if (filter != NULL) {
+    free(filter->keys);
+    infra_arena_free(NULL, filter, sizeof (*filter));
+  }
+}
+
+struct query_state {
+  const DOMSelector *selector;
+  InfraStack *out;
+  bool first_only;
+};
+
+static bool
+query_visit(struct dom_element *element, const struct match_context *ctx,
+            void *user_data)
+{
+  struct query_state *state = user_data;
+
+  INFRA_STACK_FOREACH(state->selector->complexes, i) {
+    if (match_complex(state->selector->complexes->items[i], element, ctx)) {
+      infra_stack_push(state->out, element);
+      return state->first_only;
+    }
+  }
+
+  return false;
+}
+
+static void
+query(const DOMSelector *selector, struct dom_node *root, InfraStack *out,
+      bool first_only)
+{
+  struct query_state state = { selector, out, first_only };
+
+  walk(root, selector->uses_bloom, query_visit, &state);
+}
+
+struct dom_element *
+dom_selector_query(const DOMSelector *selector, struct dom_node *root)
+{
+  InfraStack *out = heap_stack();
+  struct dom_element *result;
+
+  query(selector, root, out, true);
+  result = infra_stack_pop(out);
+  infra_stack_free(out);
+
+  return result;
+}
+
+void
+dom_selector_query_all(const DOMSelector *selector, struct dom_node *root,
+                       InfraStack *out)
+{
+  query(selector, root, out, false);
+}
+
+bool
+dom_query_selector(struct dom_node *root, const char *selectors, size_t len,
+                   struct dom_element **result)
+{
+  DOMSelector *selector = dom_selector_compile(selectors, len);
+
+  if (selector == NULL)
+    return false;
+
+  *result = dom_selector_query(selector, root);
+  dom_selector_free(selector);
+
+  return true;
+}
+
+bool
+dom_query_selector_all(struct dom_node *root, const char *selectors,
+                       size_t len, InfraStack *out)
+{
+  DOMSelector *selector = dom_selector_compile(selectors, len);
+
+  if (selector == NULL)
+    return false;
+
+  dom_selector_query_all(selector, root, out);
+  dom_selector_free(selector);
+
+  return true;
+}
+
+/* END QUERIES */
+
+/* START SELECTOR SETS */
+
+struct set_entry {
+  const struct complex_selector *complex;
+  uint32_t rule;
+};
+
+/* Open addressing over lowercased keys, copied into the set */
+struct bucket_slot {
+  InfraString *key; /* NULL if unused */
+  uint32_t hash;
+  InfraStack *entries; // -> struct set_entry
+};
+
+struct bucket_map {
+  struct bucket_slot *slots;
+  uint32_t cap; /* power of two, or 0 */
+  uint32_t count;
+};
+
+struct DOMSelectorSet_s {
+  InfraStack *rules; // -> DOMSelector
+  bool uses_bloom;
+
+  /* every complex selector is filed under one feature of its subject */
+  struct bucket_map ids;
+  struct bucket_map classes;
+  struct bucket_map attributes;
+  struct bucket_map names; /* type selectors, for uninterned elements */
+  InfraStack *html_tags[NUM_HTML_TAG];
+  InfraStack *svg_tags[NUM_SVG_TAG];
+  InfraStack *mathml_tags[NUM_MATHML_TAG];
+  InfraStack *universal;
+};
+
+static const uint32_t k_bucket_map_initial_cap = 64;
+
+static struct bucket_slot *
+bucket_slot(const struct bucket_map *map, const char *key, size_t len,
+            uint32_t hash)
+{
+  for (uint32_t i = hash; ; i++) {
+    struct bucket_slot *slot = &map->slots[i & (map->cap - 1)];
+
+    if (slot->key == NULL
+     || (slot->hash == hash && slot->key->size == len
+      && strncasecmp(slot->key->data, key, len) == 0))
+      return slot;
+  }
+}
+
+static const InfraStack *
+bucket_find(const struct bucket_map *map, const char *key, size_t len)
+{
+  const struct bucket_slot *slot;
+
+  if (map->count == 0)
+    return NULL;
+
+  slot = bucket_slot(map, key, len, bloom_key(key, len, 0));
+
+  return slot->entries;
+}
+
+static void
+bucket_map_grow(struct bucket_map *map)
+{
+  struct bucket_slot *old_slots = map->slots;
+  uint32_t old_cap = map->cap;
+
+  map->cap = old_cap != 0 ? 2 * old_cap : k_bucket_map_initial_cap;
+  map->slots = infra_arena_alloc(NULL, map->cap * sizeof (*map->slots));
+
+  for (uint32_t i = 0; i < old_cap; i++) {
+    struct bucket_slot *slot = &old_slots[i];
+
+    if (slot->key != NULL)
+      *bucket_slot(map, slot->key->data, slot->key->size, slot->hash) = *slot;
+  }
+
+  if (old_slots != NULL)
+    infra_arena_free(NULL, old_slots, old_cap * sizeof (*old_slots));
+}
+
+static InfraStack *
+bucket_get(struct bucket_map *map, const InfraString *key)
+{
+  uint32_t hash = bloom_key(key->data, key->size, 0);
+  struct bucket_slot *slot;
+
+  if (2 * (map->count + 1) > map->cap)
+    bucket_map_grow(map);
+
+  slot = bucket_slot(map, key->data, key->size, hash);
+
+  if (slot->key == NULL) {
+    slot->key = lower_copy(key);
+    slot->hash = hash;
+    slot->entries = heap_stack();
+    map->count++;
+  }
+
+  return slot->entries;
+}
+
+static void
+free_entries(InfraStack *list)
+{
+  if (list == NULL)
+    return;
+
+  INFRA_STACK_FOREACH(list, i)
+    infra_arena_free(NULL, list->items[i], sizeof (struct set_entry));
+
+  infra_stack_free(list);
+}
+
+static void
+bucket_map_free(struct bucket_map *map)
+{
+  for (uint32_t i = 0; i < map->cap; i++)
+    if (map->slots[i].key != NULL) {
+      infra_string_free(map->slots[i].key);
+      free_entries(map->slots[i].entries);
+    }
+
+  if (map->slots != NULL)
+    infra_arena_free(NULL, map->slots, map->cap * sizeof (*map->slots));
+}
+
+static void
+file_entry(InfraStack **list, const struct complex_selector *complex,
+           uint32_t rule)
+{
+  struct set_entry *entry = infra_arena_alloc(NULL, sizeof (*entry));
+
+  entry->complex = complex;
+  entry->rule = rule;
+
+  if (*list == NULL)
+    *list = heap_stack();
+
+  infra_stack_push(*list, entry);
+}
+
+/* Ids beat classes beat type selectors beat attribute names */
+static void
+file_complex(DOMSelectorSet *set, const struct complex_selector *complex,
+             uint32_t rule)
+{
+  const struct compound *subject = complex->compounds->items[0];
+  InfraStack *list;
+
+  if (subject->id != NULL) {
+    list = bucket_get(&set->ids, subject->id);
+    file_entry(&list, complex, rule);
+    return;
+  }
+
+  INFRA_STACK_FOREACH(subject->tests, i) {
+    const struct selector_test *test = subject->tests->items[i];
+
+    if (test->kind == TEST_CLASS) {
+      list = bucket_get(&set->classes, test->name);
+      file_entry(&list, complex, rule);
+      return;
+    }
+  }
+
+  if (subject->name != NULL) {
+    if (subject->html_tag != 0)
+      file_entry(&set->html_tags[subject->html_tag], complex, rule);
+    if (subject->svg_tag != 0)
+      file_entry(&set->svg_tags[subject->svg_tag], complex, rule);
+    if (subject->mathml_tag != 0)
+      file_entry(&set->mathml_tags[subject->mathml_tag], complex, rule);
+
+    list = bucket_get(&set->names, subject->name);
+    file_entry(&list, complex, rule);
+    return;
+  }
+
+  INFRA_STACK_FOREACH(subject->tests, i) {
+    const struct selector_test *test = subject->tests->items[i];
+
+    if (test->kind >= TEST_ATTR_EXISTS && test->kind <= TEST_ATTR_SUBSTRING) {
+      list = bucket_get(&set->attributes, test->name);
+      file_entry(&list, complex, rule);
+      return;
+    }
+  }
+
+  file_entry(&set->universal, complex, rule);
+}
+
+DOMSelectorSet *
+dom_selector_set_create(void)
+{
+  DOMSelectorSet *set = infra_arena_alloc(NULL, sizeof (*set));
+
+  set->rules = heap_stack();
+
+  return set;
+}
+
+int32_t
+dom_selector_set_add(DOMSelectorSet *set, const char *text, size_t len)
+{
+  DOMSelector *selector = dom_selector_compile(text, len);
+  uint32_t rule = set->rules->size;
+
+  if (selector == NULL)
+    return -1;
+
+  infra_stack_push(set->rules, selector);
+  set->uses_bloom |= selector->uses_bloom;
+
+  INFRA_STACK_FOREACH(selector->complexes, i)
+    file_complex(set, selector->complexes->items[i], rule);
+
+  return rule;
+}
+
+uint32_t
+dom_selector_set_num_rules(const DOMSelectorSet *set)
+{
+  return set->rules->size;
+}
+
+void
+dom_selector_set_free(DOMSelectorSet *set)
+{
+  bucket_map_free(&set->ids);
+  bucket_map_free(&set->classes);
+  bucket_map_free(&set->attributes);
+  bucket_map_free(&set->names);
+
+  for (size_t i = 0; i < NUM_HTML_TAG; i++)
+    free_entries(set->html_tags[i]);
+  for (size_t i = 0; i < NUM_SVG_TAG; i++)
+    free_entries(set->svg_tags[i]);
+  for (size_t i = 0; i < NUM_MATHML_TAG; i++)
+    free_entries(set->mathml_tags[i]);
+  free_entries(set->universal);
+
+  INFRA_STACK_FOREACH(set->rules, i)
+    dom_selector_free(set->rules->items[i]);
+
+  infra_stack_free(set->rules);
+  infra_arena_free(NULL, set, sizeof (*set));
+}
+
+struct set_query_state {
+  const DOMSelectorSet *set;
+  DOMSelectorMatchFunc match;
+  void *user_data;
+
+  /* which element each rule last matched, so it is reported once */
+  uint32_t *stamps;
+  uint32_t serial;
+};
+
+static void
+try_entries(struct set_query_state *state, const InfraStack *list,
+            struct dom_element *element, const struct match_context *ctx)
+{
+  if (list == NULL)
+    return;
+
+  INFRA_STACK_FOREACH(list, i) {
+    const struct set_entry *entry = list->items[i];
+
+    if (state->stamps[entry->rule] == state->serial
+     || !match_complex(entry->complex, element, ctx))
+      continue;
+
+    state->stamps[entry->rule] = state->serial;
+    state->match(entry->rule, element, state->user_data);
+  }
+}
+
+static bool
+set_query_visit(struct dom_element *element, const struct match_context *ctx,
+                void *user_data)
+{
+  struct set_query_state *state = user_data;
+  const DOMSelectorSet *set = state->set;
+  const InfraString *value;
+
+  state->serial++;
+
+  if ((value = dom_element_get_attribute(element, "id", 2)) != NULL
+   && value->size != 0)
+    try_entries(state, bucket_find(&set->ids, value->data, value->size),
+                element, ctx);
+
+  if ((value = dom_element_get_attribute(element, "class", 5)) != NULL
+   && set->classes.count != 0) {
+    const char *p = value->data, *end = p + value->size;
+
+    while (p < end) {
+      const char *token;
+
+      while (p < end && is_ascii_whitespace(*p))
+        p++;
+
+      for (token = p; p < end && !is_ascii_whitespace(*p); p++)
+        ;
+
+      if (p != token)
+        try_entries(state, bucket_find(&set->classes, token, p - token),
+                    element, ctx);
+    }
+  }
+
+  if (element->local_name == 0) {
+    if (element->uninterned_local_name != NULL)
+      try_entries(state, bucket_find(&set->names,
+                  element->uninterned_local_name->data,
+                  element->uninterned_local_name->size), element, ctx);
+  } else if (element->namespace == INFRA_NAMESPACE_HTML) {
+    try_entries(state, set->html_tags[element->local_name], element, ctx);
+  } else if (element->namespace == INFRA_NAMESPACE_SVG) {
+    try_entries(state, set->svg_tags[element->local_name], element, ctx);
+  } else if (element->namespace == INFRA_NAMESPACE_MATHML) {
+    try_entries(state, set->mathml_tags[element->local_name], element, ctx);
+  }
+
+  if (set->attributes.count != 0) {
+    for (uint32_t i = 0; i < element->num_attrs; i++) {
+      const struct dom_attr_slot *attr = &element->attrs[i];
+
+      if (attr->namespace == INFRA_NAMESPACE_NONE)
+        try_entries(state, bucket_find(&set->attributes, attr->local_name->data,
+                                       attr->local_name->size), element, ctx);
+    }
+  }
+
+  try_entries(state, set->universal, element, ctx);
+
+  return false;
+}
+
+void
+dom_selector_set_match(const DOMSelectorSet *set, struct dom_node *root,
+                       DOMSelectorMatchFunc match, void *user_data)
+{
+  struct set_query_state state = {
+    .set = set,
+    .match = match,
+    .user_data = user_data,
+  };
+
+  if (set->rules->size == 0)
+    return;
+
+  state.stamps = infra_arena_alloc(NULL, set->rules->size * sizeof (uint32_t));
+
+  walk(root, set->uses_bloom, set_query_visit, &state);
+
+  infra_arena_free(NULL, state.stamps, set->rules->size * sizeof (uint32_t));
+}
+
+/* END SELECTOR SETS */
@@ -0,0 +1,756 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <wfs/dom_snapshot.h>
+#include <wfs/dom_html.h>
+#include <wfs/html_foreign.h>
+#include <wfs/html_tags.h>
+#include <wfs/infra_atom.h>
+
+static const char k_snapshot_magic[8] = "WFSSNAP";
+static const uint32_t k_snapshot_byte_order = 0x01020304;
+
+/* Followed by the node, attribute and string sections, in that order */
+struct snapshot_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint16_t node_size;
+  uint16_t attr_size;
+  uint16_t num_html_tags;
+  uint16_t num_svg_tags;
+  uint16_t num_mathml_tags;
+  uint8_t mode;
+  uint8_t _pad;
+
+  uint32_t num_nodes;
+  uint32_t num_attrs;
+  uint32_t strings_size;
+  uint32_t nodes_offset;
+  uint32_t attrs_offset;
+  uint32_t strings_offset;
+};
+
+struct DOMSnapshot_s {
+  const struct snapshot_header *header;
+  const DOMSnapNode *nodes;
+  const DOMSnapAttr *attrs;
+  const char *strings;
+
+  void *mapping; /* NULL unless from dom_snapshot_map() */
+  size_t mapping_len;
+};
+
+/* Attribute prefixes are static strings, see HTMLForeignAttr */
+static const char *k_attr_prefixes[] = { "xlink", "xml", "xmlns" };
+
+static const char *
+static_prefix(const char *prefix)
+{
+  for (size_t i = 0; i < sizeof (k_attr_prefixes) / sizeof (k_attr_prefixes[0]); i++)
+    if (strcmp(prefix, k_attr_prefixes[i]) == 0)
+      return k_attr_prefixes[i];
+
+  return NULL;
+}
+
+static void *
+grow(void *items, uint32_t *cap, uint32_t need, size_t item_size)
+{
+  uint32_t new_cap = *cap != 0 ? *cap : 16;
+
+  if (need <= *cap)
+    return items;
+
+  while (new_cap < need)
+    new_cap *= 2;
+
+  items = realloc(items, new_cap * item_size);
+
+  if (items == NULL)
+    abort();
+
+  *cap = new_cap;
+  return items;
+}
+
+static inline size_t
+align_up(size_t n, size_t to)
+{
+  return (n + to - 1) & ~(to - 1);
+}
+
+/* START WRITER */
+
+struct writer {
+  DOMSnapNode *nodes;
+  uint32_t num_nodes;
+  uint32_t nodes_cap;
+
+  DOMSnapAttr *attrs;
+  uint32_t num_attrs;
+  uint32_t attrs_cap;
+
+  /* uint32_t length, bytes, NUL, padded to 4 */
+  char *strings;
+  uint32_t strings_size;
+  uint32_t strings_cap;
+
+  /* open addressing over string offsets, for deduplication */
+  uint32_t *slots;
+  uint32_t slots_cap;
+  uint32_t num_strings;
+
+  bool failed;
+};
+
+static uint32_t
+string_length_at(const char *strings, uint32_t offset)
+{
+  uint32_t len;
+
+  memcpy(&len, strings + offset, sizeof (len));
+  return len;
+}
+
+static void
+rehash_strings(struct writer *w)
+{
+  uint32_t new_cap = w->slots_cap != 0 ? w->slots_cap * 2 : 256;
+  uint32_t *new_slots = calloc(new_cap, sizeof (*new_slots));
+
+  if (new_slots == NULL)
+    abort();
+
+  for (uint32_t i = 0; i < w->slots_cap; i++) {
+    uint32_t offset = w->slots[i];
+    uint32_t h;
+
+    if (offset == 0)
+      continue;
+
+    h = infra_hash_bytes(w->strings + offset + 4,
+                         string_length_at(w->strings, offset));
+
+    while (new_slots[h & (new_cap - 1)] != 0)
+      h++;
+
+    new_slots[h & (new_cap - 1)] = offset;
+  }
+
+  free(w->slots);
+  w->slots = new_slots;
+  w->slots_cap = new_cap;
+}
+
+static uint32_t
+put_bytes(struct writer *w, const char *data, size_t len)
+{
+  uint32_t h, offset, size, len32 = len;
+
+  if (data == NULL)
+    return 0;
+
+  if (len > UINT32_MAX - 8) {
+    w->failed = true;
+    return 0;
+  }
+
+  if (2 * (w->num_strings + 1) > w->slots_cap)
+    rehash_strings(w);
+
+  for (h = infra_hash_bytes(data, len); ; h++) {
+    offset = w->slots[h & (w->slots_cap - 1)];
+
+    if (offset == 0)
+      break;
+
+    if (string_length_at(w->strings, offset) == len
+     && memcmp(w->strings + offset + 4, data, len) == 0)
+      return offset;
+  }
+
+  size = align_up(4 + len + 1, 4);
+
+  if ((uint64_t) w->strings_size + size > UINT32_MAX) {
+    w->failed = true;
+    return 0;
+  }
+
+  offset = w->strings_size;
+  w->strings = grow(w->strings, &w->strings_cap, offset + size, 1);
+  memset(w->strings + offset, 0, size);
+  memcpy(w->strings + offset, &len32, 4);
+  memcpy(w->strings + offset + 4, data, len);
+
+  w->strings_size += size;
+  w->slots[h & (w->slots_cap - 1)] = offset;
+  w->num_strings++;
+
+  return offset;
+}
+
+static uint32_t
+put_string(struct writer *w, const InfraString *string)
+{
+  return string != NULL ? put_bytes(w, string->data, string->size) : 0;
+}
+
+static uint32_t
+put_node(struct writer *w, struct dom_node *node, uint32_t parent)
+{
+  uint32_t index = w->num_nodes;
+  DOMSnapNode *rec;
+
+  w->nodes = grow(w->nodes, &w->nodes_cap, index + 1, sizeof (*w->nodes));
+  w->num_nodes++;
+
+  rec = &w->nodes[index];
+  memset(rec, 0, sizeof (*rec));
+
+  rec->parent = parent;
+  rec->num_children = node->num_children;
+
+  if (DOM_IMPLEMENTS(node, element)) {
+    struct dom_element *element = (DOMAny *) node;
+
+    rec->kind = DOM_SNAP_ELEMENT;
+    rec->namespace = element->namespace;
+    rec->local_name = element->local_name;
+    rec->data = put_string(w, element->uninterned_local_name);
+
+    if (element->num_attrs != 0) {
+      rec->element.first_attr = w->num_attrs;
+      rec->element.num_attrs = element->num_attrs;
+
+      for (uint32_t i = 0; i < element->num_attrs; i++) {
+        const struct dom_attr_slot *attr = &element->attrs[i];
+        InfraString prefix = { 0 };
+        DOMSnapAttr *arec;
+
+        w->attrs = grow(w->attrs, &w->attrs_cap, w->num_attrs + 1,
+                        sizeof (*w->attrs));
+        arec = &w->attrs[w->num_attrs++];
+        memset(arec, 0, sizeof (*arec));
+
+        arec->local_name = put_string(w, attr->local_name);
+        arec->value = put_string(w, attr->value);
+        arec->namespace = attr->namespace;
+
+        if (attr->prefix != NULL) {
+          if (static_prefix(attr->prefix) == NULL)
+            w->failed = true;
+
+          prefix.data = (char *) attr->prefix;
+          prefix.size = strlen(attr->prefix);
+          arec->prefix = put_string(w, &prefix);
+        }
+      }
+    }
+  } else if (DOM_IMPLEMENTS(node, text) || DOM_IMPLEMENTS(node, comment)) {
+    size_t len;
+    const char *data = dom_character_data_get((DOMAny *) node, &len);
+
+    rec->kind = DOM_IMPLEMENTS(node, text) ? DOM_SNAP_TEXT : DOM_SNAP_COMMENT;
+    rec->data = put_bytes(w, data, len);
+  } else if (DOM_IMPLEMENTS(node, document_type)) {
+    struct dom_document_type *doctype = (DOMAny *) node;
+
+    rec->kind = DOM_SNAP_DOCUMENT_TYPE;
+    rec->data = put_string(w, doctype->name);
+    rec->doctype.public_id = put_string(w, doctype->public_id);
+    rec->doctype.system_id = put_string(w, doctype->system_id);
+  } else if (DOM_IMPLEMENTS(node, document_fragment)) {
+    rec->kind = DOM_SNAP_DOCUMENT_FRAGMENT;
+  } else if (DOM_IMPLEMENTS(node, document) && index == 0) {
+    rec->kind = DOM_SNAP_DOCUMENT;
+  } else {
+    w->failed = true;
+  }
+
+  return index;
+}
+
+struct write_frame {
+  struct dom_node *node;
+  struct dom_node *next_child;
+  uint32_t index;
+  uint32_t prev_child; /* DOM_SNAP_NONE before the first */
+  bool content_done;
+};
+
+static struct dom_node *
+template_contents(struct dom_node *node)
+{
+  if (!DOM_IMPLEMENTS(node, html_template_element))
+    return NULL;
+
+  return (struct dom_node *)
+    ((struct dom_html_template_element *) node)->template_contents;
+}
+
+/* Preorder, with a template's contents after its children */
+static void
+write_tree(struct writer *w, struct dom_document *document)
+{
+  struct write_frame *frames = NULL;
+  uint32_t depth = 0, frames_cap = 0;
+
+  frames = grow(frames, &frames_cap, 1, sizeof (*frames));
+  frames[depth++] = (struct write_frame) {
+    .node = (struct dom_node *) document,
+    .next_child = ((struct dom_node *) document)->first_child,
+    .index = put_node(w, (struct dom_node *) document, DOM_SNAP_NONE),
+  };
+
+  while (depth > 0) {
+    struct write_frame *frame = &frames[depth - 1];
+    struct dom_node *next = NULL;
+    uint32_t index = DOM_SNAP_NONE;
+
+    if (frame->next_child != NULL) {
+      next = frame->next_child;
+      frame->next_child = next->next_sibling;
+      index = put_node(w, next, frame->index);
+
+      if (frame->prev_child != DOM_SNAP_NONE)
+        w->nodes[frame->prev_child].next_sibling = index;
+      frame->prev_child = index;
+    } else if (!frame->content_done) {
+      frame->content_done = true;
+      next = template_contents(frame->node);
+
+      if (next != NULL) {
+        index = put_node(w, next, frame->index);
+        w->nodes[frame->index].content = index;
+      }
+    }
+
+    if (next != NULL) {
+      frames = grow(frames, &frames_cap, depth + 1, sizeof (*frames));
+      frames[depth++] = (struct write_frame) {
+        .node = next,
+        .next_child = next->first_child,
+        .index = index,
+      };
+    } else if (frame->content_done) {
+      w->nodes[frame->index].subtree_end = w->num_nodes;
+      depth--;
+    }
+  }
+
+  free(frames);
+}
+
+void *
+dom_snapshot_build(struct dom_document *document, size_t *len)
+{
+  struct writer w = { .strings_size = 4 };
+  struct snapshot_header header = {
+    .version = DOM_SNAPSHOT_VERSION,
+    .byte_order = k_snapshot_byte_order,
+    .node_size = sizeof (DOMSnapNode),
+    .attr_size = sizeof (DOMSnapAttr),
+    .num_html_tags = NUM_HTML_TAG,
+    .num_svg_tags = NUM_SVG_TAG,
+    .num_mathml_tags = NUM_MATHML_TAG,
+    .mode = document->mode,
+  };
+  size_t size;
+  char *image = NULL;
+
+  /* offset 0 stands for NULL */
+  w.strings = grow(w.strings, &w.strings_cap, 4, 1);
+  memset(w.strings, 0, 4);
+
+  write_tree(&w, document);
+
+  header.num_nodes = w.num_nodes;
+  header.num_attrs = w.num_attrs;
+  header.strings_size = w.strings_size;
+
+  size = align_up(sizeof (header), 8);
+  header.nodes_offset = size;
+  size = align_up(size + (size_t) w.num_nodes * sizeof (DOMSnapNode), 8);
+  header.attrs_offset = size;
+  size = align_up(size + (size_t) w.num_attrs * sizeof (DOMSnapAttr), 8);
+  header.strings_offset = size;
+  size += w.strings_size;
+
+  if (size > UINT32_MAX)
+    w.failed = true;
+
+  if (!w.failed) {
+    memcpy(header.magic, k_snapshot_magic, sizeof (header.magic));
+
+    if ((image = calloc(1, size)) == NULL)
+      abort();
+
+    memcpy(image, &header, sizeof (header));
+    memcpy(image + header.nodes_offset, w.nodes,
+           w.num_nodes * sizeof (DOMSnapNode));
+    if (w.num_attrs != 0)
+      memcpy(image + header.attrs_offset, w.attrs,
+             w.num_attrs * sizeof (DOMSnapAttr));
+    memcpy(image + header.strings_offset, w.strings, w.strings_size);
+
+    *len = size;
+  }
+
+  free(w.nodes);
+  free(w.attrs);
+  free(w.strings);
+  free(w.slots);
+
+  return image;
+}
+
+bool
+dom_snapshot_save(struct dom_document *document, const char *path)
+{
+  size_t len;
+  void *image = dom_snapshot_build(document, &len);
+  FILE *fp;
+  bool ok;
+
+  if (image == NULL)
+    return false;
+
+  if ((fp = fopen(path, "wb")) == NULL) {
+    free(image);
+    return false;
+  }
+
+  ok = fwrite(image, 1, len, fp) == len;
+  ok = fclose(fp) == 0 && ok;
+
+  free(image);
+  return ok;
+}
+
+/* END WRITER */
+
+/* START READER */
+
+static bool
+section_fits(size_t len, uint32_t offset, uint32_t count, size_t item_size)
+{
+  return offset <= len && (uint64_t) count * item_size <= len - offset;
+}
+
+DOMSnapshot *
+dom_snapshot_open(const void *data, size_t len)
+{
+  const struct snapshot_header *header = data;
+  DOMSnapshot *snapshot;
+
+  if (len < sizeof (*header) || (uintptr_t) data % 8 != 0)
+    return NULL;
+
+  if (memcmp(header->magic, k_snapshot_magic, sizeof (header->magic)) != 0
+   || header->version != DOM_SNAPSHOT_VERSION
+   || header->byte_order != k_snapshot_byte_order
+   || header->node_size != sizeof (DOMSnapNode)
+   || header->attr_size != sizeof (DOMSnapAttr)
+   || header->num_html_tags != NUM_HTML_TAG
+   || header->num_svg_tags != NUM_SVG_TAG
+   || header->num_mathml_tags != NUM_MATHML_TAG)
+    return NULL;
+
+  if (header->num_nodes == 0
+   || header->nodes_offset % 8 != 0 || header->attrs_offset % 8 != 0
+   || !section_fits(len, header->nodes_offset, header->num_nodes,
+                    sizeof (DOMSnapNode))
+   || !section_fits(len, header->attrs_offset, header->num_attrs,
+                    sizeof (DOMSnapAttr))
+   || !section_fits(len, header->strings_offset, header->strings_size, 1))
+    return NULL;
+
+  if ((snapshot = calloc(1, sizeof (*snapshot))) == NULL)
+    abort();
+
+  snapshot->header = header;
+  snapshot->nodes = (const void *) ((const char *) data + header->nodes_offset);
+  snapshot->attrs = (const void *) ((const char *) data + header->attrs_offset);
+  snapshot->strings = (const char *) data + header->strings_offset;
+
+  if (snapshot->nodes[0].kind != DOM_SNAP_DOCUMENT) {
+    free(snapshot);
+    return NULL;
+  }
+
+  return snapshot;
+}
+
+DOMSnapshot *
+dom_snapshot_map(const char *path)
+{
+  DOMSnapshot *snapshot;
+  struct stat st;
+  void *mapping;
+  int fd;
+
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return NULL;
+
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return NULL;
+  }
+
+  mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (mapping == MAP_FAILED)
+    return NULL;
+
+  if ((snapshot = dom_snapshot_open(mapping, st.st_size)) == NULL) {
+    munmap(mapping, st.st_size);
+    return NULL;
+  }
+
+  snapshot->mapping = mapping;
+  snapshot->mapping_len = st.st_size;
+
+  return snapshot;
+}
+
+void
+dom_snapshot_close(DOMSnapshot *snapshot)
+{
+  if (snapshot == NULL)
+    return;
+
+  if (snapshot->mapping != NULL)
+    munmap(snapshot->mapping, snapshot->mapping_len);
+
+  free(snapshot);
+}
+
+uint32_t
+dom_snapshot_num_nodes(const DOMSnapshot *snapshot)
+{
+  return snapshot->header->num_nodes;
+}
+
+enum DOMDocumentMode
+dom_snapshot_mode(const DOMSnapshot *snapshot)
+{
+  return snapshot->header->mode;
+}
+
+const DOMSnapNode *
+dom_snapshot_node(const DOMSnapshot *snapshot, uint32_t index)
+{
+  if (index >= snapshot->header->num_nodes)
+    return NULL;
+
+  return &snapshot->nodes[index];
+}
+
+const DOMSnapAttr *
+dom_snapshot_attrs(const DOMSnapshot *snapshot, const DOMSnapNode *node)
+{
+  if (node->kind != DOM_SNAP_ELEMENT || node->element.num_attrs == 0)
+    return NULL;
+
+  return &snapshot->attrs[node->element.first_attr];
+}
+
+const char *
+dom_snapshot_string(const DOMSnapshot *snapshot, uint32_t offset, size_t *len)
+{
+  if (offset == 0)
+    return NULL;
+
+  if (len != NULL)
+    *len = string_length_at(snapshot->strings, offset);
+
+  return snapshot->strings + offset + 4;
+}
+
+/* END READER */
+
+/* START MATERIALIZATION */
+
+/* Has an initial reference, like infra_string_create() */
+static InfraString *
+load_string(const DOMSnapshot *snapshot, uint32_t offset)
+{
+  InfraString *string;
+  const char *data;
+  size_t len;
+
+  if ((data = dom_snapshot_string(snapshot, offset, &len)) == NULL)
+    return NULL;
+
+  string = infra_string_create();
+  infra_string_append(string, data, len);
+
+  return string;
+}
+
+/* Names are atoms, as the parser makes them */
+static InfraAtom *
+load_atom(const DOMSnapshot *snapshot, uint32_t offset)
+{
+  const char *data;
+  size_t len;
+
+  if ((data = dom_snapshot_string(snapshot, offset, &len)) == NULL)
+    return NULL;
+
+  return infra_atom_intern(data, len);
+}
+
+static void
+load_attrs(const DOMSnapshot *snapshot, struct dom_element *element,
+           const DOMSnapNode *rec)
+{
+  const DOMSnapAttr *arecs = dom_snapshot_attrs(snapshot, rec);
+
+  if (arecs == NULL)
+    return;
+
+  dom_element_reserve_attributes(element, rec->element.num_attrs);
+
+  for (uint32_t i = 0; i < rec->element.num_attrs; i++) {
+    const char *prefix = dom_snapshot_string(snapshot, arecs[i].prefix, NULL);
+    InfraString *value = load_string(snapshot, arecs[i].value);
+
+    dom_element_append_attribute(element,
+                                 load_atom(snapshot, arecs[i].local_name), value,
+                                 arecs[i].namespace,
+                                 prefix != NULL ? static_prefix(prefix) : NULL);
+    infra_string_unref(value);
+  }
+}
+
+static struct dom_node *
+load_node(const DOMSnapshot *snapshot, struct dom_document *document,
+          const DOMSnapNode *rec)
+{
+  struct dom_node *node;
+
+  switch (rec->kind) {
+    case DOM_SNAP_ELEMENT:
+      if (rec->local_name != 0)
+        node = (struct dom_node *) dom_create_element_interned(document,
+          rec->local_name, rec->namespace, NULL, NULL, false);
+      else
+        node = (struct dom_node *) dom_create_element(document,
+          load_atom(snapshot, rec->data), rec->namespace, NULL, NULL, false);
+
+      load_attrs(snapshot, (struct dom_element *) node, rec);
+      return node;
+
+    case DOM_SNAP_TEXT:
+    case DOM_SNAP_COMMENT:
+      node = rec->kind == DOM_SNAP_TEXT ? DOM_NEW_OBJECT( text )
+                                        : DOM_NEW_OBJECT( comment );
+      ((struct dom_character_data *) node)->data =
+        load_string(snapshot, rec->data);
+      break;
+
+    case DOM_SNAP_DOCUMENT_TYPE: {
+      struct dom_document_type *doctype = DOM_NEW_OBJECT( document_type );
+
+      doctype->name      = load_string(snapshot, rec->data);
+      doctype->public_id = load_string(snapshot, rec->doctype.public_id);
+      doctype->system_id = load_string(snapshot, rec->doctype.system_id);
+      node = (struct dom_node *) doctype;
+      break;
+    }
+
+    case DOM_SNAP_DOCUMENT_FRAGMENT:
+      node = DOM_NEW_OBJECT( document_fragment );
+      break;
+
+    default:
+      abort();
+  }
+
+  node->node_document = dom_weak_ref_object(document);
+
+  return node;
+}
+
+struct load_frame {
+  struct dom_node *node;
+  uint32_t index;
+  uint32_t end;
+};
+
+struct dom_node *
+dom_snapshot_materialize(const DOMSnapshot *snapshot,
+                         struct dom_document *document, uint32_t index)
+{
+  InfraArena *previous = infra_arena_enter(document->arena);
+  const DOMSnapNode *root = dom_snapshot_node(snapshot, index);
+  struct load_frame *frames = NULL;
+  uint32_t depth = 0, frames_cap = 0;
+  struct dom_node *result;
+
+  if (root == NULL)
+    abort();
+
+  if (index == 0) {
+    result = (struct dom_node *) document;
+    document->mode = dom_snapshot_mode(snapshot);
+  } else {
+    result = load_node(snapshot, document, root);
+  }
+
+  frames = grow(frames, &frames_cap, 1, sizeof (*frames));
+  frames[depth++] = (struct load_frame) { result, index, root->subtree_end };
+
+  for (uint32_t i = index + 1; i < root->subtree_end; i++) {
+    const DOMSnapNode *rec = &snapshot->nodes[i];
+    struct dom_node *parent, *node;
+
+    while (frames[depth - 1].end <= i)
+      depth--;
+
+    parent = frames[depth - 1].node;
+
+    if (rec->parent != frames[depth - 1].index)
+      abort();
+
+    node = load_node(snapshot, document, rec);
+
+    if (snapshot->nodes[rec->parent].content == i) {
+      struct dom_html_template_element *template = (DOMAny *) parent;
+      struct dom_document_fragment *fragment = (DOMAny *) node;
+
+      if (!DOM_IMPLEMENTS(parent, html_template_element))
+        abort();
+
+      /* see html_template_element_traverse() */
+      template->template_contents = dom_strong_ref_object(fragment);
+      fragment->host = dom_strong_ref_object(template);
+    } else {
+      dom_append_node(parent, node);
+    }
+
+    if (rec->subtree_end > i + 1) {
+      frames = grow(frames, &frames_cap, depth + 1, sizeof (*frames));
+      frames[depth++] = (struct load_frame) { node, i, rec->subtree_end };
+    }
+  }
+
+  free(frames);
+  infra_arena_leave(previous);
+
+  return result;
+}
+
+/* END MATERIALIZATION */
@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <wfs/dom.h>
+#include <wfs/dom_trace.h>
+
+/* Comfortably more than the number of interfaces in the library */
+#define TRACE_TABLE_SIZE 1024
+
+struct trace_slot {
+  const DOMInterface *interface;
+  DOMTraceStats stats;
+};
+
+static struct trace_slot trace_table[TRACE_TABLE_SIZE];
+
+static struct {
+  DOMTraceRecord *records;
+  size_t capacity;
+  size_t next;
+  size_t count;
+} trace_ring;
+
+static const char *k_trace_event_names[NUM_DOM_TRACE_EVENTS] = {
+  [DOM_TRACE_ALLOC] = "alloc",
+  [DOM_TRACE_FREE]  = "free",
+  [DOM_TRACE_REF]   = "ref",
+  [DOM_TRACE_UNREF] = "unref",
+};
+
+static struct trace_slot *
+find_slot(const DOMInterface *interface, bool create)
+{
+  size_t i = ((uintptr_t) interface >> 4) & (TRACE_TABLE_SIZE - 1);
+
+  for (size_t n = 0; n < TRACE_TABLE_SIZE; n++) {
+    struct trace_slot *slot = &trace_table[i];
+
+    if (slot->interface == interface)
+      return slot;
+
+    if (slot->interface == NULL) {
+      if (!create)
+        return NULL;
+
+      slot->interface = interface;
+      return slot;
+    }
+
+    i = (i + 1) & (TRACE_TABLE_SIZE - 1);
+  }
+
+  return NULL;
+}
+
+void
+dom_trace_event(enum DOMTraceEvent event, const void *object,
+                const DOMInterface *interface, int_least32_t strong_refcnt)
+{
+  struct trace_slot *slot = find_slot(interface, true);
+
+  if (slot != NULL) {
+    DOMTraceStats *stats = &slot->stats;
+
+    switch (event) {
+      case DOM_TRACE_ALLOC:
+        stats->allocs++;
+        if (++stats->live > stats->peak_live)
+          stats->peak_live = stats->live;
+        break;
+
+      case DOM_TRACE_FREE:
+        stats->frees++;
+        if (stats->live > 0) /* allocated before a dom_trace_reset() */
+          stats->live--;
+        break;
+
+      case DOM_TRACE_REF:
+        stats->refs++;
+        break;
+
+      case DOM_TRACE_UNREF:
+        stats->unrefs++;
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  if (trace_ring.capacity != 0) {
+    trace_ring.records[trace_ring.next] = (DOMTraceRecord) {
+      .interface     = interface,
+      .object        = object,
+      .strong_refcnt = strong_refcnt,
+      .event         = event,
+    };
+
+    trace_ring.next = (trace_ring.next + 1) % trace_ring.capacity;
+    if (trace_ring.count < trace_ring.capacity)
+      trace_ring.count++;
+  }
+}
+
+bool
+dom_trace_get_stats(const DOMInterface *interface, DOMTraceStats *stats)
+{
+  struct trace_slot *slot = find_slot(interface, false);
+
+  if (slot == NULL)
+    return false;
+
+  *stats = slot->stats;
+  return true;
+}
+
+void
+dom_trace_foreach_stats(void (*cb) (const DOMInterface *interface,
+                                    const DOMTraceStats *stats,
+                                    void *user_data),
+                        void *user_data)
+{
+  for (size_t i = 0; i < TRACE_TABLE_SIZE; i++)
+    if (trace_table[i].interface != NULL)
+      cb(trace_table[i].interface, &trace_table[i].stats, user_data);
+}
+
+void
+dom_trace_reset(void)
+{
+  memset(trace_table, 0, sizeof (trace_table));
+  trace_ring.next  = 0;
+  trace_ring.count = 0;
+}
+
+void
+dom_trace_ring_start(size_t capacity)
+{
+  free(trace_ring.records);
+
+  trace_ring.records  = capacity != 0
+                      ? malloc(capacity * sizeof (*trace_ring.records))
+                      : NULL;
+  trace_ring.capacity = capacity;
+  trace_ring.next     = 0;
+  trace_ring.count    = 0;
+}
+
+static inline const DOMTraceRecord *
+ring_record(size_t i)
+{
+  size_t first = trace_ring.next + trace_ring.capacity - trace_ring.count;
+
+  return &trace_ring.records[(first + i) % trace_ring.capacity];
+}
+
+/* Oldest first */
+size_t
+dom_trace_ring_read(DOMTraceRecord *records, size_t max)
+{
+  size_t n = trace_ring.count < max ? trace_ring.count : max;
+
+  for (size_t i = 0; i < n; i++)
+    records[i] = *ring_record(i);
+
+  return n;
+}
+
+static void
+dump_stats_cb(const DOMInterface *interface, const DOMTraceStats *stats,
+              void *user_data)
+{
+  fprintf(user_data,
+   "%-32s allocs=%"PRIu64" frees=%"PRIu64" live=%"PRIu64" peak=%"PRIu64
+   " refs=%"PRIu64" unrefs=%"PRIu64"\n",
+   interface->name, stats->allocs, stats->frees, stats->live,
+   stats->peak_live, stats->refs, stats->unrefs);
+}
+
+void
+dom_trace_dump_stats(FILE *fp)
+{
+  dom_trace_foreach_stats(dump_stats_cb, fp);
+}
+
+void
+dom_trace_dump_ring(FILE *fp)
+{
+  for (size_t i = 0; i < trace_ring.count; i++) {
+    const DOMTraceRecord *r = ring_record(i);
+
+    fprintf(fp, "%-5s %-32s %p strong=%"PRIdLEAST32"\n",
+     k_trace_event_names[r->event], r->interface->name, r->object,
+     r->strong_refcnt);
+  }
+}
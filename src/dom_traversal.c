@@ -0,0 +1,377 @@
+#include <wfs/dom_traversal.h>
+
+enum DOMFilterResult
+dom_filter_node(const DOMNodeFilter *filter, struct dom_node *node)
+{
+  enum DOMNodeType type = dom_node_type(node);
+
+  if ((filter->what_to_show & (1u << (type - 1))) == 0)
+    return DOM_FILTER_SKIP;
+
+  if (filter->local_name != 0 && type == DOM_ELEMENT_NODE) {
+    struct dom_element *element = (DOMAny *) node;
+
+    if (element->local_name != filter->local_name
+     || element->namespace != filter->namespace)
+      return DOM_FILTER_SKIP;
+  }
+
+  if (filter->accept != NULL)
+    return filter->accept(node, filter->user_data);
+
+  return DOM_FILTER_ACCEPT;
+}
+
+/* START NODE ITERATOR */
+
+static struct dom_document *
+document_of(struct dom_node *node)
+{
+  if (DOM_IMPLEMENTS(node, document))
+    return (struct dom_document *) node;
+
+  return node->node_document;
+}
+
+void
+dom_node_iterator_init(DOMNodeIterator *iterator, struct dom_node *root,
+                       const DOMNodeFilter *filter)
+{
+  *iterator = (DOMNodeIterator) {
+    .root = root,
+    .reference = root,
+    .pointer_before_reference = true,
+    .filter = *filter,
+    .document = document_of(root),
+  };
+
+  /* readers of a frozen document must not write to it, nor can it change */
+  if (iterator->document != NULL && dom_is_frozen(root))
+    iterator->document = NULL;
+
+  if (iterator->document != NULL) {
+    iterator->next = iterator->document->node_iterators;
+    if (iterator->next != NULL)
+      iterator->next->prev = iterator;
+    iterator->document->node_iterators = iterator;
+  }
+}
+
+void
+dom_node_iterator_detach(DOMNodeIterator *iterator)
+{
+  if (iterator->document == NULL)
+    return;
+
+  if (iterator->prev != NULL)
+    iterator->prev->next = iterator->next;
+  else
+    iterator->document->node_iterators = iterator->next;
+
+  if (iterator->next != NULL)
+    iterator->next->prev = iterator->prev;
+
+  iterator->document = NULL;
+  iterator->prev = NULL;
+  iterator->next = NULL;
+}
+
+/* 6.1 "traverse" */
+static struct dom_node *
+iterator_traverse(DOMNodeIterator *iterator, bool next)
+{
+  struct dom_node *node = iterator->reference;
+  bool before = iterator->pointer_before_reference;
+
+  for (;;) {
+    if (next) {
+      if (!before && (node = dom_next_preorder(node, iterator->root)) == NULL)
+        return NULL;
+      before = false;
+    } else {
+      if (before && (node = dom_prev_preorder(node, iterator->root)) == NULL)
+        return NULL;
+      before = true;
+    }
+
+    if (dom_filter_node(&iterator->filter, node) == DOM_FILTER_ACCEPT)
+      break;
+  }
+
+  iterator->reference = node;
+  iterator->pointer_before_reference = before;
+
+  return node;
+}
+
+struct dom_node *
+dom_node_iterator_next(DOMNodeIterator *iterator)
+{
+  return iterator_traverse(iterator, true);
+}
+
+struct dom_node *
+dom_node_iterator_previous(DOMNodeIterator *iterator)
+{
+  return iterator_traverse(iterator, false);
+}
+
+static bool
+is_inclusive_ancestor(const struct dom_node *ancestor, const struct dom_node *node)
+{
+  for (; node != NULL; node = node->parent)
+    if (node == ancestor)
+      return true;
+
+  return false;
+}
+
+/* 6.1 "NodeIterator pre-removing steps", for every live iterator */
+void
+dom_node_iterators_pre_remove(struct dom_document *document,
+                              struct dom_node *node)
+{
+  for (DOMNodeIterator *it = document->node_iterators; it != NULL; it = it->next) {
+    struct dom_node *prev;
+
+    if (node == it->root || !is_inclusive_ancestor(node, it->reference))
+      continue;
+
+    if (it->pointer_before_reference) {
+      struct dom_node *next = dom_next_preorder_skipping_children(node, it->root);
+
+      if (next != NULL) {
+        it->reference = next;
+        continue;
+      }
+
+      it->pointer_before_reference = false;
+    }
+
+    if ((prev = node->prev_sibling) == NULL) {
+      it->reference = node->parent;
+      continue;
+    }
+
+    while (prev->last_child != NULL)
+      prev = prev->last_child;
+
+    it->reference = prev;
+  }
+}
+
+/* END NODE ITERATOR */
+
+/* START TREE WALKER */
+
+void
+dom_tree_walker_init(DOMTreeWalker *walker, struct dom_node *root,
+                     const DOMNodeFilter *filter)
+{
+  *walker = (DOMTreeWalker) {
+    .root = root,
+    .current = root,
+    .filter = *filter,
+  };
+}
+
+static inline enum DOMFilterResult
+walker_filter(DOMTreeWalker *walker, struct dom_node *node)
+{
+  return dom_filter_node(&walker->filter, node);
+}
+
+struct dom_node *
+dom_tree_walker_parent_node(DOMTreeWalker *walker)
+{
+  struct dom_node *node = walker->current;
+
+  while (node != NULL && node != walker->root) {
+    node = node->parent;
+
+    if (node != NULL && walker_filter(walker, node) == DOM_FILTER_ACCEPT)
+      return walker->current = node;
+  }
+
+  return NULL;
+}
+
+/* 6.2 "traverse children" */
+static struct dom_node *
+walker_traverse_children(DOMTreeWalker *walker, bool first)
+{
+  struct dom_node *node = first ? walker->current->first_child
+                                : walker->current->last_child;
+
+  while (node != NULL) {
+    enum DOMFilterResult result = walker_filter(walker, node);
+
+    if (result == DOM_FILTER_ACCEPT)
+      return walker->current = node;
+
+    if (result == DOM_FILTER_SKIP) {
+      struct dom_node *child = first ? node->first_child : node->last_child;
+
+      if (child != NULL) {
+        node = child;
+        continue;
+      }
+    }
+
+    while (node != NULL) {
+      struct dom_node *sibling = first ? node->next_sibling : node->prev_sibling;
+      struct dom_node *parent;
+
+      if (sibling != NULL) {
+        node = sibling;
+        break;
+      }
+
+      parent = node->parent;
+
+      if (parent == NULL || parent == walker->root || parent == walker->current)
+        return NULL;
+
+      node = parent;
+    }
+  }
+
+  return NULL;
+}
+
+struct dom_node *
+dom_tree_walker_first_child(DOMTreeWalker *walker)
+{
+  return walker_traverse_children(walker, true);
+}
+
+struct dom_node *
+dom_tree_walker_last_child(DOMTreeWalker *walker)
+{
+  return walker_traverse_children(walker, false);
+}
+
+/* 6.2 "traverse siblings" */
+static struct dom_node *
+walker_traverse_siblings(DOMTreeWalker *walker, bool next)
+{
+  struct dom_node *node = walker->current;
+
+  if (node == walker->root)
+    return NULL;
+
+  for (;;) {
+    struct dom_node *sibling = next ? node->next_sibling : node->prev_sibling;
+
+    while (sibling != NULL) {
+      enum DOMFilterResult result;
+
+      node = sibling;
+      result = walker_filter(walker, node);
+
+      if (result == DOM_FILTER_ACCEPT)
+        return walker->current = node;
+
+      sibling = next ? node->first_child : node->last_child;
+
+      if (result == DOM_FILTER_REJECT || sibling == NULL)
+        sibling = next ? node->next_sibling : node->prev_sibling;
+    }
+
+    node = node->parent;
+
+    if (node == NULL || node == walker->root)
+      return NULL;
+
+    if (walker_filter(walker, node) == DOM_FILTER_ACCEPT)
+      return NULL;
+  }
+}
+
+struct dom_node *
+dom_tree_walker_previous_sibling(DOMTreeWalker *walker)
+{
+  return walker_traverse_siblings(walker, false);
+}
+
+struct dom_node *
+dom_tree_walker_next_sibling(DOMTreeWalker *walker)
+{
+  return walker_traverse_siblings(walker, true);
+}
+
+struct dom_node *
+dom_tree_walker_previous_node(DOMTreeWalker *walker)
+{
+  struct dom_node *node = walker->current;
+
+  while (node != walker->root) {
+    struct dom_node *sibling = node->prev_sibling;
+
+    while (sibling != NULL) {
+      enum DOMFilterResult result;
+
+      node = sibling;
+      result = walker_filter(walker, node);
+
+      while (result != DOM_FILTER_REJECT && node->last_child != NULL) {
+        node = node->last_child;
+        result = walker_filter(walker, node);
+      }
+
+      if (result == DOM_FILTER_ACCEPT)
+        return walker->current = node;
+
+      sibling = node->prev_sibling;
+    }
+
+    if (node == walker->root || node->parent == NULL)
+      return NULL;
+
+    node = node->parent;
+
+    if (walker_filter(walker, node) == DOM_FILTER_ACCEPT)
+      return walker->current = node;
+  }
+
+  return NULL;
+}
+
+struct dom_node *
+dom_tree_walker_next_node(DOMTreeWalker *walker)
+{
+  struct dom_node *node = walker->current;
+  enum DOMFilterResult result = DOM_FILTER_ACCEPT;
+
+  for (;;) {
+    struct dom_node *temp;
+
+    while (result != DOM_FILTER_REJECT && node->first_child != NULL) {
+      node = node->first_child;
+      result = walker_filter(walker, node);
+
+      if (result == DOM_FILTER_ACCEPT)
+        return walker->current = node;
+    }
+
+    for (temp = node; temp != NULL; temp = temp->parent) {
+      if (temp == walker->root)
+        return NULL;
+
+      if (temp->next_sibling != NULL) {
+        node = temp->next_sibling;
+        break;
+      }
+    }
+
+    if (temp == NULL)
+      return NULL;
+
+    result = walker_filter(walker, node);
+
+    if (result == DOM_FILTER_ACCEPT)
+      return walker->current = node;
+  }
+}
+
+/* END TREE WALKER */
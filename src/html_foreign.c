@@ -0,0 +1,277 @@
+#include <threads.h>
+
+#include <wfs/html_foreign.h>
+
+#include "phash.h"
+
+const char *k_svg_tag_names[NUM_SVG_TAG] = {
+  [SVG_TAG_A]                   = "a",
+  [SVG_TAG_ALTGLYPH]            = "altGlyph",
+  [SVG_TAG_ALTGLYPHDEF]         = "altGlyphDef",
+  [SVG_TAG_ALTGLYPHITEM]        = "altGlyphItem",
+  [SVG_TAG_ANIMATE]             = "animate",
+  [SVG_TAG_ANIMATECOLOR]        = "animateColor",
+  [SVG_TAG_ANIMATEMOTION]       = "animateMotion",
+  [SVG_TAG_ANIMATETRANSFORM]    = "animateTransform",
+  [SVG_TAG_CIRCLE]              = "circle",
+  [SVG_TAG_CLIPPATH]            = "clipPath",
+  [SVG_TAG_DEFS]                = "defs",
+  [SVG_TAG_DESC]                = "desc",
+  [SVG_TAG_DISCARD]             = "discard",
+  [SVG_TAG_ELLIPSE]             = "ellipse",
+  [SVG_TAG_FEBLEND]             = "feBlend",
+  [SVG_TAG_FECOLORMATRIX]       = "feColorMatrix",
+  [SVG_TAG_FECOMPONENTTRANSFER] = "feComponentTransfer",
+  [SVG_TAG_FECOMPOSITE]         = "feComposite",
+  [SVG_TAG_FECONVOLVEMATRIX]    = "feConvolveMatrix",
+  [SVG_TAG_FEDIFFUSELIGHTING]   = "feDiffuseLighting",
+  [SVG_TAG_FEDISPLACEMENTMAP]   = "feDisplacementMap",
+  [SVG_TAG_FEDISTANTLIGHT]      = "feDistantLight",
+  [SVG_TAG_FEDROPSHADOW]        = "feDropShadow",
+  [SVG_TAG_FEFLOOD]             = "feFlood",
+  [SVG_TAG_FEFUNCA]             = "feFuncA",
+  [SVG_TAG_FEFUNCB]             = "feFuncB",
+  [SVG_TAG_FEFUNCG]             = "feFuncG",
+  [SVG_TAG_FEFUNCR]             = "feFuncR",
+  [SVG_TAG_FEGAUSSIANBLUR]      = "feGaussianBlur",
+  [SVG_TAG_FEIMAGE]             = "feImage",
+  [SVG_TAG_FEMERGE]             = "feMerge",
+  [SVG_TAG_FEMERGENODE]         = "feMergeNode",
+  [SVG_TAG_FEMORPHOLOGY]        = "feMorphology",
+  [SVG_TAG_FEOFFSET]            = "feOffset",
+  [SVG_TAG_FEPOINTLIGHT]        = "fePointLight",
+  [SVG_TAG_FESPECULARLIGHTING]  = "feSpecularLighting",
+  [SVG_TAG_FESPOTLIGHT]         = "feSpotLight",
+  [SVG_TAG_FETILE]              = "feTile",
+  [SVG_TAG_FETURBULENCE]        = "feTurbulence",
+  [SVG_TAG_FILTER]              = "filter",
+  [SVG_TAG_FOREIGNOBJECT]       = "foreignObject",
+  [SVG_TAG_G]                   = "g",
+  [SVG_TAG_GLYPHREF]            = "glyphRef",
+  [SVG_TAG_IMAGE]               = "image",
+  [SVG_TAG_LINE]                = "line",
+  [SVG_TAG_LINEARGRADIENT]      = "linearGradient",
+  [SVG_TAG_MARKER]              = "marker",
+  [SVG_TAG_MASK]                = "mask",
+  [SVG_TAG_METADATA]            = "metadata",
+  [SVG_TAG_MPATH]               = "mpath",
+  [SVG_TAG_PATH]                = "path",
+  [SVG_TAG_PATTERN]             = "pattern",
+  [SVG_TAG_POLYGON]             = "polygon",
+  [SVG_TAG_POLYLINE]            = "polyline",
+  [SVG_TAG_RADIALGRADIENT]      = "radialGradient",
+  [SVG_TAG_RECT]                = "rect",
+  [SVG_TAG_SCRIPT]              = "script",
+  [SVG_TAG_SET]                 = "set",
+  [SVG_TAG_STOP]                = "stop",
+  [SVG_TAG_STYLE]               = "style",
+  [SVG_TAG_SVG]                 = "svg",
+  [SVG_TAG_SWITCH]              = "switch",
+  [SVG_TAG_SYMBOL]              = "symbol",
+  [SVG_TAG_TEXT]                = "text",
+  [SVG_TAG_TEXTPATH]            = "textPath",
+  [SVG_TAG_TITLE]               = "title",
+  [SVG_TAG_TSPAN]               = "tspan",
+  [SVG_TAG_USE]                 = "use",
+  [SVG_TAG_VIEW]                = "view",
+};
+
+const char *k_mathml_tag_names[NUM_MATHML_TAG] = {
+  [MATHML_TAG_ANNOTATION]     = "annotation",
+  [MATHML_TAG_ANNOTATION_XML] = "annotation-xml",
+  [MATHML_TAG_MACTION]        = "maction",
+  [MATHML_TAG_MALIGNMARK]     = "malignmark",
+  [MATHML_TAG_MATH]           = "math",
+  [MATHML_TAG_MERROR]         = "merror",
+  [MATHML_TAG_MFRAC]          = "mfrac",
+  [MATHML_TAG_MGLYPH]         = "mglyph",
+  [MATHML_TAG_MI]             = "mi",
+  [MATHML_TAG_MMULTISCRIPTS]  = "mmultiscripts",
+  [MATHML_TAG_MN]             = "mn",
+  [MATHML_TAG_MO]             = "mo",
+  [MATHML_TAG_MOVER]          = "mover",
+  [MATHML_TAG_MPADDED]        = "mpadded",
+  [MATHML_TAG_MPHANTOM]       = "mphantom",
+  [MATHML_TAG_MPRESCRIPTS]    = "mprescripts",
+  [MATHML_TAG_MROOT]          = "mroot",
+  [MATHML_TAG_MROW]           = "mrow",
+  [MATHML_TAG_MS]             = "ms",
+  [MATHML_TAG_MSPACE]         = "mspace",
+  [MATHML_TAG_MSQRT]          = "msqrt",
+  [MATHML_TAG_MSTYLE]         = "mstyle",
+  [MATHML_TAG_MSUB]           = "msub",
+  [MATHML_TAG_MSUBSUP]        = "msubsup",
+  [MATHML_TAG_MSUP]           = "msup",
+  [MATHML_TAG_MTABLE]         = "mtable",
+  [MATHML_TAG_MTD]            = "mtd",
+  [MATHML_TAG_MTEXT]          = "mtext",
+  [MATHML_TAG_MTR]            = "mtr",
+  [MATHML_TAG_MUNDER]         = "munder",
+  [MATHML_TAG_MUNDEROVER]     = "munderover",
+  [MATHML_TAG_NONE]           = "none",
+  [MATHML_TAG_SEMANTICS]      = "semantics",
+};
+
+/* adjust SVG attributes; entry 0 is unused */
+static const char *k_svg_attr_names[] = {
+  NULL,
+  "attributeName",
+  "attributeType",
+  "baseFrequency",
+  "baseProfile",
+  "calcMode",
+  "clipPathUnits",
+  "diffuseConstant",
+  "edgeMode",
+  "filterUnits",
+  "glyphRef",
+  "gradientTransform",
+  "gradientUnits",
+  "kernelMatrix",
+  "kernelUnitLength",
+  "keyPoints",
+  "keySplines",
+  "keyTimes",
+  "lengthAdjust",
+  "limitingConeAngle",
+  "markerHeight",
+  "markerUnits",
+  "markerWidth",
+  "maskContentUnits",
+  "maskUnits",
+  "numOctaves",
+  "pathLength",
+  "patternContentUnits",
+  "patternTransform",
+  "patternUnits",
+  "pointsAtX",
+  "pointsAtY",
+  "pointsAtZ",
+  "preserveAlpha",
+  "preserveAspectRatio",
+  "primitiveUnits",
+  "refX",
+  "refY",
+  "repeatCount",
+  "repeatDur",
+  "requiredExtensions",
+  "requiredFeatures",
+  "specularConstant",
+  "specularExponent",
+  "spreadMethod",
+  "startOffset",
+  "stdDeviation",
+  "stitchTiles",
+  "surfaceScale",
+  "systemLanguage",
+  "tableValues",
+  "targetX",
+  "targetY",
+  "textLength",
+  "viewBox",
+  "viewTarget",
+  "xChannelSelector",
+  "yChannelSelector",
+  "zoomAndPan",
+};
+
+/* adjust MathML attributes */
+static const char *k_mathml_attr_names[] = {
+  NULL,
+  "definitionURL",
+};
+
+/* adjust foreign attributes; keys and results are parallel */
+static const char *k_foreign_attr_names[] = {
+  NULL,
+  "xlink:actuate",
+  "xlink:arcrole",
+  "xlink:href",
+  "xlink:role",
+  "xlink:show",
+  "xlink:title",
+  "xlink:type",
+  "xml:lang",
+  "xml:space",
+  "xmlns",
+  "xmlns:xlink",
+};
+
+static const HTMLForeignAttr k_foreign_attrs[] = {
+  { 0 },
+  { "xlink", "actuate", INFRA_NAMESPACE_XLINK },
+  { "xlink", "arcrole", INFRA_NAMESPACE_XLINK },
+  { "xlink", "href",    INFRA_NAMESPACE_XLINK },
+  { "xlink", "role",    INFRA_NAMESPACE_XLINK },
+  { "xlink", "show",    INFRA_NAMESPACE_XLINK },
+  { "xlink", "title",   INFRA_NAMESPACE_XLINK },
+  { "xlink", "type",    INFRA_NAMESPACE_XLINK },
+  { "xml",   "lang",    INFRA_NAMESPACE_XML   },
+  { "xml",   "space",   INFRA_NAMESPACE_XML   },
+  { NULL,    "xmlns",   INFRA_NAMESPACE_XMLNS },
+  { "xmlns", "xlink",   INFRA_NAMESPACE_XMLNS },
+};
+
+#define COUNTOF(a) (sizeof ((a)) / sizeof ((a)[0]))
+
+static struct phash svg_tag_table =
+  PHASH_INIT(k_svg_tag_names, _SVG_TAG_FIRST, NUM_SVG_TAG);
+static struct phash mathml_tag_table =
+  PHASH_INIT(k_mathml_tag_names, _MATHML_TAG_FIRST, NUM_MATHML_TAG);
+static struct phash svg_attr_table =
+  PHASH_INIT(k_svg_attr_names, 1, COUNTOF(k_svg_attr_names));
+static struct phash mathml_attr_table =
+  PHASH_INIT(k_mathml_attr_names, 1, COUNTOF(k_mathml_attr_names));
+static struct phash foreign_attr_table =
+  PHASH_INIT(k_foreign_attr_names, 1, COUNTOF(k_foreign_attr_names));
+
+static once_flag tables_once = ONCE_FLAG_INIT;
+
+static void
+build_tables(void)
+{
+  phash_build(&svg_tag_table);
+  phash_build(&mathml_tag_table);
+  phash_build(&svg_attr_table);
+  phash_build(&mathml_attr_table);
+  phash_build(&foreign_attr_table);
+}
+
+uint16_t
+html_svg_tag_lookup(const char *name, size_t len)
+{
+  call_once(&tables_once, build_tables);
+  return phash_lookup(&svg_tag_table, name, len);
+}
+
+uint16_t
+html_mathml_tag_lookup(const char *name, size_t len)
+{
+  call_once(&tables_once, build_tables);
+  return phash_lookup(&mathml_tag_table, name, len);
+}
+
+const char *
+html_adjust_svg_attr(const char *name, size_t len)
+{
+  call_once(&tables_once, build_tables);
+  return k_svg_attr_names[phash_lookup(&svg_attr_table, name, len)];
+}
+
+const char *
+html_adjust_mathml_attr(const char *name, size_t len)
+{
+  call_once(&tables_once, build_tables);
+  return k_mathml_attr_names[phash_lookup(&mathml_attr_table, name, len)];
+}
+
+const HTMLForeignAttr *
+html_adjust_foreign_attr(const char *name, size_t len)
+{
+  uint16_t v;
+
+  call_once(&tables_once, build_tables);
+  v = phash_lookup(&foreign_attr_table, name, len);
+
+  return v != 0 ? &k_foreign_attrs[v] : NULL;
+}
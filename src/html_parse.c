@@ -17,18 +17,25 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <threads.h>
+#include <time.h>
 #include <grapheme.h>
 
 #include <wfs/dom.h>
 #include <wfs/dom_core.h>
+#include <wfs/dom_mutation.h>
 #include <wfs/html_tags.h>
+#include <wfs/html_foreign.h>
 #include <wfs/html.h>
 
+#include <wfs/infra_atom.h>
 #include <wfs/infra_string.h>
 #include <wfs/infra_stack.h>
 #include <wfs/infra_namespace.h>
 
+#include "html_quirks.h"
 #include "unicode.h"
 
 struct tokenizer;
@@ -48,6 +55,7 @@ enum token_type {
   TOKEN_EOF,
 };
 
+/* Names are atoms once the token is emitted */
 struct tag {
   InfraString *tagname;
   InfraStack *attrs;
@@ -66,6 +74,10 @@ enum {
 struct attr {
   InfraString *name;
   InfraString *value;
+
+  /* set by adjust_foreign_attrs() */
+  enum InfraNamespace namespace;
+  const char *prefix;
 };
 
 struct doctype {
@@ -78,6 +90,34 @@ struct doctype {
   bool force_quirks : 1;
 };
 
+/* Names the tree builder compares against; see intern_atoms() */
+enum {
+  ATOM_COLOR,
+  ATOM_ENCODING,
+  ATOM_FACE,
+  ATOM_HTML,
+  ATOM_IMAGE,
+  ATOM_MATH,
+  ATOM_SIZE,
+  ATOM_SVG,
+
+  NUM_ATOMS
+};
+
+static const char *k_atom_names[NUM_ATOMS] = {
+  [ATOM_COLOR]    = "color",
+  [ATOM_ENCODING] = "encoding",
+  [ATOM_FACE]     = "face",
+  [ATOM_HTML]     = "html",
+  [ATOM_IMAGE]    = "image",
+  [ATOM_MATH]     = "math",
+  [ATOM_SIZE]     = "size",
+  [ATOM_SVG]      = "svg",
+};
+
+static InfraAtom *atoms[NUM_ATOMS];
+static once_flag atoms_once = ONCE_FLAG_INIT;
+
 union token_data {
   struct tag      tag;
   struct doctype  doctype;
@@ -180,6 +220,7 @@ struct tokenizer {
   struct {
     const char *p;
     const char *end;
+    const char *c_start; /* of the last tokenizer_getc() */
   } input;
 
   struct treebuilder *treebuilder;
@@ -189,11 +230,14 @@ struct tokenizer {
   struct tag *tag;
   struct attr *attr;
   InfraString *comment;
+  const char *comment_start; /* where its data would be in the input */
   struct doctype doctype;
   enum token_type tag_type;
 
   enum tokenizer_state state;
   enum tokenizer_state ret_state;
+
+  size_t ntokens; /* emitted so far, for yield budgets */
 };
 
 enum tokenizer_status {
@@ -201,6 +245,7 @@ enum tokenizer_status {
   TOKENIZER_STATUS_OK,
   TOKENIZER_STATUS_IGNORE,
   TOKENIZER_STATUS_EOF,
+  TOKENIZER_STATUS_YIELD,
 };
 
 typedef enum tokenizer_status (*tokenizer_state_handler) (struct tokenizer *tokenizer, int32_t c);
@@ -252,6 +297,15 @@ struct treebuilder {
   bool scripting;
   bool frameset_ok;
   bool foster_parenting;
+
+  /* callback mode; NULL when building a DOM */
+  const HTMLSink *sink;
+  InfraString *sink_text; /* pending characters */
+  HTMLSinkAttr *sink_attrs;
+  size_t sink_attrs_cap;
+
+  /* the document's, if the input lies within it; see insert_character() */
+  DOMSource *source;
 };
 
 enum treebuilder_status {
@@ -265,9 +319,32 @@ typedef enum treebuilder_status (*treebuilder_mode_handler) (struct treebuilder
                                                              union token_data *token_data,
                                                              enum token_type token_type);
 
+/* one html_parser_run() call */
+struct slice {
+  const HTMLParseBudget *budget;
+  const char *input_start;
+  size_t ntokens_start;
+  struct timespec deadline;
+  size_t next_clock_check; /* tokens into the slice */
+};
+
+struct HTMLParser_s {
+  struct tokenizer tokenizer;
+  struct treebuilder treebuilder;
+
+  HTMLParseYieldHook yield_hook;
+  void *yield_data;
+
+  bool done;
+};
+
 static void tokenizer_error(struct tokenizer *tokenizer, const char *msg);
 static void treebuilder_error(struct treebuilder *treebuilder);
-static void tokenizer_mainloop(struct tokenizer *tokenizer);
+static void slice_begin(struct slice *slice, struct tokenizer *tokenizer,
+                        const HTMLParseBudget *budget);
+static bool slice_exhausted(struct slice *slice, struct tokenizer *tokenizer);
+static enum tokenizer_status tokenizer_mainloop(struct tokenizer *tokenizer,
+                                                const HTMLParseBudget *budget);
 static int_least32_t tokenizer_getc(struct tokenizer *tokenizer);
 
 static int tokenizer_cmp_consume(struct tokenizer *tokenizer,
@@ -276,7 +353,8 @@ static int tokenizer_cmp_consume(struct tokenizer *tokenizer,
 static int tokenizer_match(struct tokenizer *tokenizer, const char *s, size_t slen);
 static int tokenizer_matchcase(struct tokenizer *tokenizer, const char *s, size_t slen);
 
-static void push_open_element(struct treebuilder *treebuilder, struct dom_element *elem);
+static void push_open_element(struct treebuilder *treebuilder, struct dom_element *elem,
+                              const struct tag *tag);
 static const struct dom_element *pop_open_element(struct treebuilder *treebuilder);
 static inline struct dom_element *current_node(struct treebuilder *treebuilder);
 static inline struct dom_element *adjusted_current_node(struct treebuilder *treebuilder);
@@ -285,6 +363,9 @@ static void acknowledge_self_closing_fl(struct tag *tag);
 static int appropriate_end_tag(struct tokenizer *tokenizer);
 static inline int char_ref_in_attr(struct tokenizer *tokenizer);
 
+static void intern_atoms(void);
+static void intern_name(InfraString **name);
+
 static void create_doctype(struct tokenizer *tokenizer);
 static void destroy_tag(struct tag *tag);
 static void create_tag(struct tokenizer *tokenizer, enum token_type type);
@@ -306,7 +387,21 @@ static enum tokenizer_status emit_eof(struct tokenizer *tokenizer);
 static enum treebuilder_status tree_construction_dispatcher(struct treebuilder *treebuilder,
                                                             union token_data *token_data,
                                                             enum token_type token_type);
-/* XXX MathML, SVG */
+static bool is_mathml_text_integration_point(const struct dom_element *elem);
+static bool is_html_integration_point(const struct dom_element *elem);
+static const char *element_local_name(const struct dom_element *elem);
+static bool element_has_tag_name(const struct dom_element *elem, const InfraString *name);
+
+static void sink_flush_text(struct treebuilder *treebuilder);
+static void sink_start_element(struct treebuilder *treebuilder,
+                               const struct dom_element *elem, const struct tag *tag);
+static void sink_end_element(struct treebuilder *treebuilder,
+                             const struct dom_element *elem);
+
+static void rename_attr(struct attr *attr, const char *name);
+static void adjust_mathml_attrs(struct tag *tag);
+static void adjust_svg_attrs(struct tag *tag);
+static void adjust_foreign_attrs(struct tag *tag);
 
 static struct insertion_location appropriate_place(struct treebuilder *treebuilder,
                                                    struct dom_node *override_target);
@@ -314,6 +409,8 @@ static struct dom_element *create_element_for_token(struct treebuilder *treebuil
                                                     struct tag *tag,
                                                     enum InfraNamespace namespace,
                                                     struct dom_node *intended_parent);
+static void insert_node(struct treebuilder *treebuilder, struct dom_node *parent,
+                        struct dom_node *node, struct dom_node *child);
 static void insert_element_at_adj_location(struct treebuilder *treebuilder,
                                                           struct dom_element *element);
 static struct dom_element *insert_foreign_element(struct treebuilder *treebuilder,
@@ -370,6 +467,22 @@ static enum tokenizer_status comment_end_bang_state(struct tokenizer *tokenizer,
 static enum tokenizer_status doctype_state(struct tokenizer *tokenizer, int32_t c);
 static enum tokenizer_status before_doctype_name_state(struct tokenizer *tokenizer, int32_t c);
 static enum tokenizer_status doctype_name_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status after_doctype_name_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status after_doctype_public_keyword_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status before_doctype_public_id_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status doctype_public_id_double_quoted_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status doctype_public_id_single_quoted_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status after_doctype_public_id_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status between_doctype_public_system_ids_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status after_doctype_system_keyword_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status before_doctype_system_id_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status doctype_system_id_double_quoted_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status doctype_system_id_single_quoted_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status after_doctype_system_id_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status bogus_doctype_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status cdata_section_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status cdata_section_bracket_state(struct tokenizer *tokenizer, int32_t c);
+static enum tokenizer_status cdata_section_end_state(struct tokenizer *tokenizer, int32_t c);
 
 static enum treebuilder_status initial_mode(struct treebuilder *treebuilder,
                                             union token_data *token_data,
@@ -395,6 +508,9 @@ static enum treebuilder_status after_body_mode(struct treebuilder *treebuilder,
 static enum treebuilder_status after_after_body_mode(struct treebuilder *treebuilder,
                                                      union token_data *token_data,
                                                      enum token_type token_type);
+static enum treebuilder_status foreign_content_rules(struct treebuilder *treebuilder,
+                                                     union token_data *token_data,
+                                                     enum token_type token_type);
 
 /* globals */
 static const tokenizer_state_handler k_tokenizer_states[NUM_STATES] = {
@@ -433,6 +549,22 @@ static const tokenizer_state_handler k_tokenizer_states[NUM_STATES] = {
   [DOCTYPE_STATE] = doctype_state,
   [BEFORE_DOCTYPE_NAME_STATE] = before_doctype_name_state,
   [DOCTYPE_NAME_STATE] = doctype_name_state,
+  [AFTER_DOCTYPE_NAME_STATE] = after_doctype_name_state,
+  [AFTER_DOCTYPE_PUBLIC_KEYWORD_STATE] = after_doctype_public_keyword_state,
+  [BEFORE_DOCTYPE_PUBLIC_ID_STATE] = before_doctype_public_id_state,
+  [DOCTYPE_PUBLIC_ID_DOUBLE_QUOTED_STATE] = doctype_public_id_double_quoted_state,
+  [DOCTYPE_PUBLIC_ID_SINGLE_QUOTED_STATE] = doctype_public_id_single_quoted_state,
+  [AFTER_DOCTYPE_PUBLIC_ID_STATE] = after_doctype_public_id_state,
+  [BETWEEN_DOCTYPE_PUBLIC_SYSTEM_IDS_STATE] = between_doctype_public_system_ids_state,
+  [AFTER_DOCTYPE_SYSTEM_KEYWORD_STATE] = after_doctype_system_keyword_state,
+  [BEFORE_DOCTYPE_SYSTEM_ID_STATE] = before_doctype_system_id_state,
+  [DOCTYPE_SYSTEM_ID_DOUBLE_QUOTED_STATE] = doctype_system_id_double_quoted_state,
+  [DOCTYPE_SYSTEM_ID_SINGLE_QUOTED_STATE] = doctype_system_id_single_quoted_state,
+  [AFTER_DOCTYPE_SYSTEM_ID_STATE] = after_doctype_system_id_state,
+  [BOGUS_DOCTYPE_STATE] = bogus_doctype_state,
+  [CDATA_SECTION_STATE] = cdata_section_state,
+  [CDATA_SECTION_BRACKET_STATE] = cdata_section_bracket_state,
+  [CDATA_SECTION_END_STATE] = cdata_section_end_state,
   /* ... */
 };
 
@@ -464,11 +596,69 @@ treebuilder_error(struct treebuilder *treebuilder)
 }
 
 static void
-tokenizer_mainloop(struct tokenizer *tokenizer)
+slice_begin(struct slice *slice, struct tokenizer *tokenizer,
+            const HTMLParseBudget *budget)
+{
+  slice->budget = budget;
+  slice->input_start = tokenizer->input.p;
+  slice->ntokens_start = tokenizer->ntokens;
+  slice->next_clock_check = 0;
+
+  if (budget != NULL && budget->max_nsecs != 0) {
+    timespec_get(&slice->deadline, TIME_UTC);
+    slice->deadline.tv_sec  += budget->max_nsecs / 1000000000;
+    slice->deadline.tv_nsec += budget->max_nsecs % 1000000000;
+
+    if (slice->deadline.tv_nsec >= 1000000000) {
+      slice->deadline.tv_sec++;
+      slice->deadline.tv_nsec -= 1000000000;
+    }
+  }
+}
+
+static bool
+slice_exhausted(struct slice *slice, struct tokenizer *tokenizer)
+{
+  const HTMLParseBudget *budget = slice->budget;
+  size_t ntokens = tokenizer->ntokens - slice->ntokens_start;
+
+  if (budget == NULL)
+    return false;
+
+  if (budget->max_tokens != 0 && ntokens >= budget->max_tokens)
+    return true;
+
+  if (budget->max_bytes != 0
+   && (size_t) (tokenizer->input.p - slice->input_start) >= budget->max_bytes)
+    return true;
+
+  /*
+   * Reading the clock per character token would dominate the parse. A
+   * step may emit several tokens, so test a threshold, not a multiple.
+   */
+  if (budget->max_nsecs != 0 && ntokens >= slice->next_clock_check) {
+    struct timespec now;
+
+    slice->next_clock_check = ntokens + 64;
+    timespec_get(&now, TIME_UTC);
+    return (now.tv_sec > slice->deadline.tv_sec
+         || (now.tv_sec == slice->deadline.tv_sec
+          && now.tv_nsec >= slice->deadline.tv_nsec));
+  }
+
+  return false;
+}
+
+static enum tokenizer_status
+tokenizer_mainloop(struct tokenizer *tokenizer, const HTMLParseBudget *budget)
 {
   enum tokenizer_status rc = TOKENIZER_STATUS_OK;
+  struct slice slice;
+
+  slice_begin(&slice, tokenizer, budget);
 
   while (rc != TOKENIZER_STATUS_EOF) {
+    size_t ntokens = tokenizer->ntokens;
     int32_t c;
 
     switch (tokenizer->state) {
@@ -483,8 +673,14 @@ tokenizer_mainloop(struct tokenizer *tokenizer)
 
     do { rc = k_tokenizer_states[tokenizer->state](tokenizer, c); }
       while (rc == TOKENIZER_STATUS_RECONSUME);
+
+    /* only yield right after a token has gone through tree construction */
+    if (rc != TOKENIZER_STATUS_EOF && tokenizer->ntokens != ntokens
+     && slice_exhausted(&slice, tokenizer))
+      return TOKENIZER_STATUS_YIELD;
   }
 
+  return rc;
 }
 
 static int_least32_t
@@ -494,6 +690,8 @@ tokenizer_getc(struct tokenizer *tokenizer)
   size_t read;
   uint_least32_t c = { 0 };
 
+  tokenizer->input.c_start = tokenizer->input.p;
+
   if (left > 0 && *tokenizer->input.p == '\0')
     /* grapheme doesn't handle this */
     return *tokenizer->input.p++;
@@ -568,19 +766,35 @@ tokenizer_matchcase(struct tokenizer *tokenizer,
   return tokenizer_cmp_consume(tokenizer, my_strncasecmp, s, slen);
 }
 
+/* tag is only used for sink callbacks and may be NULL for implied elements */
 static void
-push_open_element(struct treebuilder *treebuilder, struct dom_element *elem)
+push_open_element(struct treebuilder *treebuilder, struct dom_element *elem,
+                  const struct tag *tag)
 {
   infra_stack_push(treebuilder->open_elements,
     dom_strong_ref_object(elem));
+
+  if (treebuilder->sink != NULL)
+    sink_start_element(treebuilder, elem, tag);
 }
 
+/*
+ * In callback mode nothing else holds the element, so the result may
+ * already be freed: only compare it, never dereference it.
+ */
 static const struct dom_element *
 pop_open_element(struct treebuilder *treebuilder)
 {
   struct dom_element *popped = infra_stack_pop(treebuilder->open_elements);
 
-  dom_strong_unref_object(popped);
+  if (treebuilder->sink != NULL)
+    sink_end_element(treebuilder, popped);
+
+  /* parsed trees would otherwise fill the cycle collector's buffer */
+  if (((struct dom_node *) popped)->parent != NULL)
+    dom_strong_unref_held_object(popped);
+  else
+    dom_strong_unref_object(popped);
 
   return popped;
 }
@@ -621,6 +835,23 @@ char_ref_in_attr(struct tokenizer *tokenizer)
        || tokenizer->ret_state == ATTR_VALUE_UNQUOTED_STATE);
 }
 
+static void
+intern_atoms(void)
+{
+  for (int i = 0; i < NUM_ATOMS; i++)
+    atoms[i] = infra_atom_intern(k_atom_names[i], strlen(k_atom_names[i]));
+}
+
+/* Swap a finished name buffer for its atom */
+static void
+intern_name(InfraString **name)
+{
+  InfraAtom *atom = infra_atom_from_string(*name);
+
+  infra_string_unref(*name);
+  *name = atom;
+}
+
 static void
 create_doctype(struct tokenizer *tokenizer)
 {
@@ -633,6 +864,10 @@ create_doctype(struct tokenizer *tokenizer)
   tokenizer->doctype.name      = infra_string_create();
   tokenizer->doctype.public_id = infra_string_create();
   tokenizer->doctype.system_id = infra_string_create();
+
+  tokenizer->doctype.name_missing      = true;
+  tokenizer->doctype.public_id_missing = true;
+  tokenizer->doctype.system_id_missing = true;
 }
 
 static void
@@ -701,6 +936,10 @@ create_comment(struct tokenizer *tokenizer)
 {
   infra_string_unref(tokenizer->comment);
   tokenizer->comment = infra_string_create();
+
+  /* past "<!" there, else at the character just consumed */
+  tokenizer->comment_start = tokenizer->state == MARKUP_DECL_OPEN_STATE
+                           ? tokenizer->input.p : tokenizer->input.c_start;
 }
 
 static void
@@ -710,6 +949,8 @@ emit_token(struct tokenizer *tokenizer, union token_data *token_data,
   struct treebuilder *treebuilder = tokenizer->treebuilder;
   enum treebuilder_status rc = TREEBUILDER_STATUS_OK;
 
+  tokenizer->ntokens++;
+
   do { rc = tree_construction_dispatcher(treebuilder, token_data, token_type); }
     while (rc == TREEBUILDER_STATUS_REPROCESS);
 }
@@ -717,34 +958,34 @@ emit_token(struct tokenizer *tokenizer, union token_data *token_data,
 static void
 emit_tag(struct tokenizer *tokenizer)
 {
-  /* XXX Support other namespaces */
-  for (uint16_t i = HTML_TAG_HTML; i < NUM_HTML_TAG; i++)
-  {
-    if (!strcmp(k_html_tag_names[i], tokenizer->tag->tagname->data))
-    {
-      tokenizer->tag->localname = i;
-      break;
-    }
+  struct tag *tag = tokenizer->tag;
+
+  intern_name(&tag->tagname);
+
+  INFRA_STACK_FOREACH(tag->attrs, i) {
+    struct attr *attr = tag->attrs->items[i];
+    intern_name(&attr->name);
   }
 
-  if (tokenizer->tag->localname == 0)
+  /* SVG and MathML names are looked up on insertion, see create_element_for_token() */
+  tag->localname = html_tag_lookup(tag->tagname->data, tag->tagname->size);
+
+  if (tag->localname == 0)
   {
-    if (!strcmp("math", tokenizer->tag->tagname->data)) {
-      tokenizer->tag->localname = FOREIGN_TAG_MATH;
-    } else if (!strcmp("svg", tokenizer->tag->tagname->data)) {
-      tokenizer->tag->localname = FOREIGN_TAG_SVG;
-    } else if (strcmp("image", tokenizer->tag->tagname->data) == 0
-            && tokenizer->treebuilder->mode == IN_BODY_MODE) {
-      tokenizer->tag->localname = HTML_TAG_IMG;
+    if (tag->tagname == atoms[ATOM_MATH]) {
+      tag->localname = FOREIGN_TAG_MATH;
+    } else if (tag->tagname == atoms[ATOM_SVG]) {
+      tag->localname = FOREIGN_TAG_SVG;
     }
   }
 
-  emit_token(tokenizer, (union token_data *) tokenizer->tag, tokenizer->tag_type);
+  emit_token(tokenizer, (union token_data *) tag, tokenizer->tag_type);
 }
 
 static void
 emit_doctype(struct tokenizer *tokenizer)
 {
+  intern_name(&tokenizer->doctype.name);
   emit_token(tokenizer, (union token_data *) &tokenizer->doctype, TOKEN_DOCTYPE);
 }
 
@@ -775,7 +1016,17 @@ emit_character(struct tokenizer *tokenizer, uint32_t c)
 static enum tokenizer_status
 emit_eof(struct tokenizer *tokenizer)
 {
+  struct treebuilder *treebuilder = tokenizer->treebuilder;
+
   emit_token(tokenizer, NULL, TOKEN_EOF);
+
+  /* 13.2.7 The end: pop all the nodes off the stack of open elements */
+  while (treebuilder->open_elements->size > 0)
+    pop_open_element(treebuilder);
+
+  if (treebuilder->sink != NULL)
+    sink_flush_text(treebuilder);
+
   return TOKENIZER_STATUS_EOF;
 }
 
@@ -785,10 +1036,224 @@ tree_construction_dispatcher(struct treebuilder *treebuilder,
                              union token_data *token_data,
                              enum token_type token_type)
 {
-  /* XXX Foreign content!!! */
+  struct dom_element *node = adjusted_current_node(treebuilder);
+  bool is_char = (token_type == TOKEN_CHARACTER || token_type == TOKEN_WHITESPACE);
+  bool is_start = (token_type == TOKEN_START_TAG);
+
+  if (node == NULL
+   || node->namespace == INFRA_NAMESPACE_HTML
+   || token_type == TOKEN_EOF)
+    goto insertion_mode;
+
+  if (is_mathml_text_integration_point(node)) {
+    if (is_char)
+      goto insertion_mode;
+
+    if (is_start) {
+      uint16_t name = html_mathml_tag_lookup(token_data->tag.tagname->data,
+                                             token_data->tag.tagname->size);
+      if (name != MATHML_TAG_MGLYPH && name != MATHML_TAG_MALIGNMARK)
+        goto insertion_mode;
+    }
+  }
+
+  if (node->namespace == INFRA_NAMESPACE_MATHML
+   && node->local_name == MATHML_TAG_ANNOTATION_XML
+   && is_start && token_data->tag.localname == FOREIGN_TAG_SVG)
+    goto insertion_mode;
+
+  if ((is_start || is_char) && is_html_integration_point(node))
+    goto insertion_mode;
+
+  return foreign_content_rules(treebuilder, token_data, token_type);
+
+insertion_mode:
   return k_treebuilder_modes[treebuilder->mode](treebuilder, token_data, token_type);
 }
 
+static bool
+is_mathml_text_integration_point(const struct dom_element *elem)
+{
+  if (elem->namespace != INFRA_NAMESPACE_MATHML)
+    return false;
+
+  switch (elem->local_name) {
+    case MATHML_TAG_MI: case MATHML_TAG_MO: case MATHML_TAG_MN:
+    case MATHML_TAG_MS: case MATHML_TAG_MTEXT:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+static bool
+is_html_integration_point(const struct dom_element *elem)
+{
+  if (elem->namespace == INFRA_NAMESPACE_SVG)
+    return (elem->local_name == SVG_TAG_FOREIGNOBJECT
+         || elem->local_name == SVG_TAG_DESC
+         || elem->local_name == SVG_TAG_TITLE);
+
+  if (elem->namespace != INFRA_NAMESPACE_MATHML
+   || elem->local_name != MATHML_TAG_ANNOTATION_XML)
+    return false;
+
+  for (uint32_t i = 0; i < elem->num_attrs; i++) {
+    const struct dom_attr_slot *attr = &elem->attrs[i];
+    const InfraString *value = attr->value;
+
+    if (attr->namespace != INFRA_NAMESPACE_NONE
+     || attr->local_name != atoms[ATOM_ENCODING])
+      continue;
+
+    if ((value->size == 9 && !my_strncasecmp(value->data, "text/html", 9))
+     || (value->size == 21 && !my_strncasecmp(value->data, "application/xhtml+xml", 21)))
+      return true;
+  }
+
+  return false;
+}
+
+static const char *
+element_local_name(const struct dom_element *elem)
+{
+  if (elem->local_name == 0)
+    return elem->uninterned_local_name->data;
+
+  switch (elem->namespace) {
+    case INFRA_NAMESPACE_HTML:   return k_html_tag_names[elem->local_name];
+    case INFRA_NAMESPACE_SVG:    return k_svg_tag_names[elem->local_name];
+    case INFRA_NAMESPACE_MATHML: return k_mathml_tag_names[elem->local_name];
+    default:                     return NULL;
+  }
+}
+
+/* "node's tag name, converted to ASCII lowercase, is token's tag name" */
+static bool
+element_has_tag_name(const struct dom_element *elem, const InfraString *name)
+{
+  const char *elem_name = element_local_name(elem);
+
+  if (elem_name == NULL)
+    return false;
+
+  if (elem->local_name == 0 && elem->uninterned_local_name == name)
+    return true;
+
+  return (strlen(elem_name) == name->size
+       && !my_strncasecmp(elem_name, name->data, name->size));
+}
+
+static void
+sink_flush_text(struct treebuilder *treebuilder)
+{
+  InfraString *text = treebuilder->sink_text;
+
+  if (text->size == 0)
+    return;
+
+  if (treebuilder->sink->on_text != NULL)
+    treebuilder->sink->on_text(treebuilder->sink->user_data, text->data, text->size);
+
+  infra_string_clear(text);
+}
+
+static void
+sink_start_element(struct treebuilder *treebuilder,
+                   const struct dom_element *elem, const struct tag *tag)
+{
+  size_t num_attrs = 0;
+
+  sink_flush_text(treebuilder);
+
+  if (treebuilder->sink->on_start_element == NULL)
+    return;
+
+  if (tag != NULL && tag->attrs != NULL) {
+    num_attrs = tag->attrs->size;
+
+    if (num_attrs > treebuilder->sink_attrs_cap) {
+      treebuilder->sink_attrs_cap = num_attrs;
+      treebuilder->sink_attrs = realloc(treebuilder->sink_attrs,
+        num_attrs * sizeof (*treebuilder->sink_attrs));
+    }
+
+    INFRA_STACK_FOREACH(tag->attrs, i) {
+      const struct attr *attr = tag->attrs->items[i];
+
+      treebuilder->sink_attrs[i] = (HTMLSinkAttr) {
+        .prefix     = attr->prefix,
+        .local_name = attr->name->data,
+        .value      = attr->value->data,
+        .value_len  = attr->value->size,
+        .namespace  = attr->namespace,
+      };
+    }
+  }
+
+  treebuilder->sink->on_start_element(treebuilder->sink->user_data,
+    elem->namespace, element_local_name(elem),
+    treebuilder->sink_attrs, num_attrs);
+}
+
+static void
+sink_end_element(struct treebuilder *treebuilder, const struct dom_element *elem)
+{
+  sink_flush_text(treebuilder);
+
+  if (treebuilder->sink->on_end_element != NULL)
+    treebuilder->sink->on_end_element(treebuilder->sink->user_data,
+      elem->namespace, element_local_name(elem));
+}
+
+static void
+rename_attr(struct attr *attr, const char *name)
+{
+  attr->name = infra_atom_intern(name, strlen(name));
+}
+
+static void
+adjust_mathml_attrs(struct tag *tag)
+{
+  INFRA_STACK_FOREACH(tag->attrs, i) {
+    struct attr *attr = tag->attrs->items[i];
+    const char *name = html_adjust_mathml_attr(attr->name->data, attr->name->size);
+
+    if (name != NULL)
+      rename_attr(attr, name);
+  }
+}
+
+static void
+adjust_svg_attrs(struct tag *tag)
+{
+  INFRA_STACK_FOREACH(tag->attrs, i) {
+    struct attr *attr = tag->attrs->items[i];
+    const char *name = html_adjust_svg_attr(attr->name->data, attr->name->size);
+
+    if (name != NULL)
+      rename_attr(attr, name);
+  }
+}
+
+static void
+adjust_foreign_attrs(struct tag *tag)
+{
+  INFRA_STACK_FOREACH(tag->attrs, i) {
+    struct attr *attr = tag->attrs->items[i];
+    const HTMLForeignAttr *adj = html_adjust_foreign_attr(attr->name->data,
+                                                          attr->name->size);
+
+    if (adj == NULL)
+      continue;
+
+    rename_attr(attr, adj->local_name);
+    attr->namespace = adj->namespace;
+    attr->prefix    = adj->prefix;
+  }
+}
+
 static struct insertion_location
 appropriate_place(struct treebuilder *treebuilder, struct dom_node *override_target)
 {
@@ -873,33 +1338,77 @@ create_element_for_token(struct treebuilder *treebuilder, struct tag *tag,
 {
   dom_strong_ref_object(intended_parent);
 
-  struct dom_document *document =
-    dom_strong_ref_object(intended_parent->node_document);
-  uint16_t local_name = tag->localname;
+  struct dom_document *document = dom_strong_ref_object(
+    DOM_IMPLEMENTS(intended_parent, document)
+      ? (struct dom_document *) intended_parent
+      : intended_parent->node_document);
+  uint16_t local_name = 0;
   struct dom_element *element = NULL;
   /*
-   * XXX: uninterned local names (mostly valid custom element names)
    * XXX: stub for custom elements; create dummy definition and generate
    * internal element index
    */
 
   bool exec_script = false;
 
-  element = dom_create_element_interned(document, local_name, namespace,
-    NULL, NULL, exec_script);
+  switch (namespace) {
+    case INFRA_NAMESPACE_HTML:
+      if (tag->localname < NUM_HTML_TAG)
+        local_name = tag->localname;
+      break;
 
-  INFRA_STACK_FOREACH(tag->attrs, i) {
-    struct attr *on_token = tag->attrs->items[i];
+    /* adjust SVG tag name: the table holds the properly cased names */
+    case INFRA_NAMESPACE_SVG:
+      local_name = html_svg_tag_lookup(tag->tagname->data, tag->tagname->size);
+      break;
+
+    case INFRA_NAMESPACE_MATHML:
+      local_name = html_mathml_tag_lookup(tag->tagname->data, tag->tagname->size);
+      break;
 
-    // if
+    default:
+      break;
   }
 
-  dom_strong_unref_object(document);
-  dom_strong_unref_object(intended_parent);
+  if (local_name != 0)
+    element = dom_create_element_interned(document, local_name, namespace,
+      NULL, NULL, exec_script);
+  else
+    element = dom_create_element(document, tag->tagname, namespace,
+      NULL, NULL, exec_script);
+
+  /*
+   * Sinks are passed the token's attributes, see sink_start_element(), but
+   * open elements need theirs too: the algorithm inspects them (HTML
+   * integration points), and they go away with the element when popped.
+   */
+  if (tag->attrs != NULL) {
+    dom_element_reserve_attributes(element, tag->attrs->size);
+
+    INFRA_STACK_FOREACH(tag->attrs, i) {
+      struct attr *on_token = tag->attrs->items[i];
+
+      dom_element_append_attribute(element, on_token->name, on_token->value,
+                                   on_token->namespace, on_token->prefix);
+    }
+  }
+
+  /* both are held by the tree builder as well */
+  dom_strong_unref_held_object(document);
+  dom_strong_unref_held_object(intended_parent);
 
   return element;
 }
 
+/* In callback mode the tree is never built */
+static void
+insert_node(struct treebuilder *treebuilder, struct dom_node *parent,
+            struct dom_node *node, struct dom_node *child)
+{
+  if (treebuilder->sink == NULL)
+    dom_insert_node(parent, node, child, false);
+}
+
 static void
 insert_element_at_adj_location(struct treebuilder *treebuilder,
                                struct dom_element *element)
@@ -907,7 +1416,8 @@ insert_element_at_adj_location(struct treebuilder *treebuilder,
   struct insertion_location location = appropriate_place(treebuilder, NULL);
 
   /* XXX Check if possible */
-  dom_insert_node(location.parent, (struct dom_node *) element, location.child, false);
+  insert_node(treebuilder, location.parent, (struct dom_node *) element,
+   location.child);
 }
 
 static struct dom_element *
@@ -923,7 +1433,7 @@ insert_foreign_element(struct treebuilder *treebuilder,
   if (!only_add_to_element_stack)
     insert_element_at_adj_location(treebuilder, element);
 
-  push_open_element(treebuilder, element);
+  push_open_element(treebuilder, element, tag);
 
   return element;
 }
@@ -936,27 +1446,103 @@ insert_html_element(struct treebuilder *treebuilder,
     insert_foreign_element(treebuilder, tag, INFRA_NAMESPACE_HTML, false);
 }
 
+/*
+ * Whether the len bytes at p are in the parser's source, so that a node
+ * can borrow them rather than copy
+ */
+static bool
+in_source(const struct treebuilder *treebuilder, const char *p, size_t len)
+{
+  const DOMSource *source = treebuilder->source;
+
+  return source != NULL && p >= source->data
+      && p + len <= source->data + source->len;
+}
+
 static void
 insert_character(struct treebuilder *treebuilder, uint32_t c)
 {
-  (void) treebuilder;
-  (void) c;
+  const struct tokenizer *tokenizer = treebuilder->tokenizer;
+  const char *data = tokenizer->input.c_start;
+  struct insertion_location location;
+  struct dom_node *prev;
+  struct dom_text *text;
+  char enc[4];
+  size_t len;
+
+  if (treebuilder->sink != NULL) {
+    infra_string_put_codepoint(treebuilder->sink_text, c);
+    return;
+  }
+
+  location = appropriate_place(treebuilder, NULL);
+
+  if (DOM_IMPLEMENTS(location.parent, document))
+    return;
+
+  /*
+   * Characters read as they stand in the input (no references, NULs or
+   * CRs) are borrowed from it, and runs of them extend a single span.
+   */
+  len = grapheme_encode_utf8(c, enc, sizeof (enc));
+
+  if (!in_source(treebuilder, data, len)
+   || (size_t) (tokenizer->input.p - data) != len
+   || memcmp(data, enc, len) != 0)
+    data = enc;
+
+  prev = location.child != NULL ? location.child->prev_sibling
+                                : location.parent->last_child;
+
+  if (prev != NULL && DOM_IMPLEMENTS(prev, text)) {
+    dom_character_data_append((struct dom_character_data *) prev, data, len);
+    return;
+  }
+
+  text = DOM_NEW_OBJECT( text );
+
+  ((struct dom_node *) text)->node_document =
+    dom_weak_ref_object(location.parent->node_document);
+
+  if (data != enc)
+    dom_character_data_borrow((struct dom_character_data *) text,
+                              treebuilder->source, data, len);
+  else
+    dom_character_data_set((struct dom_character_data *) text, data, len);
+
+  dom_insert_node(location.parent, (struct dom_node *) text,
+   location.child, false);
 }
 
 static void
 insert_comment(struct treebuilder *treebuilder, InfraString *data,
                struct insertion_location position)
 {
+  if (treebuilder->sink != NULL) {
+    sink_flush_text(treebuilder);
+
+    if (treebuilder->sink->on_comment != NULL)
+      treebuilder->sink->on_comment(treebuilder->sink->user_data,
+        data->data, data->size);
+    return;
+  }
+
   if (position.parent == NULL)
     position = appropriate_place(treebuilder, NULL);
 
   struct dom_comment *comment = DOM_NEW_OBJECT( comment );
-
-  ((struct dom_character_data *) comment)->data = infra_string_ref(data);
+  const char *start = treebuilder->tokenizer->comment_start;
 
   ((struct dom_node *) comment)->node_document =
     dom_weak_ref_object(position.parent->node_document);
 
+  if (data->size != 0 && in_source(treebuilder, start, data->size)
+   && memcmp(start, data->data, data->size) == 0)
+    dom_character_data_borrow((struct dom_character_data *) comment,
+                              treebuilder->source, start, data->size);
+  else
+    ((struct dom_character_data *) comment)->data = infra_string_ref(data);
+
   dom_insert_node(position.parent, (struct dom_node *) comment,
    position.child, false);
 }
@@ -989,6 +1575,8 @@ static void
 create_parser(struct tokenizer *tokenizer, struct treebuilder *treebuilder,
               struct dom_document *document, const char *input, size_t input_len)
 {
+  call_once(&atoms_once, intern_atoms);
+
   tokenizer->treebuilder = treebuilder;
   treebuilder->tokenizer = tokenizer;
 
@@ -996,13 +1584,21 @@ create_parser(struct tokenizer *tokenizer, struct treebuilder *treebuilder,
   tokenizer->input.end = &input[input_len];
 
   treebuilder->document = dom_strong_ref_object(document);
+
+  if (document->source != NULL
+   && input >= document->source->data
+   && &input[input_len] <= document->source->data + document->source->len)
+    treebuilder->source = document->source;
   treebuilder->open_elements = infra_stack_create();
 }
 
 static void
 free_parser(struct tokenizer *tokenizer, struct treebuilder *treebuilder)
 {
-  (void) treebuilder;
+  /* don't report elements left open by an unfinished parse */
+  treebuilder->sink = NULL;
+  infra_string_unref(treebuilder->sink_text);
+  free(treebuilder->sink_attrs);
 
   infra_string_unref(tokenizer->doctype.name);
   infra_string_unref(tokenizer->doctype.public_id);
@@ -1033,6 +1629,7 @@ html_parse(struct dom_document *document,
 {
   struct tokenizer tokenizer = { 0 };
   struct treebuilder treebuilder = { 0 };
+  InfraArena *previous = infra_arena_enter(document->arena);
 
   create_parser(&tokenizer, &treebuilder,
                 document,
@@ -1041,7 +1638,107 @@ html_parse(struct dom_document *document,
   tokenizer.state  = DATA_STATE;
   treebuilder.mode = INITIAL_MODE;
 
-  tokenizer_mainloop(&tokenizer);
+  document->parsing = true;
+  tokenizer_mainloop(&tokenizer, NULL);
+  document->parsing = false;
 
   free_parser(&tokenizer, &treebuilder);
+
+  infra_arena_leave(previous);
+
+  dom_mutation_checkpoint(document);
+}
+
+HTMLParser *
+html_parser_create(struct dom_document *document,
+                   const char *input, size_t input_len)
+{
+  HTMLParser *parser = malloc(sizeof (*parser));
+  InfraArena *previous = infra_arena_enter(document->arena);
+
+  memset(parser, 0, sizeof (*parser));
+
+  create_parser(&parser->tokenizer, &parser->treebuilder,
+                document,
+                input, input_len);
+
+  parser->tokenizer.state  = DATA_STATE;
+  parser->treebuilder.mode = INITIAL_MODE;
+
+  infra_arena_leave(previous);
+
+  return parser;
+}
+
+void
+html_parser_destroy(HTMLParser *parser)
+{
+  free_parser(&parser->tokenizer, &parser->treebuilder);
+  free(parser);
+}
+
+void
+html_parser_set_yield_hook(HTMLParser *parser,
+                           HTMLParseYieldHook hook, void *user_data)
+{
+  parser->yield_hook = hook;
+  parser->yield_data = user_data;
+}
+
+void
+html_parser_set_sink(HTMLParser *parser, const HTMLSink *sink)
+{
+  InfraArena *previous = infra_arena_enter(parser->treebuilder.document->arena);
+
+  parser->treebuilder.sink = sink;
+
+  if (parser->treebuilder.sink_text == NULL)
+    parser->treebuilder.sink_text = infra_string_create();
+
+  infra_arena_leave(previous);
+}
+
+void
+html_parse_sink(const HTMLSink *sink, const char *input, size_t input_len)
+{
+  /* owner document of the transient open elements; stays empty */
+  struct dom_document *document = dom_strong_ref_object(
+    dom_create_document(true));
+
+  HTMLParser *parser = html_parser_create(document, input, input_len);
+
+  html_parser_set_sink(parser, sink);
+  html_parser_run(parser, NULL);
+  html_parser_destroy(parser);
+
+  dom_strong_unref_object(document);
+}
+
+enum HTMLParseStatus
+html_parser_run(HTMLParser *parser, const HTMLParseBudget *budget)
+{
+  struct dom_document *document = parser->treebuilder.document;
+  InfraArena *previous;
+  enum tokenizer_status rc;
+
+  if (parser->done)
+    return HTML_PARSE_DONE;
+
+  previous = infra_arena_enter(document->arena);
+  document->parsing = true;
+  rc = tokenizer_mainloop(&parser->tokenizer, budget);
+  document->parsing = false;
+  infra_arena_leave(previous);
+
+  dom_mutation_checkpoint(document);
+
+  if (rc == TOKENIZER_STATUS_EOF) {
+    parser->done = true;
+    return HTML_PARSE_DONE;
+  }
+
+  if (parser->yield_hook != NULL)
+    parser->yield_hook(parser, document, parser->yield_data);
+
+  return HTML_PARSE_YIELDED;
 }
@@ -0,0 +1,209 @@
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "html_quirks.h"
+
+/*
+ * The public identifier checks are compiled into a case-folded trie on
+ * first use, so deciding the mode is a single walk over the identifier
+ * instead of one strncasecmp() per known DOCTYPE.
+ */
+
+enum {
+  PUBLIC_ID_QUIRKS_PREFIX   = 1 << 0,
+  PUBLIC_ID_QUIRKS_EXACT    = 1 << 1,
+  /* quirks if the system identifier is missing, limited-quirks otherwise */
+  PUBLIC_ID_HTML401_PREFIX  = 1 << 2,
+  PUBLIC_ID_LIMITED_PREFIX  = 1 << 3,
+};
+
+struct quirky_public_id {
+  const char *id;
+  uint8_t flags;
+};
+
+static const struct quirky_public_id k_quirky_public_ids[] = {
+  { "-//W3O//DTD W3 HTML Strict 3.0//EN//", PUBLIC_ID_QUIRKS_EXACT },
+  { "-/W3C/DTD HTML 4.0 Transitional/EN",   PUBLIC_ID_QUIRKS_EXACT },
+  { "HTML",                                 PUBLIC_ID_QUIRKS_EXACT },
+
+  { "+//Silmaril//dtd html Pro v0r11 19970101//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//AS//DTD HTML 3.0 asWedit + extensions//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//AdvaSoft Ltd//DTD HTML 3.0 asWedit + extensions//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML 2.0 Level 1//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML 2.0 Level 2//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML 2.0 Strict Level 1//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML 2.0 Strict Level 2//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML 2.0 Strict//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML 2.0//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML 2.1E//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML 3.0//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML 3.2 Final//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML 3.2//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML 3//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML Level 0//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML Level 1//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML Level 2//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML Level 3//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML Strict Level 0//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML Strict Level 1//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML Strict Level 2//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML Strict Level 3//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML Strict//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//IETF//DTD HTML//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//Metrius//DTD Metrius Presentational//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//Microsoft//DTD Internet Explorer 2.0 HTML Strict//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//Microsoft//DTD Internet Explorer 2.0 HTML//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//Microsoft//DTD Internet Explorer 2.0 Tables//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//Microsoft//DTD Internet Explorer 3.0 HTML Strict//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//Microsoft//DTD Internet Explorer 3.0 HTML//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//Microsoft//DTD Internet Explorer 3.0 Tables//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//Netscape Comm. Corp.//DTD HTML//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//Netscape Comm. Corp.//DTD Strict HTML//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//O'Reilly and Associates//DTD HTML 2.0//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//O'Reilly and Associates//DTD HTML Extended 1.0//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//O'Reilly and Associates//DTD HTML Extended Relaxed 1.0//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//SQ//DTD HTML 2.0 HoTMetaL + extensions//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//SoftQuad Software//DTD HoTMetaL PRO 6.0::19990601::extensions to HTML 4.0//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//SoftQuad//DTD HoTMetaL PRO 4.0::19971010::extensions to HTML 4.0//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//Spyglass//DTD HTML 2.0 Extended//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//Sun Microsystems Corp.//DTD HotJava HTML//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//Sun Microsystems Corp.//DTD HotJava Strict HTML//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//W3C//DTD HTML 3 1995-03-24//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//W3C//DTD HTML 3.2 Draft//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//W3C//DTD HTML 3.2 Final//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//W3C//DTD HTML 3.2//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//W3C//DTD HTML 3.2S Draft//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//W3C//DTD HTML 4.0 Frameset//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//W3C//DTD HTML 4.0 Transitional//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//W3C//DTD HTML Experimental 19960712//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//W3C//DTD HTML Experimental 970421//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//W3C//DTD W3 HTML//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//W3O//DTD W3 HTML 3.0//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//WebTechs//DTD Mozilla HTML 2.0//", PUBLIC_ID_QUIRKS_PREFIX },
+  { "-//WebTechs//DTD Mozilla HTML//", PUBLIC_ID_QUIRKS_PREFIX },
+
+  { "-//W3C//DTD HTML 4.01 Frameset//",     PUBLIC_ID_HTML401_PREFIX },
+  { "-//W3C//DTD HTML 4.01 Transitional//", PUBLIC_ID_HTML401_PREFIX },
+
+  { "-//W3C//DTD XHTML 1.0 Frameset//",     PUBLIC_ID_LIMITED_PREFIX },
+  { "-//W3C//DTD XHTML 1.0 Transitional//", PUBLIC_ID_LIMITED_PREFIX },
+};
+
+static const char k_quirky_system_id[] =
+  "http://www.ibm.com/data/dtd/v11/ibmxhtml1-transitional.dtd";
+
+struct trie_node {
+  uint16_t child;   /* first child, 0 if none */
+  uint16_t sibling; /* next sibling, 0 if none */
+  uint8_t c;        /* ASCII lowercase */
+  uint8_t flags;    /* of the identifier ending here */
+};
+
+static struct trie_node *trie; /* node 0 is the root */
+static once_flag trie_once = ONCE_FLAG_INIT;
+
+static inline uint8_t
+fold(uint8_t c)
+{
+  return (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+}
+
+static uint16_t
+find_child(uint16_t node, uint8_t c)
+{
+  for (uint16_t n = trie[node].child; n != 0; n = trie[n].sibling)
+    if (trie[n].c == c)
+      return n;
+
+  return 0;
+}
+
+static void
+build_trie(void)
+{
+  size_t max_nodes = 1;
+  uint16_t num_nodes = 1;
+
+  for (size_t i = 0; i < sizeof (k_quirky_public_ids) / sizeof (k_quirky_public_ids[0]); i++)
+    max_nodes += strlen(k_quirky_public_ids[i].id);
+
+  trie = calloc(max_nodes, sizeof (*trie));
+
+  for (size_t i = 0; i < sizeof (k_quirky_public_ids) / sizeof (k_quirky_public_ids[0]); i++) {
+    uint16_t node = 0;
+
+    for (const char *p = k_quirky_public_ids[i].id; *p != '\0'; p++) {
+      uint8_t c = fold(*p);
+      uint16_t next = find_child(node, c);
+
+      if (next == 0) {
+        next = num_nodes++;
+        trie[next].c       = c;
+        trie[next].sibling = trie[node].child;
+        trie[node].child   = next;
+      }
+
+      node = next;
+    }
+
+    trie[node].flags |= k_quirky_public_ids[i].flags;
+  }
+}
+
+static uint8_t
+public_id_flags(const InfraString *public_id)
+{
+  uint8_t flags = 0;
+  uint16_t node = 0;
+  uint32_t i;
+
+  call_once(&trie_once, build_trie);
+
+  for (i = 0; i < public_id->size; i++) {
+    node = find_child(node, fold(public_id->data[i]));
+    if (node == 0)
+      break;
+
+    flags |= trie[node].flags & ~PUBLIC_ID_QUIRKS_EXACT;
+  }
+
+  if (i == public_id->size)
+    flags |= trie[node].flags & PUBLIC_ID_QUIRKS_EXACT;
+
+  return flags;
+}
+
+static bool
+equals_ignore_case(const InfraString *s, const char *t, size_t len)
+{
+  if (s->size != len)
+    return false;
+
+  for (size_t i = 0; i < len; i++)
+    if (fold(s->data[i]) != fold(t[i]))
+      return false;
+
+  return true;
+}
+
+enum DOMDocumentMode
+html_doctype_document_mode(const InfraString *name, const InfraString *public_id,
+                           const InfraString *system_id, bool force_quirks)
+{
+  uint8_t flags = public_id != NULL ? public_id_flags(public_id) : 0;
+
+  if (force_quirks
+   || name == NULL || strcmp(name->data, "html")
+   || (flags & (PUBLIC_ID_QUIRKS_PREFIX | PUBLIC_ID_QUIRKS_EXACT))
+   || (system_id != NULL
+    && equals_ignore_case(system_id, k_quirky_system_id, sizeof (k_quirky_system_id) - 1))
+   || (system_id == NULL && (flags & PUBLIC_ID_HTML401_PREFIX)))
+    return DOM_DOCUMENT_MODE_QUIRKS;
+
+  if (flags & (PUBLIC_ID_LIMITED_PREFIX | PUBLIC_ID_HTML401_PREFIX))
+    return DOM_DOCUMENT_MODE_LIMITED_QUIRKS;
+
+  return DOM_DOCUMENT_MODE_NO_QUIRKS;
+}
@@ -0,0 +1,17 @@
+#ifndef _html_quirks_h
+#define _html_quirks_h
+
+#include <stdbool.h>
+
+#include <wfs/dom_core.h>
+
+/*
+ * 13.2.6.4.1 The "initial" insertion mode: document mode for a DOCTYPE
+ * token. Pass NULL for a missing public or system identifier.
+ */
+enum DOMDocumentMode html_doctype_document_mode(const InfraString *name,
+                                                const InfraString *public_id,
+                                                const InfraString *system_id,
+                                                bool force_quirks);
+
+#endif /* _html_quirks_h */
@@ -0,0 +1,413 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+#include <wfs/dom.h>
+#include <wfs/dom_core.h>
+#include <wfs/dom_html.h>
+#include <wfs/html.h>
+#include <wfs/html_foreign.h>
+#include <wfs/html_tags.h>
+#include <wfs/infra_arena.h>
+#include <wfs/infra_stack.h>
+#include <wfs/infra_string.h>
+
+#define SERIALIZE_BUFFER_SIZE 4096
+
+struct writer {
+  HTMLSerializeWriteFunc write;
+  void *user_data;
+
+  size_t len;
+  char buf[SERIALIZE_BUFFER_SIZE];
+};
+
+static void
+flush(struct writer *w)
+{
+  if (w->len != 0)
+    w->write(w->user_data, w->buf, w->len);
+
+  w->len = 0;
+}
+
+static void
+put(struct writer *w, const char *ptr, size_t len)
+{
+  if (len > sizeof (w->buf) - w->len) {
+    flush(w);
+
+    if (len >= sizeof (w->buf)) {
+      w->write(w->user_data, ptr, len);
+      return;
+    }
+  }
+
+  memcpy(w->buf + w->len, ptr, len);
+  w->len += len;
+}
+
+#define PUT_LITERAL(w, s) put((w), (s), sizeof (s) - 1)
+
+static void
+put_cstr(struct writer *w, const char *s)
+{
+  put(w, s, strlen(s));
+}
+
+/* START ESCAPING */
+
+/*
+ * 13.3 "Escaping a string": & and U+00A0 always, < and > too (also in
+ * attribute mode), " in attribute mode only. U+00A0 is 0xC2 0xA0 in UTF-8,
+ * so the scan stops at every 0xC2 and the caller checks the next byte.
+ */
+static inline bool
+is_special(unsigned char c, bool attr_mode)
+{
+  return c == '&' || c == '<' || c == '>' || c == 0xC2
+      || (attr_mode && c == '"');
+}
+
+/* Length of the prefix of ptr that needs no escaping */
+static size_t
+scan_plain(const char *ptr, size_t len, bool attr_mode)
+{
+  size_t i = 0;
+
+#ifdef __SSE2__
+  const __m128i amp  = _mm_set1_epi8('&');
+  const __m128i lt   = _mm_set1_epi8('<');
+  const __m128i gt   = _mm_set1_epi8('>');
+  const __m128i nbsp = _mm_set1_epi8((char) 0xC2);
+  const __m128i quot = _mm_set1_epi8(attr_mode ? '"' : '&');
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *) (ptr + i));
+    __m128i hits = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, amp), _mm_cmpeq_epi8(chunk, lt)),
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, gt),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, nbsp), _mm_cmpeq_epi8(chunk, quot))));
+    int mask = _mm_movemask_epi8(hits);
+
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+#endif
+
+  for (; i < len; i++)
+    if (is_special(ptr[i], attr_mode))
+      break;
+
+  return i;
+}
+
+static void
+put_escaped(struct writer *w, const char *ptr, size_t len, bool attr_mode)
+{
+  while (len != 0) {
+    size_t n = scan_plain(ptr, len, attr_mode);
+
+    put(w, ptr, n);
+    ptr += n;
+    len -= n;
+
+    if (len == 0)
+      break;
+
+    switch ((unsigned char) *ptr) {
+      case '&': PUT_LITERAL(w, "&amp;");  break;
+      case '<': PUT_LITERAL(w, "&lt;");   break;
+      case '>': PUT_LITERAL(w, "&gt;");   break;
+      case '"': PUT_LITERAL(w, "&quot;"); break;
+
+      case 0xC2:
+        if (len > 1 && (unsigned char) ptr[1] == 0xA0) {
+          PUT_LITERAL(w, "&nbsp;");
+          ptr++;
+          len--;
+        } else {
+          put(w, ptr, 1);
+        }
+        break;
+    }
+
+    ptr++;
+    len--;
+  }
+}
+
+static void
+put_string_escaped(struct writer *w, const InfraString *string, bool attr_mode)
+{
+  if (string != NULL)
+    put_escaped(w, string->data, string->size, attr_mode);
+}
+
+/* END ESCAPING */
+
+static bool
+is_html(const struct dom_node *node, uint16_t local_name)
+{
+  const struct dom_element *element = (const DOMAny *) node;
+
+  return DOM_IMPLEMENTS(node, element)
+      && element->namespace == INFRA_NAMESPACE_HTML
+      && element->local_name == local_name;
+}
+
+static bool
+is_void_element(const struct dom_element *element)
+{
+  if (element->namespace != INFRA_NAMESPACE_HTML)
+    return false;
+
+  switch (element->local_name) {
+    case HTML_TAG_AREA: case HTML_TAG_BASE: case HTML_TAG_BASEFONT:
+    case HTML_TAG_BGSOUND: case HTML_TAG_BR: case HTML_TAG_COL:
+    case HTML_TAG_EMBED: case HTML_TAG_FRAME: case HTML_TAG_HR:
+    case HTML_TAG_IMG: case HTML_TAG_INPUT: case HTML_TAG_KEYGEN:
+    case HTML_TAG_LINK: case HTML_TAG_META: case HTML_TAG_PARAM:
+    case HTML_TAG_SOURCE: case HTML_TAG_TRACK: case HTML_TAG_WBR:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+/* Text children of these are written verbatim */
+static bool
+has_raw_text(const struct dom_node *node)
+{
+  const struct dom_element *element = (const DOMAny *) node;
+
+  if (node == NULL || !DOM_IMPLEMENTS(node, element)
+   || element->namespace != INFRA_NAMESPACE_HTML)
+    return false;
+
+  switch (element->local_name) {
+    case HTML_TAG_STYLE: case HTML_TAG_SCRIPT: case HTML_TAG_XMP:
+    case HTML_TAG_IFRAME: case HTML_TAG_NOEMBED: case HTML_TAG_NOFRAMES:
+    case HTML_TAG_PLAINTEXT:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+static void
+put_tag_name(struct writer *w, const struct dom_element *element)
+{
+  if (element->local_name == 0) {
+    if (element->uninterned_local_name != NULL)
+      put(w, element->uninterned_local_name->data,
+          element->uninterned_local_name->size);
+    return;
+  }
+
+  switch (element->namespace) {
+    case INFRA_NAMESPACE_HTML:
+      put_cstr(w, k_html_tag_names[element->local_name]);
+      break;
+
+    case INFRA_NAMESPACE_SVG:
+      put_cstr(w, k_svg_tag_names[element->local_name]);
+      break;
+
+    case INFRA_NAMESPACE_MATHML:
+      put_cstr(w, k_mathml_tag_names[element->local_name]);
+      break;
+
+    default:
+      break;
+  }
+}
+
+static void
+put_start_tag(struct writer *w, const struct dom_element *element)
+{
+  PUT_LITERAL(w, "<");
+  put_tag_name(w, element);
+
+  for (uint32_t i = 0; i < element->num_attrs; i++) {
+    const struct dom_attr_slot *attr = &element->attrs[i];
+
+    PUT_LITERAL(w, " ");
+
+    /* prefixes are only ever xlink, xml and xmlns, see HTMLForeignAttr */
+    if (attr->prefix != NULL) {
+      put_cstr(w, attr->prefix);
+      PUT_LITERAL(w, ":");
+    }
+
+    put(w, attr->local_name->data, attr->local_name->size);
+    PUT_LITERAL(w, "=\"");
+    put_string_escaped(w, attr->value, true);
+    PUT_LITERAL(w, "\"");
+  }
+
+  PUT_LITERAL(w, ">");
+}
+
+static void
+put_end_tag(struct writer *w, const struct dom_element *element)
+{
+  PUT_LITERAL(w, "</");
+  put_tag_name(w, element);
+  PUT_LITERAL(w, ">");
+}
+
+/* What node's serialized children come from: itself, or its template contents */
+static struct dom_node *
+children_of(struct dom_node *node)
+{
+  if (is_html(node, HTML_TAG_TEMPLATE)) {
+    struct dom_html_template_element *template = (DOMAny *) node;
+
+    return (struct dom_node *) template->template_contents;
+  }
+
+  return node;
+}
+
+/* Everything but elements */
+static void
+put_leaf(struct writer *w, struct dom_node *node)
+{
+  if (DOM_IMPLEMENTS(node, text)) {
+    size_t len;
+    const char *data = dom_character_data_get((DOMAny *) node, &len);
+
+    if (data == NULL)
+      return;
+
+    if (has_raw_text(node->parent))
+      put(w, data, len);
+    else
+      put_escaped(w, data, len, false);
+  } else if (DOM_IMPLEMENTS(node, comment)) {
+    size_t len;
+    const char *data = dom_character_data_get((DOMAny *) node, &len);
+
+    PUT_LITERAL(w, "<!--");
+    if (data != NULL)
+      put(w, data, len);
+    PUT_LITERAL(w, "-->");
+  } else if (DOM_IMPLEMENTS(node, document_type)) {
+    const InfraString *name = ((struct dom_document_type *) node)->name;
+
+    PUT_LITERAL(w, "<!DOCTYPE ");
+    if (name != NULL)
+      put(w, name->data, name->size);
+    PUT_LITERAL(w, ">");
+  }
+}
+
+/*
+ * Walks by sibling and parent pointers. Template contents have no parent,
+ * so the templates being serialized are kept on a stack to climb back out.
+ */
+static void
+serialize(struct writer *w, struct dom_node *root, bool outer)
+{
+  struct dom_node *top = outer ? NULL : children_of(root);
+  struct dom_node *node = outer ? root : top != NULL ? top->first_child : NULL;
+  InfraStack *templates = NULL;
+
+  while (node != NULL) {
+    if (DOM_IMPLEMENTS(node, element)) {
+      struct dom_element *element = (DOMAny *) node;
+      struct dom_node *children;
+
+      put_start_tag(w, element);
+
+      if (!is_void_element(element)) {
+        children = children_of(node);
+
+        if (children != NULL && children->first_child != NULL) {
+          if (children != node) {
+            if (templates == NULL) {
+              InfraArena *previous = infra_arena_enter(NULL);
+              templates = infra_stack_create();
+              infra_arena_leave(previous);
+            }
+
+            infra_stack_push(templates, node);
+          }
+
+          node = children->first_child;
+          continue;
+        }
+
+        put_end_tag(w, element);
+      }
+    } else {
+      put_leaf(w, node);
+    }
+
+    /* climb until there is a sibling to go on with */
+    for (;;) {
+      struct dom_node *parent;
+
+      if (node == root && outer) {
+        node = NULL;
+        break;
+      }
+
+      if (node->next_sibling != NULL) {
+        node = node->next_sibling;
+        break;
+      }
+
+      parent = node->parent;
+
+      if (parent == top) {
+        node = NULL;
+        break;
+      }
+
+      if (parent == NULL || !DOM_IMPLEMENTS(parent, element))
+        parent = infra_stack_pop(templates);
+
+      put_end_tag(w, (struct dom_element *) parent);
+      node = parent;
+    }
+  }
+
+  if (templates != NULL)
+    infra_stack_free(templates);
+}
+
+void
+html_serialize(struct dom_node *node, bool outer,
+               HTMLSerializeWriteFunc write, void *user_data)
+{
+  struct writer w = { .write = write, .user_data = user_data };
+
+  serialize(&w, node, outer);
+  flush(&w);
+}
+
+static void
+append_to_string(void *user_data, const char *data, size_t len)
+{
+  infra_string_append(user_data, data, len);
+}
+
+void
+html_serialize_inner(struct dom_node *node, InfraString *out)
+{
+  html_serialize(node, false, append_to_string, out);
+}
+
+void
+html_serialize_outer(struct dom_node *node, InfraString *out)
+{
+  html_serialize(node, true, append_to_string, out);
+}
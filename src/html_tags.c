@@ -15,10 +15,13 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include <stddef.h>
+#include <threads.h>
 
 #include <wfs/dom_html.h>
 #include <wfs/html_tags.h>
 
+#include "phash.h"
+
 const char *k_html_tag_names[NUM_HTML_TAG] = {
 
   /* 4.1 The document element */
@@ -354,3 +357,20 @@ const DOMInterface *k_html_element_interfaces[NUM_HTML_TAG] = {
   [HTML_TAG_SPACER]    = DOM_INTERFACE(html_unknown_element),
   [HTML_TAG_TT]        = DOM_INTERFACE(html_element),
 };
+
+static struct phash tag_table =
+  PHASH_INIT(k_html_tag_names, _HTML_TAG_FIRST, NUM_HTML_TAG);
+static once_flag tag_table_once = ONCE_FLAG_INIT;
+
+static void
+build_tag_table(void)
+{
+  phash_build(&tag_table);
+}
+
+uint16_t
+html_tag_lookup(const char *name, size_t len)
+{
+  call_once(&tag_table_once, build_tag_table);
+  return phash_lookup(&tag_table, name, len);
+}
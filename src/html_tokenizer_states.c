@@ -17,7 +17,7 @@ data_state(struct tokenizer *tokenizer, int32_t c)
       return TOKENIZER_STATUS_OK;
 
     case -1:
-      return TOKENIZER_STATUS_EOF;
+      return emit_eof(tokenizer);
 
     default:
       emit_character(tokenizer, c);
@@ -564,7 +564,18 @@ markup_decl_open_state(struct tokenizer *tokenizer, int32_t c)
   }
 
   if (tokenizer_match(tokenizer, S("[CDATA["))) {
-    /* XXX */
+    struct dom_element *node = adjusted_current_node(tokenizer->treebuilder);
+
+    if (node != NULL && node->namespace != INFRA_NAMESPACE_HTML) {
+      tokenizer->state = CDATA_SECTION_STATE;
+      return TOKENIZER_STATUS_OK;
+    }
+
+    tokenizer_error(tokenizer, "cdata-in-html-content");
+    create_comment(tokenizer);
+    for (const char *p = "[CDATA["; *p != '\0'; p++)
+      infra_string_put_char(tokenizer->comment, *p);
+    tokenizer->state = BOGUS_COMMENT_STATE;
     return TOKENIZER_STATUS_OK;
   }
 
@@ -574,7 +585,6 @@ markup_decl_open_state(struct tokenizer *tokenizer, int32_t c)
   return TOKENIZER_STATUS_OK;
 }
 
-#undef S
 
 static enum tokenizer_status
 comment_start_state(struct tokenizer *tokenizer, int32_t c)
@@ -825,6 +835,7 @@ before_doctype_name_state(struct tokenizer *tokenizer, int32_t c)
 {
   if (ascii_is_upper_alpha(c)) {
     create_doctype(tokenizer);
+    tokenizer->doctype.name_missing = false;
     infra_string_put_char(tokenizer->doctype.name, c | 0x20);
     tokenizer->state = DOCTYPE_NAME_STATE;
     return TOKENIZER_STATUS_OK;
@@ -837,6 +848,7 @@ before_doctype_name_state(struct tokenizer *tokenizer, int32_t c)
     case '\0':
       tokenizer_error(tokenizer, "unexpected-null-character");
       create_doctype(tokenizer);
+      tokenizer->doctype.name_missing = false;
       infra_string_put_codepoint(tokenizer->doctype.name, 0xFFFD);
       tokenizer->state = DOCTYPE_NAME_STATE;
       return TOKENIZER_STATUS_OK;
@@ -858,6 +870,7 @@ before_doctype_name_state(struct tokenizer *tokenizer, int32_t c)
 
     default:
       create_doctype(tokenizer);
+      tokenizer->doctype.name_missing = false;
       infra_string_put_codepoint(tokenizer->doctype.name, c);
       tokenizer->state = DOCTYPE_NAME_STATE;
       return TOKENIZER_STATUS_OK;
@@ -898,3 +911,509 @@ doctype_name_state(struct tokenizer *tokenizer, int32_t c)
       return TOKENIZER_STATUS_OK;
   }
 }
+
+static enum tokenizer_status
+after_doctype_name_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case '\t': case '\n': case '\f': case ' ':
+      return TOKENIZER_STATUS_IGNORE;
+
+    case '>':
+      tokenizer->state = DATA_STATE;
+      emit_doctype(tokenizer);
+      return TOKENIZER_STATUS_OK;
+
+    case -1:
+      tokenizer_error(tokenizer, "eof-in-doctype");
+      tokenizer->doctype.force_quirks = true;
+      emit_doctype(tokenizer);
+      return emit_eof(tokenizer);
+
+    case 'P': case 'p':
+      if (tokenizer_matchcase(tokenizer, S("UBLIC"))) {
+        tokenizer->state = AFTER_DOCTYPE_PUBLIC_KEYWORD_STATE;
+        return TOKENIZER_STATUS_OK;
+      }
+      goto anything_else;
+
+    case 'S': case 's':
+      if (tokenizer_matchcase(tokenizer, S("YSTEM"))) {
+        tokenizer->state = AFTER_DOCTYPE_SYSTEM_KEYWORD_STATE;
+        return TOKENIZER_STATUS_OK;
+      }
+      goto anything_else;
+
+anything_else:
+    default:
+      tokenizer_error(tokenizer, "invalid-character-sequence-after-doctype-name");
+      tokenizer->doctype.force_quirks = true;
+      tokenizer->state = BOGUS_DOCTYPE_STATE;
+      return TOKENIZER_STATUS_RECONSUME;
+  }
+}
+
+static enum tokenizer_status
+after_doctype_public_keyword_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case '\t': case '\n': case '\f': case ' ':
+      tokenizer->state = BEFORE_DOCTYPE_PUBLIC_ID_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '\"':
+      tokenizer_error(tokenizer, "missing-whitespace-after-doctype-public-keyword");
+      tokenizer->doctype.public_id_missing = false;
+      tokenizer->state = DOCTYPE_PUBLIC_ID_DOUBLE_QUOTED_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '\'':
+      tokenizer_error(tokenizer, "missing-whitespace-after-doctype-public-keyword");
+      tokenizer->doctype.public_id_missing = false;
+      tokenizer->state = DOCTYPE_PUBLIC_ID_SINGLE_QUOTED_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '>':
+      tokenizer_error(tokenizer, "missing-doctype-public-identifier");
+      tokenizer->doctype.force_quirks = true;
+      tokenizer->state = DATA_STATE;
+      emit_doctype(tokenizer);
+      return TOKENIZER_STATUS_OK;
+
+    case -1:
+      tokenizer_error(tokenizer, "eof-in-doctype");
+      tokenizer->doctype.force_quirks = true;
+      emit_doctype(tokenizer);
+      return emit_eof(tokenizer);
+
+    default:
+      tokenizer_error(tokenizer, "missing-quote-before-doctype-public-identifier");
+      tokenizer->doctype.force_quirks = true;
+      tokenizer->state = BOGUS_DOCTYPE_STATE;
+      return TOKENIZER_STATUS_RECONSUME;
+  }
+}
+
+static enum tokenizer_status
+before_doctype_public_id_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case '\t': case '\n': case '\f': case ' ':
+      return TOKENIZER_STATUS_IGNORE;
+
+    case '\"':
+      tokenizer->doctype.public_id_missing = false;
+      tokenizer->state = DOCTYPE_PUBLIC_ID_DOUBLE_QUOTED_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '\'':
+      tokenizer->doctype.public_id_missing = false;
+      tokenizer->state = DOCTYPE_PUBLIC_ID_SINGLE_QUOTED_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '>':
+      tokenizer_error(tokenizer, "missing-doctype-public-identifier");
+      tokenizer->doctype.force_quirks = true;
+      tokenizer->state = DATA_STATE;
+      emit_doctype(tokenizer);
+      return TOKENIZER_STATUS_OK;
+
+    case -1:
+      tokenizer_error(tokenizer, "eof-in-doctype");
+      tokenizer->doctype.force_quirks = true;
+      emit_doctype(tokenizer);
+      return emit_eof(tokenizer);
+
+    default:
+      tokenizer_error(tokenizer, "missing-quote-before-doctype-public-identifier");
+      tokenizer->doctype.force_quirks = true;
+      tokenizer->state = BOGUS_DOCTYPE_STATE;
+      return TOKENIZER_STATUS_RECONSUME;
+  }
+}
+
+static enum tokenizer_status
+doctype_public_id_double_quoted_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case '\"':
+      tokenizer->state = AFTER_DOCTYPE_PUBLIC_ID_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '\0':
+      tokenizer_error(tokenizer, "unexpected-null-character");
+      infra_string_put_codepoint(tokenizer->doctype.public_id, 0xFFFD);
+      return TOKENIZER_STATUS_OK;
+
+    case '>':
+      tokenizer_error(tokenizer, "abrupt-doctype-public-identifier");
+      tokenizer->doctype.force_quirks = true;
+      tokenizer->state = DATA_STATE;
+      emit_doctype(tokenizer);
+      return TOKENIZER_STATUS_OK;
+
+    case -1:
+      tokenizer_error(tokenizer, "eof-in-doctype");
+      tokenizer->doctype.force_quirks = true;
+      emit_doctype(tokenizer);
+      return emit_eof(tokenizer);
+
+    default:
+      infra_string_put_codepoint(tokenizer->doctype.public_id, c);
+      return TOKENIZER_STATUS_OK;
+  }
+}
+
+static enum tokenizer_status
+doctype_public_id_single_quoted_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case '\'':
+      tokenizer->state = AFTER_DOCTYPE_PUBLIC_ID_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '\0':
+      tokenizer_error(tokenizer, "unexpected-null-character");
+      infra_string_put_codepoint(tokenizer->doctype.public_id, 0xFFFD);
+      return TOKENIZER_STATUS_OK;
+
+    case '>':
+      tokenizer_error(tokenizer, "abrupt-doctype-public-identifier");
+      tokenizer->doctype.force_quirks = true;
+      tokenizer->state = DATA_STATE;
+      emit_doctype(tokenizer);
+      return TOKENIZER_STATUS_OK;
+
+    case -1:
+      tokenizer_error(tokenizer, "eof-in-doctype");
+      tokenizer->doctype.force_quirks = true;
+      emit_doctype(tokenizer);
+      return emit_eof(tokenizer);
+
+    default:
+      infra_string_put_codepoint(tokenizer->doctype.public_id, c);
+      return TOKENIZER_STATUS_OK;
+  }
+}
+
+static enum tokenizer_status
+after_doctype_public_id_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case '\t': case '\n': case '\f': case ' ':
+      tokenizer->state = BETWEEN_DOCTYPE_PUBLIC_SYSTEM_IDS_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '>':
+      tokenizer->state = DATA_STATE;
+      emit_doctype(tokenizer);
+      return TOKENIZER_STATUS_OK;
+
+    case '\"':
+      tokenizer_error(tokenizer, "missing-whitespace-between-doctype-public-and-system-identifiers");
+      tokenizer->doctype.system_id_missing = false;
+      tokenizer->state = DOCTYPE_SYSTEM_ID_DOUBLE_QUOTED_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '\'':
+      tokenizer_error(tokenizer, "missing-whitespace-between-doctype-public-and-system-identifiers");
+      tokenizer->doctype.system_id_missing = false;
+      tokenizer->state = DOCTYPE_SYSTEM_ID_SINGLE_QUOTED_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case -1:
+      tokenizer_error(tokenizer, "eof-in-doctype");
+      tokenizer->doctype.force_quirks = true;
+      emit_doctype(tokenizer);
+      return emit_eof(tokenizer);
+
+    default:
+      tokenizer_error(tokenizer, "missing-quote-before-doctype-system-identifier");
+      tokenizer->doctype.force_quirks = true;
+      tokenizer->state = BOGUS_DOCTYPE_STATE;
+      return TOKENIZER_STATUS_RECONSUME;
+  }
+}
+
+static enum tokenizer_status
+between_doctype_public_system_ids_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case '\t': case '\n': case '\f': case ' ':
+      return TOKENIZER_STATUS_IGNORE;
+
+    case '>':
+      tokenizer->state = DATA_STATE;
+      emit_doctype(tokenizer);
+      return TOKENIZER_STATUS_OK;
+
+    case '\"':
+      tokenizer->doctype.system_id_missing = false;
+      tokenizer->state = DOCTYPE_SYSTEM_ID_DOUBLE_QUOTED_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '\'':
+      tokenizer->doctype.system_id_missing = false;
+      tokenizer->state = DOCTYPE_SYSTEM_ID_SINGLE_QUOTED_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case -1:
+      tokenizer_error(tokenizer, "eof-in-doctype");
+      tokenizer->doctype.force_quirks = true;
+      emit_doctype(tokenizer);
+      return emit_eof(tokenizer);
+
+    default:
+      tokenizer_error(tokenizer, "missing-quote-before-doctype-system-identifier");
+      tokenizer->doctype.force_quirks = true;
+      tokenizer->state = BOGUS_DOCTYPE_STATE;
+      return TOKENIZER_STATUS_RECONSUME;
+  }
+}
+
+static enum tokenizer_status
+after_doctype_system_keyword_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case '\t': case '\n': case '\f': case ' ':
+      tokenizer->state = BEFORE_DOCTYPE_SYSTEM_ID_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '\"':
+      tokenizer_error(tokenizer, "missing-whitespace-after-doctype-system-keyword");
+      tokenizer->doctype.system_id_missing = false;
+      tokenizer->state = DOCTYPE_SYSTEM_ID_DOUBLE_QUOTED_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '\'':
+      tokenizer_error(tokenizer, "missing-whitespace-after-doctype-system-keyword");
+      tokenizer->doctype.system_id_missing = false;
+      tokenizer->state = DOCTYPE_SYSTEM_ID_SINGLE_QUOTED_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '>':
+      tokenizer_error(tokenizer, "missing-doctype-system-identifier");
+      tokenizer->doctype.force_quirks = true;
+      tokenizer->state = DATA_STATE;
+      emit_doctype(tokenizer);
+      return TOKENIZER_STATUS_OK;
+
+    case -1:
+      tokenizer_error(tokenizer, "eof-in-doctype");
+      tokenizer->doctype.force_quirks = true;
+      emit_doctype(tokenizer);
+      return emit_eof(tokenizer);
+
+    default:
+      tokenizer_error(tokenizer, "missing-quote-before-doctype-system-identifier");
+      tokenizer->doctype.force_quirks = true;
+      tokenizer->state = BOGUS_DOCTYPE_STATE;
+      return TOKENIZER_STATUS_RECONSUME;
+  }
+}
+
+static enum tokenizer_status
+before_doctype_system_id_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case '\t': case '\n': case '\f': case ' ':
+      return TOKENIZER_STATUS_IGNORE;
+
+    case '\"':
+      tokenizer->doctype.system_id_missing = false;
+      tokenizer->state = DOCTYPE_SYSTEM_ID_DOUBLE_QUOTED_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '\'':
+      tokenizer->doctype.system_id_missing = false;
+      tokenizer->state = DOCTYPE_SYSTEM_ID_SINGLE_QUOTED_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '>':
+      tokenizer_error(tokenizer, "missing-doctype-system-identifier");
+      tokenizer->doctype.force_quirks = true;
+      tokenizer->state = DATA_STATE;
+      emit_doctype(tokenizer);
+      return TOKENIZER_STATUS_OK;
+
+    case -1:
+      tokenizer_error(tokenizer, "eof-in-doctype");
+      tokenizer->doctype.force_quirks = true;
+      emit_doctype(tokenizer);
+      return emit_eof(tokenizer);
+
+    default:
+      tokenizer_error(tokenizer, "missing-quote-before-doctype-system-identifier");
+      tokenizer->doctype.force_quirks = true;
+      tokenizer->state = BOGUS_DOCTYPE_STATE;
+      return TOKENIZER_STATUS_RECONSUME;
+  }
+}
+
+static enum tokenizer_status
+doctype_system_id_double_quoted_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case '\"':
+      tokenizer->state = AFTER_DOCTYPE_SYSTEM_ID_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '\0':
+      tokenizer_error(tokenizer, "unexpected-null-character");
+      infra_string_put_codepoint(tokenizer->doctype.system_id, 0xFFFD);
+      return TOKENIZER_STATUS_OK;
+
+    case '>':
+      tokenizer_error(tokenizer, "abrupt-doctype-system-identifier");
+      tokenizer->doctype.force_quirks = true;
+      tokenizer->state = DATA_STATE;
+      emit_doctype(tokenizer);
+      return TOKENIZER_STATUS_OK;
+
+    case -1:
+      tokenizer_error(tokenizer, "eof-in-doctype");
+      tokenizer->doctype.force_quirks = true;
+      emit_doctype(tokenizer);
+      return emit_eof(tokenizer);
+
+    default:
+      infra_string_put_codepoint(tokenizer->doctype.system_id, c);
+      return TOKENIZER_STATUS_OK;
+  }
+}
+
+static enum tokenizer_status
+doctype_system_id_single_quoted_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case '\'':
+      tokenizer->state = AFTER_DOCTYPE_SYSTEM_ID_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case '\0':
+      tokenizer_error(tokenizer, "unexpected-null-character");
+      infra_string_put_codepoint(tokenizer->doctype.system_id, 0xFFFD);
+      return TOKENIZER_STATUS_OK;
+
+    case '>':
+      tokenizer_error(tokenizer, "abrupt-doctype-system-identifier");
+      tokenizer->doctype.force_quirks = true;
+      tokenizer->state = DATA_STATE;
+      emit_doctype(tokenizer);
+      return TOKENIZER_STATUS_OK;
+
+    case -1:
+      tokenizer_error(tokenizer, "eof-in-doctype");
+      tokenizer->doctype.force_quirks = true;
+      emit_doctype(tokenizer);
+      return emit_eof(tokenizer);
+
+    default:
+      infra_string_put_codepoint(tokenizer->doctype.system_id, c);
+      return TOKENIZER_STATUS_OK;
+  }
+}
+
+static enum tokenizer_status
+after_doctype_system_id_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case '\t': case '\n': case '\f': case ' ':
+      return TOKENIZER_STATUS_IGNORE;
+
+    case '>':
+      tokenizer->state = DATA_STATE;
+      emit_doctype(tokenizer);
+      return TOKENIZER_STATUS_OK;
+
+    case -1:
+      tokenizer_error(tokenizer, "eof-in-doctype");
+      tokenizer->doctype.force_quirks = true;
+      emit_doctype(tokenizer);
+      return emit_eof(tokenizer);
+
+    default:
+      tokenizer_error(tokenizer, "unexpected-character-after-doctype-system-identifier");
+      tokenizer->state = BOGUS_DOCTYPE_STATE;
+      return TOKENIZER_STATUS_RECONSUME;
+  }
+}
+
+static enum tokenizer_status
+bogus_doctype_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case '>':
+      tokenizer->state = DATA_STATE;
+      emit_doctype(tokenizer);
+      return TOKENIZER_STATUS_OK;
+
+    case '\0':
+      tokenizer_error(tokenizer, "unexpected-null-character");
+      return TOKENIZER_STATUS_IGNORE;
+
+    case -1:
+      emit_doctype(tokenizer);
+      return emit_eof(tokenizer);
+
+    default:
+      return TOKENIZER_STATUS_IGNORE;
+  }
+}
+
+#undef S
+
+/* ... */
+
+static enum tokenizer_status
+cdata_section_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case ']':
+      tokenizer->state = CDATA_SECTION_BRACKET_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    case -1:
+      tokenizer_error(tokenizer, "eof-in-cdata");
+      return emit_eof(tokenizer);
+
+    default:
+      emit_character(tokenizer, c);
+      return TOKENIZER_STATUS_OK;
+  }
+}
+
+static enum tokenizer_status
+cdata_section_bracket_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case ']':
+      tokenizer->state = CDATA_SECTION_END_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    default:
+      emit_character(tokenizer, ']');
+      tokenizer->state = CDATA_SECTION_STATE;
+      return TOKENIZER_STATUS_RECONSUME;
+  }
+}
+
+static enum tokenizer_status
+cdata_section_end_state(struct tokenizer *tokenizer, int32_t c)
+{
+  switch (c) {
+    case ']':
+      emit_character(tokenizer, ']');
+      return TOKENIZER_STATUS_OK;
+
+    case '>':
+      tokenizer->state = DATA_STATE;
+      return TOKENIZER_STATUS_OK;
+
+    default:
+      emit_character(tokenizer, ']');
+      emit_character(tokenizer, ']');
+      tokenizer->state = CDATA_SECTION_STATE;
+      return TOKENIZER_STATUS_RECONSUME;
+  }
+}
@@ -19,28 +19,43 @@ initial_mode(struct treebuilder *treebuilder,
 
   if (token_type == TOKEN_DOCTYPE)
   {
-    if (strcmp("html", token_data->doctype.name->data)
-     || !token_data->doctype.public_id_missing
-     || !token_data->doctype.system_id_missing
-     || strcmp("about:legacy-compat", token_data->doctype.system_id->data))
+    struct doctype *token = &token_data->doctype;
+
+    if (token->name_missing || token->name != atoms[ATOM_HTML]
+     || !token->public_id_missing
+     || (!token->system_id_missing
+      && strcmp("about:legacy-compat", token->system_id->data)))
       treebuilder_error(treebuilder);
 
-    struct doctype *token = &token_data->doctype;
-    struct dom_document_type *doctype = DOM_NEW_OBJECT( document_type );
+    if (treebuilder->sink != NULL) {
+      if (treebuilder->sink->on_doctype != NULL)
+        treebuilder->sink->on_doctype(treebuilder->sink->user_data,
+          token->name_missing ? NULL : token->name->data,
+          token->public_id_missing ? NULL : token->public_id->data,
+          token->system_id_missing ? NULL : token->system_id->data);
+    } else {
+      struct dom_document_type *doctype = DOM_NEW_OBJECT( document_type );
 
-    dom_append_node((struct dom_node *) treebuilder->document, (struct dom_node *) doctype);
+      dom_append_node((struct dom_node *) treebuilder->document, (struct dom_node *) doctype);
 
-    doctype->name      = infra_string_ref(token->name);
-    doctype->public_id = infra_string_ref(token->public_id);
-    doctype->system_id = infra_string_ref(token->system_id);
+      doctype->name      = infra_string_ref(token->name);
+      doctype->public_id = infra_string_ref(token->public_id);
+      doctype->system_id = infra_string_ref(token->system_id);
+    }
 
-    /* XXX Quirky DOCTYPES */
+    /* XXX iframe srcdoc documents */
+    treebuilder->document->mode = html_doctype_document_mode(
+      token->name_missing ? NULL : token->name,
+      token->public_id_missing ? NULL : token->public_id,
+      token->system_id_missing ? NULL : token->system_id,
+      token->force_quirks);
 
     treebuilder->mode = BEFORE_HTML_MODE;
     return TREEBUILDER_STATUS_OK;
   }
 
-  /* XXX parse error */
+  treebuilder_error(treebuilder);
+  treebuilder->document->mode = DOM_DOCUMENT_MODE_QUIRKS;
   treebuilder->mode = BEFORE_HTML_MODE;
   return TREEBUILDER_STATUS_REPROCESS;
 }
@@ -77,9 +92,10 @@ before_html_mode(struct treebuilder *treebuilder,
           (struct dom_html_element *) create_element_for_token(treebuilder,
                                        &token_data->tag, INFRA_NAMESPACE_HTML,
                                        (struct dom_node *) treebuilder->document);
-        dom_append_node((struct dom_node *) treebuilder->document,
-         (struct dom_node *) html);
-        push_open_element(treebuilder, (struct dom_element *) html);
+        insert_node(treebuilder, (struct dom_node *) treebuilder->document,
+         (struct dom_node *) html, NULL);
+        push_open_element(treebuilder, (struct dom_element *) html,
+         &token_data->tag);
 
         treebuilder->mode = BEFORE_HEAD_MODE;
         return TREEBUILDER_STATUS_OK;
@@ -109,9 +125,9 @@ anything_else: {
      dom_create_element_interned(treebuilder->document, HTML_TAG_HTML,
       INFRA_NAMESPACE_HTML, NULL, NULL, false);
 
-    dom_append_node((struct dom_node *) treebuilder->document,
-     (struct dom_node *) html);
-    push_open_element(treebuilder, (struct dom_element *) html);
+    insert_node(treebuilder, (struct dom_node *) treebuilder->document,
+     (struct dom_node *) html, NULL);
+    push_open_element(treebuilder, (struct dom_element *) html, NULL);
 
     treebuilder->mode = BEFORE_HEAD_MODE;
     return TREEBUILDER_STATUS_REPROCESS;
@@ -334,7 +350,7 @@ after_head_mode(struct treebuilder *treebuilder,
 anything_else: {
     insert_html_element(treebuilder, &(struct tag){.localname = HTML_TAG_BODY});
     treebuilder->mode = IN_BODY_MODE;
-    return TREEBUILDER_STATUS_OK;
+    return TREEBUILDER_STATUS_REPROCESS;
   }
 
 }
@@ -379,6 +395,53 @@ in_body_mode(struct treebuilder *treebuilder,
 
   /* ... */
 
+  if (token_type == TOKEN_START_TAG)
+  {
+    switch (token_data->tag.localname)
+    {
+      case FOREIGN_TAG_MATH:
+        /* XXX reconstruct active formatting */
+        adjust_mathml_attrs(&token_data->tag);
+        adjust_foreign_attrs(&token_data->tag);
+        insert_foreign_element(treebuilder, &token_data->tag,
+          INFRA_NAMESPACE_MATHML, false);
+
+        if (token_data->tag.self_closing_fl) {
+          pop_open_element(treebuilder);
+          acknowledge_self_closing_fl(&token_data->tag);
+        }
+
+        return TREEBUILDER_STATUS_OK;
+
+      case FOREIGN_TAG_SVG:
+        /* XXX reconstruct active formatting */
+        adjust_svg_attrs(&token_data->tag);
+        adjust_foreign_attrs(&token_data->tag);
+        insert_foreign_element(treebuilder, &token_data->tag,
+          INFRA_NAMESPACE_SVG, false);
+
+        if (token_data->tag.self_closing_fl) {
+          pop_open_element(treebuilder);
+          acknowledge_self_closing_fl(&token_data->tag);
+        }
+
+        return TREEBUILDER_STATUS_OK;
+
+      case _HTML_TAG_NONE:
+        if (token_data->tag.tagname == atoms[ATOM_IMAGE]) {
+          treebuilder_error(treebuilder);
+          token_data->tag.localname = HTML_TAG_IMG;
+          return TREEBUILDER_STATUS_REPROCESS;
+        }
+        break;
+
+      /* ... */
+
+      default:
+        break;
+    }
+  }
+
   if (token_type == TOKEN_END_TAG)
   {
     switch (token_data->tag.localname)
@@ -469,7 +532,19 @@ after_after_body_mode(struct treebuilder *treebuilder,
                       union token_data *token_data,
                       enum token_type token_type)
 {
-  /* ... */
+  if (token_type == TOKEN_COMMENT)
+  {
+    insert_comment(treebuilder, token_data->comment,
+      (struct insertion_location) { (struct dom_node *) treebuilder->document, NULL });
+    return TREEBUILDER_STATUS_OK;
+  }
+
+  if (token_type == TOKEN_DOCTYPE || token_type == TOKEN_WHITESPACE
+   || (token_type == TOKEN_START_TAG
+    && token_data->tag.localname == HTML_TAG_HTML))
+  {
+    return in_body_mode(treebuilder, token_data, token_type);
+  }
 
   if (token_type == TOKEN_EOF)
   {
@@ -478,7 +553,171 @@ after_after_body_mode(struct treebuilder *treebuilder,
 
   /* anything_else: */ {
     treebuilder_error(treebuilder);
-    abort();
+    treebuilder->mode = IN_BODY_MODE;
     return TREEBUILDER_STATUS_REPROCESS;
   }
 }
+
+/* 13.2.6.5 The rules for parsing tokens in foreign content */
+
+static bool
+is_foreign_breakout_tag(const struct tag *tag)
+{
+  switch (tag->localname) {
+    case HTML_TAG_B: case HTML_TAG_BIG: case HTML_TAG_BLOCKQUOTE:
+    case HTML_TAG_BODY: case HTML_TAG_BR: case HTML_TAG_CENTER:
+    case HTML_TAG_CODE: case HTML_TAG_DD: case HTML_TAG_DIV:
+    case HTML_TAG_DL: case HTML_TAG_DT: case HTML_TAG_EM:
+    case HTML_TAG_EMBED: case HTML_TAG_H1: case HTML_TAG_H2:
+    case HTML_TAG_H3: case HTML_TAG_H4: case HTML_TAG_H5:
+    case HTML_TAG_H6: case HTML_TAG_HEAD: case HTML_TAG_HR:
+    case HTML_TAG_I: case HTML_TAG_IMG: case HTML_TAG_LI:
+    case HTML_TAG_LISTING: case HTML_TAG_MENU: case HTML_TAG_META:
+    case HTML_TAG_NOBR: case HTML_TAG_OL: case HTML_TAG_P:
+    case HTML_TAG_PRE: case HTML_TAG_RUBY: case HTML_TAG_S:
+    case HTML_TAG_SMALL: case HTML_TAG_SPAN: case HTML_TAG_STRONG:
+    case HTML_TAG_STRIKE: case HTML_TAG_SUB: case HTML_TAG_SUP:
+    case HTML_TAG_TABLE: case HTML_TAG_TT: case HTML_TAG_U:
+    case HTML_TAG_UL: case HTML_TAG_VAR:
+      return true;
+
+    case HTML_TAG_FONT:
+      INFRA_STACK_FOREACH(tag->attrs, i) {
+        const struct attr *attr = tag->attrs->items[i];
+
+        if (attr->name == atoms[ATOM_COLOR]
+         || attr->name == atoms[ATOM_FACE]
+         || attr->name == atoms[ATOM_SIZE])
+          return true;
+      }
+      return false;
+
+    default:
+      return false;
+  }
+}
+
+static enum treebuilder_status
+foreign_breakout(struct treebuilder *treebuilder,
+                 union token_data *token_data,
+                 enum token_type token_type)
+{
+  struct dom_element *node;
+
+  treebuilder_error(treebuilder);
+
+  while ((node = current_node(treebuilder)) != NULL
+      && node->namespace != INFRA_NAMESPACE_HTML
+      && !is_mathml_text_integration_point(node)
+      && !is_html_integration_point(node))
+    pop_open_element(treebuilder);
+
+  /* reprocess according to the current insertion mode in HTML content */
+  return k_treebuilder_modes[treebuilder->mode](treebuilder, token_data, token_type);
+}
+
+static enum treebuilder_status
+foreign_content_rules(struct treebuilder *treebuilder,
+                      union token_data *token_data,
+                      enum token_type token_type)
+{
+  if (token_type == TOKEN_CHARACTER)
+  {
+    if (token_data->c == '\0') {
+      treebuilder_error(treebuilder);
+      insert_character(treebuilder, 0xFFFD);
+      return TREEBUILDER_STATUS_OK;
+    }
+
+    insert_character(treebuilder, token_data->c);
+    treebuilder->frameset_ok = false;
+    return TREEBUILDER_STATUS_OK;
+  }
+
+  if (token_type == TOKEN_WHITESPACE)
+  {
+    insert_character(treebuilder, token_data->c);
+    return TREEBUILDER_STATUS_OK;
+  }
+
+  if (token_type == TOKEN_COMMENT)
+  {
+    insert_comment(treebuilder, token_data->comment,
+      (struct insertion_location){0});
+    return TREEBUILDER_STATUS_OK;
+  }
+
+  if (token_type == TOKEN_DOCTYPE)
+  {
+    treebuilder_error(treebuilder);
+    return TREEBUILDER_STATUS_IGNORE;
+  }
+
+  if (token_type == TOKEN_START_TAG)
+  {
+    struct tag *tag = &token_data->tag;
+    enum InfraNamespace namespace;
+
+    if (is_foreign_breakout_tag(tag))
+      return foreign_breakout(treebuilder, token_data, token_type);
+
+    /* any other start tag */
+    namespace = adjusted_current_node(treebuilder)->namespace;
+
+    if (namespace == INFRA_NAMESPACE_MATHML)
+      adjust_mathml_attrs(tag);
+    else if (namespace == INFRA_NAMESPACE_SVG)
+      adjust_svg_attrs(tag);
+
+    adjust_foreign_attrs(tag);
+    insert_foreign_element(treebuilder, tag, namespace, false);
+
+    if (tag->self_closing_fl) {
+      /* XXX SVG script processing */
+      pop_open_element(treebuilder);
+      acknowledge_self_closing_fl(tag);
+    }
+
+    return TREEBUILDER_STATUS_OK;
+  }
+
+  if (token_type == TOKEN_END_TAG)
+  {
+    struct tag *tag = &token_data->tag;
+    struct dom_element *node = current_node(treebuilder);
+    int32_t i = treebuilder->open_elements->size - 1;
+
+    if (tag->localname == HTML_TAG_BR || tag->localname == HTML_TAG_P)
+      return foreign_breakout(treebuilder, token_data, token_type);
+
+    if (node->namespace == INFRA_NAMESPACE_SVG
+     && node->local_name == SVG_TAG_SCRIPT
+     && tag->localname == HTML_TAG_SCRIPT) {
+      /* XXX SVG script processing */
+      pop_open_element(treebuilder);
+      return TREEBUILDER_STATUS_OK;
+    }
+
+    /* any other end tag */
+    if (!element_has_tag_name(node, tag->tagname))
+      treebuilder_error(treebuilder);
+
+    while (i > 0) {
+      if (element_has_tag_name(node, tag->tagname)) {
+        while (pop_open_element(treebuilder) != node)
+          ;
+        return TREEBUILDER_STATUS_OK;
+      }
+
+      node = treebuilder->open_elements->items[--i];
+
+      if (node->namespace == INFRA_NAMESPACE_HTML)
+        return k_treebuilder_modes[treebuilder->mode](treebuilder, token_data,
+                                                      token_type);
+    }
+
+    return TREEBUILDER_STATUS_OK;
+  }
+
+  return TREEBUILDER_STATUS_OK;
+}
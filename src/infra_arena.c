@@ -0,0 +1,228 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include <threads.h>
+
+#include <wfs/infra_arena.h>
+
+#define ARENA_ALIGN       16
+#define ARENA_MAX_SMALL   1024
+#define ARENA_NUM_CLASSES (ARENA_MAX_SMALL / ARENA_ALIGN)
+
+static const size_t k_arena_chunk_size = 64 * 1024;
+
+struct chunk {
+  struct chunk *next;
+  alignas(ARENA_ALIGN) unsigned char data[];
+};
+
+/* blocks above ARENA_MAX_SMALL get their own heap allocation */
+struct large {
+  struct large *prev;
+  struct large *next;
+  alignas(ARENA_ALIGN) unsigned char data[];
+};
+
+struct free_block {
+  struct free_block *next;
+};
+
+struct InfraArena_s {
+  struct chunk *chunks;
+  unsigned char *bump;
+  unsigned char *bump_end;
+
+  struct large *large;
+  struct free_block *free_lists[ARENA_NUM_CLASSES];
+};
+
+static thread_local InfraArena *current_arena;
+
+static inline size_t
+round_size(size_t size)
+{
+  if (size == 0)
+    size = 1;
+
+  return (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+}
+
+InfraArena *
+infra_arena_create(void)
+{
+  InfraArena *arena = malloc(sizeof (*arena));
+  memset(arena, 0, sizeof (*arena));
+
+  return arena;
+}
+
+void
+infra_arena_destroy(InfraArena *arena)
+{
+  struct chunk *chunk = arena->chunks;
+  struct large *large = arena->large;
+
+  while (chunk != NULL) {
+    struct chunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+
+  while (large != NULL) {
+    struct large *next = large->next;
+    free(large);
+    large = next;
+  }
+
+  free(arena);
+}
+
+static void *
+alloc_large(InfraArena *arena, size_t size)
+{
+  struct large *large = malloc(sizeof (*large) + size);
+
+  large->prev = NULL;
+  large->next = arena->large;
+  if (arena->large != NULL)
+    arena->large->prev = large;
+  arena->large = large;
+
+  return large->data;
+}
+
+static void
+free_large(InfraArena *arena, void *ptr)
+{
+  struct large *large = (void *) ((unsigned char *) ptr - offsetof (struct large, data));
+
+  if (large->prev != NULL)
+    large->prev->next = large->next;
+  else
+    arena->large = large->next;
+
+  if (large->next != NULL)
+    large->next->prev = large->prev;
+
+  free(large);
+}
+
+static void *
+alloc_small(InfraArena *arena, size_t size)
+{
+  struct free_block **list = &arena->free_lists[size / ARENA_ALIGN - 1];
+  void *ptr;
+
+  if (*list != NULL) {
+    ptr = *list;
+    *list = (*list)->next;
+    return ptr;
+  }
+
+  if ((size_t) (arena->bump_end - arena->bump) < size) {
+    struct chunk *chunk = malloc(sizeof (*chunk) + k_arena_chunk_size);
+
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+
+    arena->bump = chunk->data;
+    arena->bump_end = chunk->data + k_arena_chunk_size;
+  }
+
+  ptr = arena->bump;
+  arena->bump += size;
+
+  return ptr;
+}
+
+void *
+infra_arena_alloc(InfraArena *arena, size_t size)
+{
+  void *ptr;
+
+  if (arena == NULL)
+    return calloc(1, size);
+
+  size = round_size(size);
+  ptr = size > ARENA_MAX_SMALL
+      ? alloc_large(arena, size)
+      : alloc_small(arena, size);
+
+  memset(ptr, 0, size);
+  return ptr;
+}
+
+void
+infra_arena_free(InfraArena *arena, void *ptr, size_t size)
+{
+  struct free_block *block = ptr;
+
+  if (arena == NULL || ptr == NULL) {
+    free(ptr);
+    return;
+  }
+
+  size = round_size(size);
+
+  if (size > ARENA_MAX_SMALL) {
+    free_large(arena, ptr);
+    return;
+  }
+
+  block->next = arena->free_lists[size / ARENA_ALIGN - 1];
+  arena->free_lists[size / ARENA_ALIGN - 1] = block;
+}
+
+void *
+infra_arena_realloc(InfraArena *arena, void *ptr,
+                    size_t old_size, size_t new_size)
+{
+  void *new_ptr;
+
+  if (arena == NULL) {
+    new_ptr = realloc(ptr, new_size);
+
+    if (new_size > old_size)
+      memset((unsigned char *) new_ptr + old_size, 0, new_size - old_size);
+
+    return new_ptr;
+  }
+
+  /* still fits in the same size class */
+  if (ptr != NULL && round_size(old_size) == round_size(new_size)) {
+    if (new_size > old_size)
+      memset((unsigned char *) ptr + old_size, 0, new_size - old_size);
+
+    return ptr;
+  }
+
+  new_ptr = infra_arena_alloc(arena, new_size);
+
+  if (ptr != NULL) {
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    infra_arena_free(arena, ptr, old_size);
+  }
+
+  return new_ptr;
+}
+
+InfraArena *
+infra_arena_current(void)
+{
+  return current_arena;
+}
+
+InfraArena *
+infra_arena_enter(InfraArena *arena)
+{
+  InfraArena *previous = current_arena;
+
+  current_arena = arena;
+  return previous;
+}
+
+void
+infra_arena_leave(InfraArena *previous)
+{
+  current_arena = previous;
+}
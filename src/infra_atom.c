@@ -0,0 +1,151 @@
+/* 
+ * This file is part of the wfs distribution (https://github.com/lauch788/wfs).
+ * Copyright (c) 2023 Adrien Ricciardi.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <threads.h>
+
+#include <wfs/infra_atom.h>
+
+/*
+ * The table is split into shards picked by the top bits of the hash, each
+ * an open-addressed set behind its own lock, so parsers running on
+ * different threads rarely contend. Atoms are carved out of a per-shard
+ * arena that is never destroyed.
+ */
+#define ATOM_SHARD_BITS 4
+#define ATOM_NUM_SHARDS (1u << ATOM_SHARD_BITS)
+
+static const size_t k_atom_initial_cap = 256;
+
+struct shard {
+  mtx_t lock;
+  InfraAtom **slots;
+  size_t cap; /* power of two */
+  size_t count;
+  InfraArena *arena;
+};
+
+static struct shard shards[ATOM_NUM_SHARDS];
+static once_flag shards_once = ONCE_FLAG_INIT;
+
+static void
+init_shards(void)
+{
+  for (size_t i = 0; i < ATOM_NUM_SHARDS; i++) {
+    mtx_init(&shards[i].lock, mtx_plain);
+    shards[i].arena = infra_arena_create();
+  }
+}
+
+static void
+grow(struct shard *shard)
+{
+  size_t new_cap = shard->cap != 0 ? shard->cap * 2 : k_atom_initial_cap;
+  InfraAtom **new_slots = calloc(new_cap, sizeof (*new_slots));
+
+  for (size_t i = 0; i < shard->cap; i++) {
+    InfraAtom *atom = shard->slots[i];
+    size_t j;
+
+    if (atom == NULL)
+      continue;
+
+    for (j = atom->hash & (new_cap - 1); new_slots[j] != NULL;
+         j = (j + 1) & (new_cap - 1))
+      ;
+
+    new_slots[j] = atom;
+  }
+
+  free(shard->slots);
+  shard->slots = new_slots;
+  shard->cap   = new_cap;
+}
+
+static InfraAtom *
+create_atom(struct shard *shard, const char *ptr, size_t len, uint32_t hash)
+{
+  InfraAtom *atom = infra_arena_alloc(shard->arena, sizeof (*atom));
+
+  if (len < INFRA_STRING_INLINE_CAP) {
+    atom->data = atom->inline_data;
+    atom->cap  = INFRA_STRING_INLINE_CAP;
+  } else {
+    atom->data = infra_arena_alloc(shard->arena, len + 1);
+    atom->cap  = len + 1;
+  }
+
+  memcpy(atom->data, ptr, len);
+  atom->data[len] = '\0';
+
+  atom->refcnt   = 1;
+  atom->size     = len;
+  atom->hash     = hash;
+  atom->has_hash = true;
+  atom->is_atom  = true;
+  atom->arena    = shard->arena;
+
+  return atom;
+}
+
+static InfraAtom *
+intern(const char *ptr, size_t len, uint32_t hash)
+{
+  struct shard *shard;
+  InfraAtom *atom;
+  size_t i;
+
+  call_once(&shards_once, init_shards);
+  shard = &shards[hash >> (32 - ATOM_SHARD_BITS)];
+
+  mtx_lock(&shard->lock);
+
+  /* keep the load factor under one half */
+  if (2 * (shard->count + 1) > shard->cap)
+    grow(shard);
+
+  for (i = hash & (shard->cap - 1); (atom = shard->slots[i]) != NULL;
+       i = (i + 1) & (shard->cap - 1))
+  {
+    if (atom->hash == hash && atom->size == len
+     && !memcmp(atom->data, ptr, len))
+      goto out;
+  }
+
+  atom = create_atom(shard, ptr, len, hash);
+  shard->slots[i] = atom;
+  shard->count++;
+
+out:
+  mtx_unlock(&shard->lock);
+  return atom;
+}
+
+InfraAtom *
+infra_atom_intern(const char *ptr, size_t len)
+{
+  return intern(ptr, len, infra_hash_bytes(ptr, len));
+}
+
+InfraAtom *
+infra_atom_from_string(InfraString *string)
+{
+  if (string->is_atom)
+    return string;
+
+  return intern(string->data, string->size, infra_string_hash(string));
+}
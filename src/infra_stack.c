@@ -1,48 +1,94 @@
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <wfs/infra_stack.h>
 
-static const uint32_t k_stack_grow_step = 4;
-
 InfraStack *
 infra_stack_create(void)
 {
-  InfraStack *stack = malloc(sizeof (*stack));
-  memset(stack, 0, sizeof (*stack));
-
-  uint32_t init_cap = k_stack_grow_step;
-  stack->cap = init_cap;
+  InfraArena *arena = infra_arena_current();
+  InfraStack *stack = infra_arena_alloc(arena, sizeof (*stack));
 
-  void **items = malloc(init_cap * sizeof (void *));
-  memset(items, 0, sizeof (*items) * init_cap);
-  stack->items = items;
+  stack->items = stack->inline_items;
+  stack->cap   = INFRA_STACK_INLINE_CAP;
+  stack->arena = arena;
 
   return stack;
 }
 
+static inline bool
+is_inline(const InfraStack *stack)
+{
+  return stack->items == stack->inline_items;
+}
+
 void
 infra_stack_free(InfraStack *stack)
 {
-  free(stack->items);
-  free(stack);
+  if (!is_inline(stack))
+    infra_arena_free(stack->arena, stack->items, stack->cap * sizeof (void *));
+
+  infra_arena_free(stack->arena, stack, sizeof (*stack));
 }
 
 static void
-maybe_grow(InfraStack *stack, size_t need)
+set_cap(InfraStack *stack, uint32_t new_cap)
 {
-  uint32_t new_size = stack->size + need;
+  void **new_items;
+
+  if (new_cap <= INFRA_STACK_INLINE_CAP) {
+    if (is_inline(stack))
+      return;
 
-  if (new_size >= stack->cap) {
-    uint32_t new_cap = stack->cap + k_stack_grow_step;
-    void **new_items = malloc(new_cap * sizeof (void *));
-    memset(new_items, 0, new_cap * sizeof (void *));
-    stack->cap = new_cap;
+    memcpy(stack->inline_items, stack->items, stack->size * sizeof (void *));
+    infra_arena_free(stack->arena, stack->items, stack->cap * sizeof (void *));
+
+    stack->items = stack->inline_items;
+    stack->cap   = INFRA_STACK_INLINE_CAP;
+    return;
+  }
 
-    memcpy(new_items, stack->items, stack->size);
-    free(stack->items);
-    stack->items = new_items;
+  if (is_inline(stack)) {
+    new_items = infra_arena_alloc(stack->arena, new_cap * sizeof (void *));
+    memcpy(new_items, stack->items, stack->size * sizeof (void *));
+  } else {
+    new_items = infra_arena_realloc(stack->arena, stack->items,
+                                    stack->cap * sizeof (void *),
+                                    new_cap * sizeof (void *));
   }
+
+  stack->items = new_items;
+  stack->cap   = new_cap;
+}
+
+void
+infra_stack_reserve(InfraStack *stack, uint32_t cap)
+{
+  if (cap > stack->cap)
+    set_cap(stack, cap);
+}
+
+void
+infra_stack_shrink_to_fit(InfraStack *stack)
+{
+  if (stack->size < stack->cap)
+    set_cap(stack, stack->size);
+}
+
+static void
+maybe_grow(InfraStack *stack, size_t need)
+{
+  size_t new_size = stack->size + need;
+  size_t new_cap = stack->cap;
+
+  if (new_size <= stack->cap)
+    return;
+
+  while (new_cap < new_size)
+    new_cap *= 2;
+
+  set_cap(stack, new_cap);
 }
 
 void *
@@ -53,6 +99,14 @@ infra_stack_push(InfraStack *stack, void *item)
   return item;
 }
 
+void
+infra_stack_push_n(InfraStack *stack, void *const *items, uint32_t count)
+{
+  maybe_grow(stack, count);
+  memcpy(&stack->items[stack->size], items, count * sizeof (void *));
+  stack->size += count;
+}
+
 void *
 infra_stack_pop(InfraStack *stack)
 {
@@ -61,3 +115,17 @@ infra_stack_pop(InfraStack *stack)
 
   return stack->items[--stack->size];
 }
+
+void
+infra_stack_erase(InfraStack *stack, uint32_t index, uint32_t count)
+{
+  if (index >= stack->size)
+    return;
+
+  if (count > stack->size - index)
+    count = stack->size - index;
+
+  memmove(&stack->items[index], &stack->items[index + count],
+          (stack->size - index - count) * sizeof (void *));
+  stack->size -= count;
+}
@@ -22,48 +22,103 @@
 #include <wfs/infra_string.h>
 
 static void maybe_grow(InfraString *string, size_t need);
-static const uint32_t k_string_grow_step = 4;
 
 InfraString *
 infra_string_create(void)
 {
-  InfraString *string = malloc(sizeof (*string));
-  memset(string, 0, sizeof (*string));
+  InfraArena *arena = infra_arena_current();
+  InfraString *string = infra_arena_alloc(arena, sizeof (*string));
 
-  uint32_t init_cap = k_string_grow_step;
-  char *data = malloc(init_cap);
-  memset(data, 0, init_cap);
-
-  string->data = data;
-  string->cap  = init_cap;
+  string->data  = string->inline_data;
+  string->cap   = INFRA_STRING_INLINE_CAP;
+  string->arena = arena;
 
   return infra_string_ref(string);
 }
 
+static inline bool
+is_inline(const InfraString *string)
+{
+  return string->data == string->inline_data;
+}
+
 void
 infra_string_free(InfraString *string)
 {
-  free(string->data);
-  free(string);
+  if (!is_inline(string))
+    infra_arena_free(string->arena, string->data, string->cap);
+
+  infra_arena_free(string->arena, string, sizeof (*string));
 }
 
+/* cap always leaves room for the terminating NUL */
 static void
-maybe_grow(InfraString *string, size_t need)
+set_cap(InfraString *string, size_t new_cap)
 {
-  size_t newsize = string->size + need;
+  char *new_data;
+
+  if (new_cap <= INFRA_STRING_INLINE_CAP) {
+    if (is_inline(string))
+      return;
 
-  if (newsize >= string->cap) {
-    size_t newcap = string->cap + k_string_grow_step * 4; /* lazy */
-    char *newdata = malloc(newcap);
-    memset(newdata, 0, newcap);
+    memcpy(string->inline_data, string->data, string->size + 1);
+    infra_arena_free(string->arena, string->data, string->cap);
 
-    memcpy(newdata, string->data, string->cap);
-    free(string->data);
+    string->data = string->inline_data;
+    string->cap  = INFRA_STRING_INLINE_CAP;
+    return;
+  }
 
-    string->data = newdata;
-    string->cap = newcap;
+  if (is_inline(string)) {
+    new_data = infra_arena_alloc(string->arena, new_cap);
+    memcpy(new_data, string->data, string->size + 1);
+  } else {
+    new_data = infra_arena_realloc(string->arena, string->data,
+                                   string->cap, new_cap);
   }
 
+  string->data = new_data;
+  string->cap  = new_cap;
+}
+
+static void
+maybe_grow(InfraString *string, size_t need)
+{
+  size_t new_size = string->size + need;
+  size_t new_cap = string->cap;
+
+  if (new_size < string->cap)
+    return;
+
+  while (new_cap <= new_size)
+    new_cap *= 2;
+
+  set_cap(string, new_cap);
+}
+
+void
+infra_string_reserve(InfraString *string, size_t len)
+{
+  if (len >= string->cap)
+    set_cap(string, len + 1);
+}
+
+void
+infra_string_shrink_to_fit(InfraString *string)
+{
+  if (string->size + 1 < string->cap)
+    set_cap(string, string->size + 1);
+}
+
+void
+infra_string_append(InfraString *string, const char *ptr, size_t len)
+{
+  maybe_grow(string, len);
+
+  memcpy(&string->data[string->size], ptr, len);
+  string->size += len;
+  string->data[string->size] = '\0';
+  string->has_hash = false;
 }
 
 void
@@ -71,6 +126,8 @@ infra_string_put_char(InfraString *string, char c)
 {
   maybe_grow(string, 1);
   string->data[string->size++] = c;
+  string->data[string->size] = '\0';
+  string->has_hash = false;
 }
 
 void
@@ -80,8 +137,16 @@ infra_string_put_codepoint(InfraString *string, uint32_t c)
   size_t written;
 
   written = grapheme_encode_utf8(c, enc, sizeof (enc));
-  maybe_grow(string, written);
+  infra_string_append(string, enc, written);
+}
+
+uint32_t
+infra_string_hash(InfraString *string)
+{
+  if (!string->has_hash) {
+    string->hash = infra_hash_bytes(string->data, string->size);
+    string->has_hash = true;
+  }
 
-  memcpy(&string->data[string->size], enc, written);
-  string->size += written;
+  return string->hash;
 }
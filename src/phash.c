@@ -0,0 +1,47 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "phash.h"
+
+static const uint32_t k_phash_max_seeds = 1 << 12;
+
+static int
+try_seed(struct phash *table, uint32_t seed)
+{
+  memset(table->slots, 0, (table->mask + 1) * sizeof (*table->slots));
+
+  for (uint16_t v = table->first; v < table->end; v++) {
+    const char *name = table->names[v];
+    uint32_t slot;
+
+    if (name == NULL)
+      continue;
+
+    slot = phash_hash(seed, name, strlen(name)) & table->mask;
+    if (table->slots[slot] != 0)
+      return 0;
+
+    table->slots[slot] = v;
+  }
+
+  table->seed = seed;
+  return 1;
+}
+
+void
+phash_build(struct phash *table)
+{
+  uint32_t size = 1;
+
+  while (size < 2u * (table->end - table->first))
+    size <<= 1;
+
+  for (;; size <<= 1) {
+    table->mask  = size - 1;
+    table->slots = realloc(table->slots, size * sizeof (*table->slots));
+
+    for (uint32_t seed = 0; seed < k_phash_max_seeds; seed++)
+      if (try_seed(table, seed))
+        return;
+  }
+}
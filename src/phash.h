@@ -0,0 +1,67 @@
+#ifndef _phash_h
+#define _phash_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Perfect hash over a static name list.
+ *
+ * The table is built once (see phash_build()) by searching for a seed
+ * under which no two names share a slot, so a lookup is one hash, one
+ * slot load and one comparison. Hashing and comparison are ASCII
+ * case-insensitive: keys may be stored in their canonical case (e.g.
+ * "foreignObject") and looked up by the tokenizer's lowercased name.
+ */
+struct phash {
+  const char *const *names; /* indexed by value; NULL entries skipped */
+  uint16_t first;
+  uint16_t end;
+
+  uint32_t seed;
+  uint32_t mask;
+  uint16_t *slots; /* value per slot, 0 = empty */
+};
+
+#define PHASH_INIT(names_, first_, end_) \
+  { .names = (names_), .first = (first_), .end = (end_) }
+
+void phash_build(struct phash *table);
+
+static inline uint32_t
+phash_hash(uint32_t seed, const char *s, size_t len)
+{
+  uint32_t h = 2166136261u ^ seed;
+
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = s[i];
+    if (c >= 'A' && c <= 'Z')
+      c |= 0x20;
+    h = (h ^ c) * 16777619u;
+  }
+
+  return h ^ (h >> 15);
+}
+
+static inline uint16_t
+phash_lookup(const struct phash *table, const char *s, size_t len)
+{
+  uint16_t v = table->slots[phash_hash(table->seed, s, len) & table->mask];
+  const char *name;
+
+  if (v == 0)
+    return 0;
+
+  name = table->names[v];
+  for (size_t i = 0; i < len; i++) {
+    unsigned char a = s[i], b = name[i];
+    if (a >= 'A' && a <= 'Z') a |= 0x20;
+    if (b >= 'A' && b <= 'Z') b |= 0x20;
+    if (a != b || b == '\0')
+      return 0;
+  }
+
+  return name[len] == '\0' ? v : 0;
+}
+
+#endif /* _phash_h */
@@ -0,0 +1,160 @@
+/*
+ * Check that queries, and a selector set holding every selector below, find
+ * exactly the elements that dom_selector_matches() accepts, and that a few
+ * selectors find as many as they should, for `make check`. Selectors that
+ * disagree are printed and make the exit status non-zero.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wfs/dom.h>
+#include <wfs/dom_core.h>
+#include <wfs/dom_selector.h>
+#include <wfs/dom_traversal.h>
+#include <wfs/html.h>
+
+/* the parser does not build HTML <div> and <p> yet, so use SVG */
+static const char k_source[] =
+  "<body><svg>"
+  "<g class='a'></g>"
+  "<g class='b'><rect class='c' id='x'></rect></g>"
+  "<g class='d'><g class='b'><rect class='c'></rect></g></g>"
+  "</svg>";
+
+static const char *k_selectors[] = {
+  ".c",
+  ".b .c",
+  ".b > .c",
+  ".a + .b .c",
+  ".a ~ .b > .c",
+  ".a + .b > .c",
+  ".d .b + .c",
+  ".d + .b .c",
+  "svg .a ~ .b .c",
+  "#x#x",
+  "#x#y",
+};
+
+/* (rule, element) pairs from dom_selector_set_match() */
+static void
+push_match(uint32_t rule, struct dom_element *element, void *user_data)
+{
+  infra_stack_push(user_data, (void *) (uintptr_t) rule);
+  infra_stack_push(user_data, element);
+}
+
+static bool
+same_elements(const InfraStack *a, const InfraStack *b)
+{
+  return a->size == b->size
+      && (a->size == 0
+       || memcmp(a->items, b->items, a->size * sizeof (void *)) == 0);
+}
+
+static bool
+check(struct dom_document *document, uint32_t rule, const InfraStack *pairs)
+{
+  const char *text = k_selectors[rule];
+  DOMSelector *selector = dom_selector_compile(text, strlen(text));
+  InfraStack *expected = infra_stack_create();
+  InfraStack *queried = infra_stack_create();
+  InfraStack *set_matched = infra_stack_create();
+  bool ok = true;
+
+  if (selector == NULL) {
+    fprintf(stderr, "%s: does not compile\n", text);
+    exit(1);
+  }
+
+  DOM_FOREACH_PREORDER((struct dom_node *) document, node)
+    if (DOM_IMPLEMENTS(node, element)
+     && dom_selector_matches(selector, (DOMAny *) node))
+      infra_stack_push(expected, node);
+
+  dom_selector_query_all(selector, (struct dom_node *) document, queried);
+
+  for (uint32_t i = 0; i < pairs->size; i += 2)
+    if ((uintptr_t) pairs->items[i] == rule)
+      infra_stack_push(set_matched, pairs->items[i + 1]);
+
+  if (!same_elements(queried, expected)) {
+    fprintf(stderr, "%s: query_all finds %u elements, not %u\n", text,
+            queried->size, expected->size);
+    ok = false;
+  }
+
+  if (!same_elements(set_matched, expected)) {
+    fprintf(stderr, "%s: the set finds %u elements, not %u\n", text,
+            set_matched->size, expected->size);
+    ok = false;
+  }
+
+  infra_stack_free(set_matched);
+  infra_stack_free(queried);
+  infra_stack_free(expected);
+  dom_selector_free(selector);
+
+  return ok;
+}
+
+static bool
+check_count(struct dom_document *document, const char *text, uint32_t count)
+{
+  DOMSelector *selector = dom_selector_compile(text, strlen(text));
+  InfraStack *found = infra_stack_create();
+  bool ok;
+
+  dom_selector_query_all(selector, (struct dom_node *) document, found);
+
+  if (!(ok = found->size == count))
+    fprintf(stderr, "%s: finds %u elements, not %u\n", text, found->size,
+            count);
+
+  infra_stack_free(found);
+  dom_selector_free(selector);
+
+  return ok;
+}
+
+int
+main(void)
+{
+  const uint32_t num_selectors = sizeof (k_selectors) / sizeof (*k_selectors);
+  struct dom_document *document = dom_strong_ref_object(
+    dom_create_document(false));
+  DOMSelectorSet *set = dom_selector_set_create();
+  InfraStack *pairs = infra_stack_create();
+  int status = 0;
+
+  html_parse(document, k_source, sizeof (k_source) - 1);
+
+  for (uint32_t i = 0; i < num_selectors; i++)
+    if (dom_selector_set_add(set, k_selectors[i], strlen(k_selectors[i])) < 0) {
+      fprintf(stderr, "%s: does not compile\n", k_selectors[i]);
+      exit(1);
+    }
+
+  dom_selector_set_match(set, (struct dom_node *) document, push_match, pairs);
+
+  for (uint32_t i = 0; i < num_selectors; i++)
+    if (!check(document, i, pairs))
+      status = 1;
+
+  /* no doctype, so ids ignore case; a repeated id is no different */
+  if (!check_count(document, "#x#x", 1) || !check_count(document, "#X#x", 1)
+   || !check_count(document, "#x#X", 1) || !check_count(document, "#x#y", 0))
+    status = 1;
+
+  document->mode = DOM_DOCUMENT_MODE_NO_QUIRKS;
+
+  if (!check_count(document, "#x#x", 1) || !check_count(document, "#X#x", 0)
+   || !check_count(document, "#x#X", 0))
+    status = 1;
+
+  infra_stack_free(pairs);
+  dom_selector_set_free(set);
+  dom_strong_unref_object(document);
+
+  return status;
+}
@@ -0,0 +1,110 @@
+/*
+ * Parse standard input and print the tree in the html5lib tree-construction
+ * test format ("| " lines), for `make check`. Attributes are printed in
+ * document order rather than sorted.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <wfs/dom.h>
+#include <wfs/dom_core.h>
+#include <wfs/html.h>
+#include <wfs/html_foreign.h>
+#include <wfs/html_tags.h>
+
+static const char *k_prefixes[NUM_INFRA_NAMESPACE] = {
+  [INFRA_NAMESPACE_MATHML] = "math ",
+  [INFRA_NAMESPACE_SVG]    = "svg ",
+  [INFRA_NAMESPACE_XLINK]  = "xlink ",
+  [INFRA_NAMESPACE_XML]    = "xml ",
+  [INFRA_NAMESPACE_XMLNS]  = "xmlns ",
+};
+
+static void
+indent(int depth)
+{
+  printf("| ");
+  for (int i = 0; i < depth; i++)
+    printf("  ");
+}
+
+static const char *
+prefix(enum InfraNamespace namespace)
+{
+  return k_prefixes[namespace] != NULL ? k_prefixes[namespace] : "";
+}
+
+static const char *
+element_name(const struct dom_element *element)
+{
+  if (element->local_name == 0)
+    return element->uninterned_local_name->data;
+
+  switch (element->namespace) {
+    case INFRA_NAMESPACE_SVG:
+      return k_svg_tag_names[element->local_name];
+    case INFRA_NAMESPACE_MATHML:
+      return k_mathml_tag_names[element->local_name];
+    default:
+      return k_html_tag_names[element->local_name];
+  }
+}
+
+static void
+print_node(struct dom_node *node, int depth)
+{
+  size_t len;
+  const char *data;
+
+  if (DOM_IMPLEMENTS(node, element)) {
+    struct dom_element *element = (DOMAny *) node;
+
+    indent(depth);
+    printf("<%s%s>\n", prefix(element->namespace), element_name(element));
+
+    for (uint32_t i = 0; i < element->num_attrs; i++) {
+      const struct dom_attr_slot *attr = &element->attrs[i];
+
+      indent(depth + 1);
+      printf("%s%.*s=\"%.*s\"\n", prefix(attr->namespace),
+             (int) attr->local_name->size, attr->local_name->data,
+             (int) attr->value->size, attr->value->data);
+    }
+  } else if (DOM_IMPLEMENTS(node, document_type)) {
+    struct dom_document_type *doctype = (DOMAny *) node;
+
+    indent(depth);
+    printf("<!DOCTYPE %.*s>\n", doctype->name != NULL ? (int) doctype->name->size : 0,
+           doctype->name != NULL ? doctype->name->data : "");
+  } else if (DOM_IMPLEMENTS(node, comment)) {
+    data = dom_character_data_get((DOMAny *) node, &len);
+    indent(depth);
+    printf("<!-- %.*s -->\n", (int) len, data != NULL ? data : "");
+  } else if (DOM_IMPLEMENTS(node, text)) {
+    data = dom_character_data_get((DOMAny *) node, &len);
+    indent(depth);
+    printf("\"%.*s\"\n", (int) len, data != NULL ? data : "");
+  }
+
+  DOM_NODE_FOREACH_CHILD(node, child)
+    print_node(child, depth + 1);
+}
+
+int
+main(void)
+{
+  static char input[1 << 20];
+  size_t len = fread(input, 1, sizeof (input), stdin);
+  struct dom_document *document = dom_strong_ref_object(
+    dom_create_document(false));
+
+  html_parse(document, input, len);
+
+  printf("#document\n");
+  DOM_NODE_FOREACH_CHILD((struct dom_node *) document, child)
+    print_node(child, 0);
+
+  dom_strong_unref_object(document);
+
+  return 0;
+}
@@ -1,6 +1,7 @@
 #ifndef _LIBWFS_DOM_H
 #define _LIBWFS_DOM_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <inttypes.h>
@@ -9,12 +10,55 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <wfs/infra_arena.h>
+
+/*
+ * Objects of a frozen document (see dom_document_freeze()) may be shared
+ * between threads. By default ref/unref leave their counts alone, so a
+ * frozen object is never freed: the document must be thawed before its
+ * last reference is dropped, or it leaks with everything in it. Built with
+ * WFS_DOM_ATOMIC_REFCNT, the counts are kept atomically instead, so that
+ * any thread may drop the last reference to a frozen document.
+ */
+#ifdef WFS_DOM_ATOMIC_REFCNT
+# define DOM_FROZEN_INC(cnt) __atomic_add_fetch(&(cnt), 1, __ATOMIC_RELAXED)
+# define DOM_FROZEN_DEC(cnt) __atomic_sub_fetch(&(cnt), 1, __ATOMIC_ACQ_REL)
+#else
+# define DOM_FROZEN_INC(cnt) ((void) (cnt))
+# define DOM_FROZEN_DEC(cnt) (cnt)
+#endif
+
+#ifdef WFS_DOM_TRACE
+# include <wfs/dom_trace.h>
+# define DOM_TRACE(event, obj) \
+   dom_trace_event((event), (obj), ((const DOMObject *) (obj))->header.interface, \
+                   ((const DOMObject *) (obj))->header.strong_refcnt)
+#else
+# define DOM_TRACE(event, obj) ((void) 0)
+#endif
+
 typedef struct DOMInterface_s DOMInterface;
 
+/* Deepest interface chain, e.g. EventTarget > Node > Element > HTMLElement > ... */
+#define DOM_MAX_INTERFACE_DEPTH 8
+
+/* Cycle collector state, see wfs/dom_cc.h */
+enum DOMCCColor : uint8_t {
+  DOM_CC_BLACK = 0, /* in use */
+  DOM_CC_GRAY,      /* possible member of a cycle */
+  DOM_CC_WHITE,     /* member of a garbage cycle */
+  DOM_CC_PURPLE,    /* possible root of a cycle */
+  DOM_CC_GARBAGE,   /* being freed by the collector */
+};
+
 typedef struct DOMHeader_s {
   const DOMInterface *interface;
   int_least32_t strong_refcnt;
   int_least32_t weak_refcnt;
+  InfraArena *arena; /* NULL if heap-allocated */
+  uint32_t cc_slot; /* 1 + index in its document's candidate buffer; 0 if none */
+  enum DOMCCColor cc_color;
+  bool frozen;
 } DOMHeader;
 
 typedef struct DOMObject_s {
@@ -22,18 +66,70 @@ typedef struct DOMObject_s {
   /* object-specific data follows here (opaque) */
 } DOMObject;
 
+/* Candidates of the cycle collector, kept per document; see wfs/dom_cc.h */
+struct dom_cc_buffer;
+
+/* Called once per strong edge by a DOMInterface's traverse hook */
+typedef void (*DOMVisitFunc) (DOMObject *target, void *ctx);
+
 typedef struct DOMInterface_s {
   const DOMInterface * parent_interface;
   const char *         name;
   size_t               impl_size;
 
-  void (*finalizer) (DOMObject *obj);
+  /* this interface's and its ancestors', most derived first; see DOM_FINALIZERS() */
+  uint8_t              num_finalizers;
+  void (*finalizers[DOM_MAX_INTERFACE_DEPTH]) (DOMObject *obj);
+
+  /* visit the strong references this interface adds; NULL if none */
+  void (*traverse) (DOMObject *obj, DOMVisitFunc visit, void *ctx);
+
+  /*
+   * Where obj's candidate buffer pointer lives, normally in its document;
+   * NULL if obj is never buffered. Inherited, unlike the hooks above.
+   */
+  struct dom_cc_buffer **(*cc_buffer) (DOMObject *obj);
+
+  /* ancestors[depth] is the interface itself; see DOM_ANCESTRY() */
+  uint8_t              depth;
+  const DOMInterface * ancestors[DOM_MAX_INTERFACE_DEPTH];
 } DOMInterface;
 
 #define DOM_DECLARE_INTERFACE(name) extern const DOMInterface k_dom_ ## name ## _interface
 #define DOM_DEFINE_INTERFACE(name) const DOMInterface k_dom_ ## name ## _interface =
 #define DOM_INTERFACE(name) (& k_dom_ ## name ## _interface)
 
+/*
+ * Fills depth and ancestors in a DOM_DEFINE_INTERFACE() initializer, given
+ * the chain from the root interface down to the one being defined:
+ *   DOM_ANCESTRY(event_target, node, element)
+ */
+#define DOM_ANCESTRY(...) \
+  .depth = DOM_NARGS_(__VA_ARGS__) - 1, \
+  .ancestors = { DOM_CAT_(DOM_MAP_, DOM_NARGS_(__VA_ARGS__))(__VA_ARGS__) }
+
+/*
+ * Fills the flattened finalizer list, most derived first, e.g. for an
+ * element interface: DOM_FINALIZERS(dom_element_finalizer, dom_node_finalizer).
+ * Interfaces with nothing to finalize leave it out.
+ */
+#define DOM_FINALIZERS(...) \
+  .num_finalizers = DOM_NARGS_(__VA_ARGS__), \
+  .finalizers = { __VA_ARGS__ }
+
+#define DOM_CAT_(a, b) DOM_CAT2_(a, b)
+#define DOM_CAT2_(a, b) a ## b
+#define DOM_NARGS_(...) DOM_NARGS2_(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define DOM_NARGS2_(_1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define DOM_MAP_1(a) DOM_INTERFACE(a)
+#define DOM_MAP_2(a, ...) DOM_INTERFACE(a), DOM_MAP_1(__VA_ARGS__)
+#define DOM_MAP_3(a, ...) DOM_INTERFACE(a), DOM_MAP_2(__VA_ARGS__)
+#define DOM_MAP_4(a, ...) DOM_INTERFACE(a), DOM_MAP_3(__VA_ARGS__)
+#define DOM_MAP_5(a, ...) DOM_INTERFACE(a), DOM_MAP_4(__VA_ARGS__)
+#define DOM_MAP_6(a, ...) DOM_INTERFACE(a), DOM_MAP_5(__VA_ARGS__)
+#define DOM_MAP_7(a, ...) DOM_INTERFACE(a), DOM_MAP_6(__VA_ARGS__)
+#define DOM_MAP_8(a, ...) DOM_INTERFACE(a), DOM_MAP_7(__VA_ARGS__)
+
 typedef void DOMAny;
 
 static inline const DOMInterface *
@@ -42,28 +138,81 @@ dom_get_interface(const DOMAny *obj)
   return ((const DOMObject *) obj)->header.interface;
 }
 
+static inline bool
+dom_is_frozen(const DOMAny *obj)
+{
+  return ((const DOMObject *) obj)->header.frozen;
+}
+
 static inline int
 dom_implements_interface(const DOMAny *obj, const DOMInterface *interface)
 {
-  for (const DOMInterface *i = dom_get_interface(obj);
-       i != NULL; i = i->parent_interface)
-    if (i == interface)
-      return 1;
+  const DOMInterface *i = dom_get_interface(obj);
+
+  return (i->depth >= interface->depth
+       && i->ancestors[interface->depth] == interface);
+}
+
+
+/* The nearest cc_buffer hook along obj's interface chain */
+static inline struct dom_cc_buffer **
+dom_cc_buffer_of(DOMObject *obj)
+{
+  const DOMInterface *interface = dom_get_interface(obj);
 
-  return 0;
+  for (uint8_t d = interface->depth + 1; d-- > 0; )
+    if (interface->ancestors[d]->cc_buffer != NULL)
+      return interface->ancestors[d]->cc_buffer(obj);
+
+  return NULL;
 }
 
+/* Candidate buffer maintenance, see src/dom_cc.c */
+void dom_cc_buffer(DOMObject *obj);
+void dom_cc_unbuffer(DOMObject *obj);
+/* Called by the document's finalizer once its tree is gone */
+void dom_cc_release(struct dom_cc_buffer *buffer);
+
+/* Run every traverse hook along obj's interface chain */
+static inline void
+dom_traverse_object(DOMObject *obj, DOMVisitFunc visit, void *ctx)
+{
+  const DOMInterface *interface = dom_get_interface(obj);
+
+  for (uint8_t d = 0; d <= interface->depth; d++)
+    if (interface->ancestors[d]->traverse != NULL)
+      interface->ancestors[d]->traverse(obj, visit, ctx);
+}
+
+/*
+ * A strong count just dropped to a nonzero value, so obj may be the last
+ * way into a cycle. Arena objects go away with their document anyway.
+ */
+static inline void
+dom_cc_possible_root(DOMObject *obj)
+{
+  if (obj->header.arena != NULL || obj->header.frozen)
+    return;
+
+  obj->header.cc_color = DOM_CC_PURPLE;
+
+  if (obj->header.cc_slot == 0)
+    dom_cc_buffer(obj);
+}
 
 static inline DOMAny *
 dom_alloc_object(const DOMInterface *interface)
 {
   /* NO INITIAL ARC REFERENCE! */
+  InfraArena *arena = infra_arena_current();
   DOMObject *obj;
 
-  obj = malloc(interface->impl_size);
-  memset(obj, 0, interface->impl_size);
+  obj = infra_arena_alloc(arena, interface->impl_size);
 
   obj->header.interface = interface;
+  obj->header.arena = arena;
+
+  DOM_TRACE(DOM_TRACE_ALLOC, obj);
 
   return obj;
 }
@@ -71,22 +220,32 @@ dom_alloc_object(const DOMInterface *interface)
 static inline void
 dom_free_object(DOMObject *obj)
 {
-  for (const DOMInterface *i = dom_get_interface(obj);
-       i != NULL; i = i->parent_interface)
-    if (i->finalizer != NULL) { i->finalizer(obj); }
+  const DOMInterface *interface = dom_get_interface(obj);
 
-  free(obj);
+  DOM_TRACE(DOM_TRACE_FREE, obj);
+
+  for (uint8_t i = 0; i < interface->num_finalizers; i++)
+    interface->finalizers[i](obj);
+
+  infra_arena_free(obj->header.arena, obj, interface->impl_size);
 }
 
 static inline DOMAny *
 dom_strong_ref_object(DOMAny *obj)
 {
-  if (obj != NULL) {
-    ((DOMObject *) obj)->header.strong_refcnt++;
-    printf("[DOM Debug]: Referenced %s now has %"PRIdLEAST32" strong references\n",
-     dom_get_interface(obj)->name, ((DOMObject *) obj)->header.strong_refcnt);
+  DOMObject *o = obj;
+
+  if (o == NULL)
+    return obj;
+
+  if (o->header.frozen) {
+    DOM_FROZEN_INC(o->header.strong_refcnt);
+    return obj;
   }
 
+  o->header.strong_refcnt++;
+  DOM_TRACE(DOM_TRACE_REF, o);
+
   return obj;
 }
 
@@ -95,19 +254,59 @@ dom_strong_unref_object(DOMAny *obj)
 {
   DOMObject *o = obj;
 
-  if (o != NULL)
-    printf("[DOM Debug]: Dereferenced %s now had %"PRIdLEAST32" strong references\n",
-     dom_get_interface(obj)->name, ((DOMObject *) obj)->header.strong_refcnt);
+  if (o == NULL)
+    return;
+
+  if (o->header.frozen) {
+    if (DOM_FROZEN_DEC(o->header.strong_refcnt) <= 0)
+      dom_free_object(o);
+    return;
+  }
+
+  --o->header.strong_refcnt;
+  DOM_TRACE(DOM_TRACE_UNREF, o);
+
+  if (o->header.strong_refcnt > 0) {
+    dom_cc_possible_root(o);
+  } else if (o->header.cc_color != DOM_CC_GARBAGE) {
+    if (o->header.cc_slot != 0)
+      dom_cc_unbuffer(o);
 
-  if (o != NULL && --o->header.strong_refcnt <= 0)
     dom_free_object(o);
+  }
+}
+
+/*
+ * Drops a temporary reference to an object that something else keeps
+ * reachable, e.g. the parser's to an element still in the tree. That
+ * cannot leave a garbage cycle behind, so the collector is not told.
+ */
+static inline void
+dom_strong_unref_held_object(DOMAny *obj)
+{
+  DOMObject *o = obj;
+
+  if (o != NULL && !o->header.frozen && o->header.strong_refcnt > 1) {
+    --o->header.strong_refcnt;
+    DOM_TRACE(DOM_TRACE_UNREF, o);
+    return;
+  }
+
+  dom_strong_unref_object(obj);
 }
 
 static inline DOMAny *
 dom_weak_ref_object(DOMAny *obj)
 {
-  if (obj != NULL)
-    ((DOMObject *) obj)->header.weak_refcnt++;
+  DOMObject *o = obj;
+
+  if (o == NULL)
+    return obj;
+
+  if (o->header.frozen)
+    DOM_FROZEN_INC(o->header.weak_refcnt);
+  else
+    o->header.weak_refcnt++;
 
   return obj;
 }
@@ -115,8 +314,15 @@ dom_weak_ref_object(DOMAny *obj)
 static inline void
 dom_weak_unref_object(DOMAny *obj)
 {
-  if (obj != NULL)
-    ((DOMObject *) obj)->header.weak_refcnt--;
+  DOMObject *o = obj;
+
+  if (o == NULL)
+    return;
+
+  if (o->header.frozen)
+    (void) DOM_FROZEN_DEC(o->header.weak_refcnt);
+  else
+    o->header.weak_refcnt--;
 }
 
 /* Only works for interfaces known at compile-type */
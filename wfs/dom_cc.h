@@ -0,0 +1,49 @@
+#ifndef _LIBWFS_DOM_CC_H
+#define _LIBWFS_DOM_CC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <wfs/dom.h>
+
+struct dom_document;
+
+/*
+ * Cycle collector (Bacon & Rajan's trial deletion). Reference counting
+ * frees everything that is not part of a cycle as soon as it becomes
+ * unreachable; an object whose strong count drops to a nonzero value is
+ * buffered as a possible cycle root, and dom_cc_collect() later looks for
+ * garbage cycles through those roots by following the strong references
+ * reported by each interface's traverse hook.
+ *
+ * Candidates are buffered per document, so that like the rest of it they
+ * may move between threads, as long as no two use them at once. Whatever
+ * is still buffered when the document goes away is collected then.
+ * Arena-backed documents are never buffered; their nodes go away with the
+ * arena.
+ */
+
+/* As for HTMLParseBudget, zero fields mean "no limit" */
+typedef struct DOMCollectBudget_s {
+  size_t max_roots;
+  uint64_t max_nsecs;
+} DOMCollectBudget;
+
+enum DOMCollectStatus : uint8_t {
+  DOM_COLLECT_DONE = 0,
+  DOM_COLLECT_YIELDED,
+};
+
+/*
+ * Examines the roots buffered in document a batch at a time until none are
+ * left or the budget runs out; each batch is collected completely, so the
+ * mutator may run freely between calls. The pause is bounded by the batch
+ * size and the size of the graph reachable from it. num_freed may be NULL.
+ */
+enum DOMCollectStatus dom_cc_collect(struct dom_document *document,
+                                     const DOMCollectBudget *budget,
+                                     size_t *num_freed);
+
+size_t dom_cc_num_candidates(const struct dom_document *document);
+
+#endif /* _LIBWFS_DOM_CC_H */
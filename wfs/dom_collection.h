@@ -0,0 +1,56 @@
+#ifndef _LIBWFS_DOM_COLLECTION_H
+#define _LIBWFS_DOM_COLLECTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <wfs/dom.h>
+#include <wfs/dom_core.h>
+#include <wfs/infra_stack.h>
+#include <wfs/infra_string.h>
+
+/*
+ * 4.2.10.2 Interface HTMLCollection. Collections are live but lazy: the
+ * matching elements are gathered on first use and reused until the version
+ * of root's document moves, so a loop over length and item() costs a
+ * single gather. Gathering by tag name from a document merges its tag
+ * lists (see dom_document_elements_by_tag()) instead of walking the tree.
+ *
+ * Collections live on the heap whatever root's document uses, and must be
+ * released before it.
+ */
+DOM_DECLARE_INTERFACE(html_collection);
+struct dom_html_collection {
+  DOMHeader _header;
+
+  struct dom_node *root; // strong reference
+
+  /* by tag name: the qualified name, lowercased, and its interned tags */
+  InfraString *name; /* NULL when matching by class */
+  InfraString *lower_name;
+  uint16_t html_tag;
+  uint16_t svg_tag;
+  uint16_t mathml_tag;
+
+  /* by class: every one of these must be present */
+  InfraStack *class_names; // -> InfraString, owned
+
+  InfraStack *cache; // -> phantom references, in tree order
+  uint64_t cache_version;
+  bool cache_valid;
+};
+
+/* Descendants of root (a document or element); no initial reference */
+struct dom_html_collection *dom_get_elements_by_tag_name(struct dom_node *root,
+                                                         const char *name,
+                                                         size_t len);
+struct dom_html_collection *dom_get_elements_by_class_name(struct dom_node *root,
+                                                           const char *names,
+                                                           size_t len);
+
+uint32_t dom_html_collection_length(struct dom_html_collection *collection);
+/* NULL if out of range */
+struct dom_element *dom_html_collection_item(struct dom_html_collection *collection,
+                                             uint32_t index);
+
+#endif /* _LIBWFS_DOM_COLLECTION_H */
@@ -11,6 +11,8 @@
 struct dom_event_target;
 struct dom_node;
 struct dom_document;
+struct DOMNodeIterator_s;
+struct dom_id_index;
 
 DOM_DECLARE_INTERFACE(event_target);
 struct dom_event_target {
@@ -26,12 +28,110 @@ struct dom_node {
   struct dom_document *node_document; // weak reference
   struct dom_node *parent; // weak reference
 
-  InfraStack *children; // -> strong references
+  /* the parent holds a strong reference to each of its children */
+  struct dom_node *first_child;
+  struct dom_node *last_child;
+  struct dom_node *prev_sibling;
+  struct dom_node *next_sibling;
+  uint32_t num_children;
+
+  /* the root is a document; maintained by dom_insert_node()/dom_remove_node() */
+  bool is_connected;
+  /* has registered mutation observers, see wfs/dom_mutation.h */
+  bool observed;
+  /* the children's child_position values increase along the sibling list */
+  bool children_ordered;
+
+  /* built on demand by dom_node_child_at(); emptied by every mutation */
+  InfraStack *child_index; // -> phantom references
+  /* sorts the node among its siblings, see dom_node_precedes() */
+  uint64_t child_position;
+};
+
+#define DOM_NODE_FOREACH_CHILD(node, child) \
+  for (struct dom_node *child = (node)->first_child; \
+       child != NULL; child = child->next_sibling)
+
+/* Node.nodeType */
+enum DOMNodeType : uint8_t {
+  DOM_ELEMENT_NODE = 1,
+  DOM_ATTRIBUTE_NODE = 2,
+  DOM_TEXT_NODE = 3,
+  DOM_CDATA_SECTION_NODE = 4,
+  DOM_PROCESSING_INSTRUCTION_NODE = 7,
+  DOM_COMMENT_NODE = 8,
+  DOM_DOCUMENT_NODE = 9,
+  DOM_DOCUMENT_TYPE_NODE = 10,
+  DOM_DOCUMENT_FRAGMENT_NODE = 11,
 };
 
+enum DOMNodeType dom_node_type(const struct dom_node *node);
+
+enum DOMDocumentMode : uint8_t {
+  DOM_DOCUMENT_MODE_NO_QUIRKS = 0,
+  DOM_DOCUMENT_MODE_QUIRKS,
+  DOM_DOCUMENT_MODE_LIMITED_QUIRKS,
+};
+
+/*
+ * Parser input that Text and Comment nodes may point into instead of
+ * copying from, such as an mmap()ed file. A document using it holds a
+ * reference, which keeps the bytes alive for as long as its nodes; release,
+ * if set, runs when the last reference goes.
+ */
+typedef struct DOMSource_s {
+  const char *data;
+  size_t len;
+
+  void (*release) (void *user_data, const char *data, size_t len);
+  void *user_data;
+
+  int_least32_t refcnt;
+} DOMSource;
+
+/* Has an initial reference */
+DOMSource *dom_source_create(const char *data, size_t len,
+                             void (*release) (void *, const char *, size_t),
+                             void *user_data);
+DOMSource *dom_source_ref(DOMSource *source);
+void dom_source_unref(DOMSource *source);
+
 DOM_DECLARE_INTERFACE(document);
 struct dom_document {
   struct dom_node _base;
+
+  /*
+   * If set, the document's nodes, strings and stacks all live here and are
+   * released in one go with the document, without finalizing each node.
+   * Nothing allocated from it may outlive the document.
+   */
+  InfraArena *arena;
+
+  enum DOMDocumentMode mode;
+
+  /* live NodeIterators over this document, see wfs/dom_traversal.h */
+  struct DOMNodeIterator_s *node_iterators;
+
+  /* connected elements by id, see dom_document_get_element_by_id() */
+  struct dom_id_index *id_index;
+  /* and by tag, see dom_document_elements_by_tag() */
+  struct dom_tag_index *tag_index;
+  /* last node in tree order, NULL until needed again */
+  struct dom_node *tree_tail;
+
+  /* bumped by every mutation of a node owned by this document */
+  uint64_t version;
+
+  /* see dom_document_set_source() */
+  DOMSource *source;
+
+  /* possible cycle roots among its objects, see wfs/dom_cc.h */
+  struct dom_cc_buffer *cc_buffer;
+
+  /* NULL until the first mutation observer, see wfs/dom_mutation.h */
+  struct dom_mutation_state *mutation;
+  /* set by the parser while it runs */
+  bool parsing;
 };
 
 DOM_DECLARE_INTERFACE(document_type);
@@ -50,14 +150,31 @@ struct dom_document_fragment {
   struct dom_element *host; // strong reference
 };
 
+/*
+ * An attribute as elements store it, inline. The Attr node is only created
+ * when asked for, see dom_element_attribute_node().
+ */
+struct dom_attr_slot {
+  InfraString *local_name; // atom
+  InfraString *value;
+
+  enum InfraNamespace namespace;
+  const char *prefix; // static storage, NULL if none
+
+  struct dom_attr *node; // strong reference, NULL until materialized
+};
+
 DOM_DECLARE_INTERFACE(element);
 struct dom_element {
   struct dom_node _base;
 
-  InfraStack *attrs; // -> strong references
+  struct dom_attr_slot *attrs; // from the element's arena
+  uint32_t num_attrs;
+  uint32_t attrs_cap;
 
-  uint16_t local_name;
+  uint16_t local_name; // interned per namespace; 0 if uninterned
   enum InfraNamespace namespace;
+  InfraString *uninterned_local_name;
 
   uint8_t ce_state;
 };
@@ -68,14 +185,25 @@ struct dom_attr {
 
   struct dom_element *element; // weak reference
   InfraString *local_name;
-  InfraString *value;
+  InfraString *value; // mirrors the slot's while element is set
+
+  enum InfraNamespace namespace;
+  const char *prefix; // static storage, NULL if none
 };
 
 DOM_DECLARE_INTERFACE(character_data);
 struct dom_character_data {
   struct dom_node _base;
 
+  /*
+   * Either data, or a span of the document's source that is copied into
+   * data on the first mutation; read both through dom_character_data_get().
+   */
   InfraString *data;
+  const char *borrowed;
+  size_t borrowed_len;
+  /* while borrowed; a strong reference except in arena documents */
+  DOMSource *source;
 };
 
 DOM_DECLARE_INTERFACE(text);
@@ -88,6 +216,11 @@ struct dom_comment {
   struct dom_character_data _base;
 };
 
+/* Shared with interfaces defined elsewhere, for their DOM_FINALIZERS() */
+void dom_node_finalizer(DOMObject *obj);
+void dom_element_finalizer(DOMObject *obj);
+void dom_character_data_finalizer(DOMObject *obj);
+
 struct dom_node *dom_pre_insert_node(struct dom_node *parent,
                                      struct dom_node *node,
                                      struct dom_node *child);
@@ -99,10 +232,117 @@ void dom_insert_node(struct dom_node *parent,
 
 void dom_append_node(struct dom_node *parent,
                      struct dom_node *node);
+
+void dom_remove_node(struct dom_node *node, bool suppress_observers);
+
+/* Tree order; a and b must share a root */
+bool dom_node_precedes(const struct dom_node *a, const struct dom_node *b);
+
+/* NULL if out of range; O(1) after the first call since the last mutation */
+struct dom_node *dom_node_child_at(struct dom_node *node, uint32_t index);
+/* No initial reference, like dom_alloc_object() */
+struct dom_document *dom_create_document(bool arena_backed);
+
+/*
+ * Make document and everything it strongly references read-only, so that
+ * any number of threads may read it at once; see DOM_FROZEN_INC() in
+ * wfs/dom.h for what happens to reference counts. Mutating a frozen node
+ * aborts. Strings are shared as-is: borrow them, don't ref them.
+ * dom_document_thaw() undoes this once the readers are gone.
+ *
+ * Without WFS_DOM_ATOMIC_REFCNT, frozen objects ignore unrefs and are
+ * never freed: thaw the document before dropping the last reference to
+ * it, or it silently leaks.
+ */
+void dom_document_freeze(struct dom_document *document);
+void dom_document_thaw(struct dom_document *document);
+
+/*
+ * First connected element in tree order whose id is id, in O(1). The index
+ * follows dom_insert_node(), dom_remove_node() and the attribute functions
+ * below; code adding attributes otherwise must do so before insertion.
+ */
+struct dom_element *dom_document_get_element_by_id(struct dom_document *document,
+                                                   const char *id, size_t len);
+
+/*
+ * Connected elements with interned local_name in namespace, in tree order,
+ * or NULL if there are none; local_name 0 lists the uninterned ones.
+ * Elements in any other namespace share a single list. Kept up to date
+ * like the id index, so the stack is only good until the next mutation.
+ */
+InfraStack *dom_document_elements_by_tag(struct dom_document *document,
+                                         enum InfraNamespace namespace,
+                                         uint16_t local_name);
+
+/*
+ * Let the parser borrow Text and Comment data from source when parsing from
+ * within source->data. Once per document, before parsing; the document
+ * takes its own reference.
+ */
+void dom_document_set_source(struct dom_document *document,
+                             DOMSource *source);
+
+/* NULL and a zero length when empty; not NUL-terminated if borrowed */
+const char *dom_character_data_get(const struct dom_character_data *cd,
+                                   size_t *len);
+void dom_character_data_set(struct dom_character_data *cd,
+                            const char *data, size_t len);
+/* Extends a borrowed span in place when data directly follows it */
+void dom_character_data_append(struct dom_character_data *cd,
+                               const char *data, size_t len);
+/*
+ * Point empty cd at data, which lies within source. Heap nodes can outlive
+ * their document, so they take their own reference to source.
+ */
+void dom_character_data_borrow(struct dom_character_data *cd,
+                               DOMSource *source,
+                               const char *data, size_t len);
+
+/*
+ * Attributes in no namespace, by local name. On arena documents, values
+ * (and the uninterned names given to dom_create_element()) that live
+ * elsewhere are copied into the arena, so callers keep ownership of theirs.
+ */
+InfraString *dom_element_get_attribute(const struct dom_element *element,
+                                       const char *name, size_t len);
+void dom_element_set_attribute(struct dom_element *element,
+                               InfraString *name, InfraString *value);
+bool dom_element_remove_attribute(struct dom_element *element,
+                                  const char *name, size_t len);
+
+/*
+ * The Attr node for element->attrs[index], created on first use and owned
+ * by the element until the attribute goes away; NULL if out of range.
+ * Readers of a frozen document may call it from any thread.
+ */
+struct dom_attr *dom_element_attribute_node(struct dom_element *element,
+                                            uint32_t index);
+struct dom_attr *dom_element_get_attribute_node(struct dom_element *element,
+                                                const char *name, size_t len);
+
+/*
+ * Append an attribute without looking for an existing one, for the parser
+ * and loaders; see dom_document_get_element_by_id() on when. local_name must
+ * be an atom; both strings gain a reference, or value is copied as above.
+ */
+void dom_element_reserve_attributes(struct dom_element *element,
+                                    uint32_t count);
+void dom_element_append_attribute(struct dom_element *element,
+                                  InfraString *local_name, InfraString *value,
+                                  enum InfraNamespace namespace,
+                                  const char *prefix);
+
 struct dom_element *dom_create_element_interned(struct dom_document *document,
                                                 uint16_t local_name,
                                                 enum InfraNamespace namespace,
                                                 const void *prefix,
                                                 const void *is,
                                                 bool sync_custom_elements);
+struct dom_element *dom_create_element(struct dom_document *document,
+                                       InfraString *local_name,
+                                       enum InfraNamespace namespace,
+                                       const void *prefix,
+                                       const void *is,
+                                       bool sync_custom_elements);
 #endif /* _LIBWFS_DOM_CORE_H */
@@ -130,6 +130,18 @@ struct dom_html_span_element {
 /* 4.8 Embedded content */
 /* ... */
 
+/* 4.8.15 MathML */
+DOM_DECLARE_INTERFACE(mathml_element);
+struct dom_mathml_element {
+  struct dom_element _base;
+};
+
+/* 4.8.16 SVG */
+DOM_DECLARE_INTERFACE(svg_element);
+struct dom_svg_element {
+  struct dom_element _base;
+};
+
 /* 4.9 Tabular data */
 DOM_DECLARE_INTERFACE(html_table_element);
 struct dom_html_table_element {
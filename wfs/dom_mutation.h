@@ -0,0 +1,104 @@
+#ifndef _LIBWFS_DOM_MUTATION_H
+#define _LIBWFS_DOM_MUTATION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <wfs/dom_core.h>
+#include <wfs/infra_stack.h>
+#include <wfs/infra_string.h>
+
+/*
+ * 4.3 Mutation observers. Records come from a pool kept by the document
+ * and wait on their observers until dom_mutation_checkpoint(), which
+ * stands in for the microtask checkpoint: each observer gets all of its
+ * records in one call. Until then, a record that continues the observer's
+ * last one is merged into it: children inserted or removed next to the
+ * last ones join its lists, and repeated changes to the same attribute or
+ * data keep the first old value.
+ *
+ * Records made while the parser runs are flagged, and only reach
+ * observers that ask for them with DOM_OBSERVE_PARSER; with none asking,
+ * parsing costs one test per mutation. html_parse() and each
+ * html_parser_run() end with a checkpoint.
+ *
+ * Unlike the spec, there are no transient observers: a removed subtree is
+ * no longer seen through its old ancestors. Observers live on the heap and
+ * must be freed before their document.
+ */
+
+/* MutationObserverInit, as a mask; attributeFilter is not supported */
+#define DOM_OBSERVE_CHILD_LIST              (1u << 0)
+#define DOM_OBSERVE_ATTRIBUTES              (1u << 1)
+#define DOM_OBSERVE_CHARACTER_DATA          (1u << 2)
+#define DOM_OBSERVE_SUBTREE                 (1u << 3)
+#define DOM_OBSERVE_ATTRIBUTE_OLD_VALUE     (1u << 4)
+#define DOM_OBSERVE_CHARACTER_DATA_OLD_VALUE (1u << 5)
+#define DOM_OBSERVE_PARSER                  (1u << 6)
+
+enum DOMMutationType : uint8_t {
+  DOM_MUTATION_CHILD_LIST,
+  DOM_MUTATION_ATTRIBUTES,
+  DOM_MUTATION_CHARACTER_DATA,
+};
+
+/* 4.3.5 Interface MutationRecord; only valid during delivery */
+typedef struct DOMMutationRecord_s {
+  enum DOMMutationType type;
+  bool by_parser;
+
+  struct dom_node *target; // strong reference
+  InfraStack *added_nodes; // -> strong references
+  InfraStack *removed_nodes; // -> strong references
+  struct dom_node *previous_sibling; // strong reference
+  struct dom_node *next_sibling; // strong reference
+
+  InfraString *attribute_name; // atom
+  InfraString *old_value; /* NULL unless asked for */
+} DOMMutationRecord;
+
+typedef struct DOMMutationObserver_s DOMMutationObserver;
+
+typedef void (*DOMMutationCallback) (DOMMutationObserver *observer,
+                                     DOMMutationRecord *const *records,
+                                     uint32_t num_records, void *user_data);
+
+DOMMutationObserver *dom_mutation_observer_create(struct dom_document *document,
+                                                  DOMMutationCallback callback,
+                                                  void *user_data);
+/* Drops pending records; not from the observer's own callback */
+void dom_mutation_observer_free(DOMMutationObserver *observer);
+
+/*
+ * 4.3.3 observe(); observing target again replaces its options. target
+ * must belong to the observer's document and stays alive until disconnect.
+ */
+void dom_mutation_observer_observe(DOMMutationObserver *observer,
+                                   struct dom_node *target, uint32_t options);
+/* Also drops pending records */
+void dom_mutation_observer_disconnect(DOMMutationObserver *observer);
+
+/* "notify mutation observers"; does nothing when called from a callback */
+void dom_mutation_checkpoint(struct dom_document *document);
+
+/*
+ * Called by dom_core.c when document->mutation is set, before the change
+ * for attributes and data (so old values can be copied) and after it for
+ * children.
+ */
+void dom_mutation_queue_child_list(struct dom_document *document,
+                                   struct dom_node *target,
+                                   struct dom_node *added,
+                                   struct dom_node *removed,
+                                   struct dom_node *previous_sibling,
+                                   struct dom_node *next_sibling);
+void dom_mutation_queue_attribute(struct dom_document *document,
+                                  struct dom_element *element,
+                                  InfraString *name, InfraString *old_value);
+void dom_mutation_queue_character_data(struct dom_document *document,
+                                       struct dom_character_data *cd);
+/* Called by the document's finalizer */
+void dom_mutation_release(struct dom_document *document);
+
+#endif /* _LIBWFS_DOM_MUTATION_H */
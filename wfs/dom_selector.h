@@ -0,0 +1,70 @@
+#ifndef _LIBWFS_DOM_SELECTOR_H
+#define _LIBWFS_DOM_SELECTOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <wfs/dom_core.h>
+#include <wfs/infra_stack.h>
+
+/*
+ * Selectors Level 4, as far as static documents need it: type, universal,
+ * #id, .class and attribute selectors (all operators and the i/s flags),
+ * the four combinators, selector lists, :root, :empty, the *-child and
+ * *-of-type pseudo-classes with an+b, and :not(), :is() and :where().
+ * Namespace prefixes, pseudo-elements and anything stateful are rejected.
+ *
+ * Compilation resolves names to tag ids and atoms once. Matching runs
+ * right to left; queries also keep a Bloom filter of the tags, ids and
+ * classes above the current node, so that most candidates failing a
+ * descendant or child combinator are dropped without climbing the tree.
+ */
+typedef struct DOMSelector_s DOMSelector;
+
+/* NULL on syntax errors and unsupported selectors */
+DOMSelector *dom_selector_compile(const char *text, size_t len);
+void dom_selector_free(DOMSelector *selector);
+
+bool dom_selector_matches(const DOMSelector *selector,
+                          struct dom_element *element);
+
+/* First matching descendant of root in tree order, or NULL */
+struct dom_element *dom_selector_query(const DOMSelector *selector,
+                                       struct dom_node *root);
+/* Append all matching descendants of root to out, in tree order */
+void dom_selector_query_all(const DOMSelector *selector, struct dom_node *root,
+                            InfraStack *out);
+
+/* One-off versions of the above; false if selectors does not compile */
+bool dom_query_selector(struct dom_node *root, const char *selectors,
+                        size_t len, struct dom_element **result);
+bool dom_query_selector_all(struct dom_node *root, const char *selectors,
+                            size_t len, InfraStack *out);
+
+/*
+ * Many selector lists ("rules") matched in one walk. Each complex selector
+ * is filed under one feature of its rightmost compound (id, class, type or
+ * attribute name), so an element is only tested against the rules that
+ * could match it, and all of them share a single ancestor filter.
+ */
+typedef struct DOMSelectorSet_s DOMSelectorSet;
+
+typedef void (*DOMSelectorMatchFunc) (uint32_t rule,
+                                      struct dom_element *element,
+                                      void *user_data);
+
+DOMSelectorSet *dom_selector_set_create(void);
+void dom_selector_set_free(DOMSelectorSet *set);
+/* The new rule's number, counting from 0; -1 if text does not compile */
+int32_t dom_selector_set_add(DOMSelectorSet *set, const char *text, size_t len);
+uint32_t dom_selector_set_num_rules(const DOMSelectorSet *set);
+
+/*
+ * Call match once for each rule and each descendant of root it matches.
+ * Elements come in tree order; the rules for one element in no set order.
+ */
+void dom_selector_set_match(const DOMSelectorSet *set, struct dom_node *root,
+                            DOMSelectorMatchFunc match, void *user_data);
+
+#endif /* _LIBWFS_DOM_SELECTOR_H */
@@ -0,0 +1,119 @@
+#ifndef _LIBWFS_DOM_SNAPSHOT_H
+#define _LIBWFS_DOM_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <wfs/dom_core.h>
+
+/*
+ * Binary snapshots of a parsed document. A snapshot is a flat,
+ * position-independent image: a header, one DOMSnapNode per node in
+ * preorder, the attributes of all elements and a deduplicated string
+ * table. Records refer to each other by index and to strings by byte
+ * offset, so a snapshot can be mmap()ed and walked in place without
+ * allocating anything, and only the subtrees actually needed turned
+ * back into live dom_* objects.
+ *
+ * Snapshots use the host's byte order and the library's tag tables;
+ * dom_snapshot_open() rejects those written by an incompatible build.
+ * Beyond the header, contents are trusted: only open files you wrote.
+ */
+
+#define DOM_SNAPSHOT_VERSION 1
+
+/* Node 0 is always the document, so 0 doubles as "no such node" */
+#define DOM_SNAP_NONE 0
+
+enum DOMSnapKind : uint8_t {
+  DOM_SNAP_DOCUMENT = 0,
+  DOM_SNAP_DOCUMENT_TYPE,
+  DOM_SNAP_DOCUMENT_FRAGMENT,
+  DOM_SNAP_ELEMENT,
+  DOM_SNAP_TEXT,
+  DOM_SNAP_COMMENT,
+};
+
+/* String fields are offsets into the string table, 0 for NULL */
+typedef struct DOMSnapNode_s {
+  uint8_t kind; /* enum DOMSnapKind */
+  uint8_t namespace; /* enum InfraNamespace, elements only */
+  uint16_t local_name; /* as in struct dom_element */
+
+  uint32_t parent;
+  uint32_t next_sibling;
+  uint32_t num_children; /* the first child, if any, is the next record */
+  uint32_t subtree_end; /* one past the last record of this subtree */
+  uint32_t content; /* template contents; a fragment inside this subtree */
+
+  /* uninterned local name, character data, or doctype name */
+  uint32_t data;
+
+  union {
+    struct {
+      uint32_t first_attr;
+      uint32_t num_attrs;
+    } element;
+
+    struct {
+      uint32_t public_id;
+      uint32_t system_id;
+    } doctype;
+  };
+} DOMSnapNode;
+
+typedef struct DOMSnapAttr_s {
+  uint32_t local_name;
+  uint32_t value;
+  uint32_t prefix;
+  uint8_t namespace; /* enum InfraNamespace */
+  uint8_t _pad[3];
+} DOMSnapAttr;
+
+typedef struct DOMSnapshot_s DOMSnapshot;
+
+/*
+ * Serialize document into a malloc()ed buffer of *len bytes. Returns NULL
+ * if the tree holds something snapshots cannot express.
+ */
+void *dom_snapshot_build(struct dom_document *document, size_t *len);
+/* Same, straight to path; false on I/O errors */
+bool dom_snapshot_save(struct dom_document *document, const char *path);
+
+/*
+ * View data in place; it must stay valid (and 8-byte aligned) until
+ * dom_snapshot_close(). dom_snapshot_map() maps path read-only instead.
+ * Both return NULL if the image is truncated or incompatible.
+ */
+DOMSnapshot *dom_snapshot_open(const void *data, size_t len);
+DOMSnapshot *dom_snapshot_map(const char *path);
+void dom_snapshot_close(DOMSnapshot *snapshot);
+
+uint32_t dom_snapshot_num_nodes(const DOMSnapshot *snapshot);
+enum DOMDocumentMode dom_snapshot_mode(const DOMSnapshot *snapshot);
+const DOMSnapNode *dom_snapshot_node(const DOMSnapshot *snapshot,
+                                     uint32_t index);
+const DOMSnapAttr *dom_snapshot_attrs(const DOMSnapshot *snapshot,
+                                      const DOMSnapNode *node);
+/* NUL-terminated; NULL for offset 0. len may be NULL */
+const char *dom_snapshot_string(const DOMSnapshot *snapshot, uint32_t offset,
+                                size_t *len);
+
+static inline uint32_t
+dom_snap_first_child(const DOMSnapNode *node, uint32_t index)
+{
+  return node->num_children != 0 ? index + 1 : DOM_SNAP_NONE;
+}
+
+/*
+ * Build live nodes for the subtree at index, owned by document (and its
+ * arena, if any). Index 0 fills document itself and returns it; anything
+ * else returns a new parentless node with no initial reference, like
+ * dom_alloc_object(). Each call makes a fresh copy.
+ */
+struct dom_node *dom_snapshot_materialize(const DOMSnapshot *snapshot,
+                                          struct dom_document *document,
+                                          uint32_t index);
+
+#endif /* _LIBWFS_DOM_SNAPSHOT_H */
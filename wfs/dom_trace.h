@@ -0,0 +1,65 @@
+#ifndef _LIBWFS_DOM_TRACE_H
+#define _LIBWFS_DOM_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Reference count instrumentation. The hooks in <wfs/dom.h> are only
+ * compiled in when WFS_DOM_TRACE is defined (see config.mk); otherwise
+ * they cost nothing and the queries below report no activity.
+ */
+
+typedef struct DOMInterface_s DOMInterface;
+
+enum DOMTraceEvent : uint8_t {
+  DOM_TRACE_ALLOC = 0,
+  DOM_TRACE_FREE,
+  DOM_TRACE_REF,
+  DOM_TRACE_UNREF,
+
+  NUM_DOM_TRACE_EVENTS
+};
+
+/* Counted per concrete interface, i.e. the one the object was allocated with */
+typedef struct DOMTraceStats_s {
+  uint64_t allocs;
+  uint64_t frees;
+  uint64_t refs;
+  uint64_t unrefs;
+  uint64_t live;
+  uint64_t peak_live;
+} DOMTraceStats;
+
+typedef struct DOMTraceRecord_s {
+  const DOMInterface *interface;
+  const void *object;
+  int_least32_t strong_refcnt; /* after the event */
+  enum DOMTraceEvent event;
+} DOMTraceRecord;
+
+void dom_trace_event(enum DOMTraceEvent event, const void *object,
+                     const DOMInterface *interface, int_least32_t strong_refcnt);
+
+/* Returns false if the interface has never been seen */
+bool dom_trace_get_stats(const DOMInterface *interface, DOMTraceStats *stats);
+void dom_trace_foreach_stats(void (*cb) (const DOMInterface *interface,
+                                         const DOMTraceStats *stats,
+                                         void *user_data),
+                             void *user_data);
+void dom_trace_reset(void);
+
+/*
+ * Keep the last `capacity` events in a ring buffer (0 turns it off again).
+ * Recording is off by default, counters are always kept.
+ */
+void dom_trace_ring_start(size_t capacity);
+size_t dom_trace_ring_read(DOMTraceRecord *records, size_t max);
+
+/* Human-readable dumps; one line per interface / event */
+void dom_trace_dump_stats(FILE *fp);
+void dom_trace_dump_ring(FILE *fp);
+
+#endif /* _LIBWFS_DOM_TRACE_H */
@@ -0,0 +1,161 @@
+#ifndef _LIBWFS_DOM_TRAVERSAL_H
+#define _LIBWFS_DOM_TRAVERSAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <wfs/dom_core.h>
+
+/*
+ * Iterative tree walks over parent and sibling links. Nothing here
+ * allocates or recurses, so any depth is fine. All walks stay within root
+ * (inclusive); none of them take references.
+ */
+
+static inline struct dom_node *
+dom_next_preorder_skipping_children(const struct dom_node *node,
+                                    const struct dom_node *root)
+{
+  for (; node != NULL && node != root; node = node->parent)
+    if (node->next_sibling != NULL)
+      return node->next_sibling;
+
+  return NULL;
+}
+
+/* Tree order ("following") */
+static inline struct dom_node *
+dom_next_preorder(const struct dom_node *node, const struct dom_node *root)
+{
+  if (node->first_child != NULL)
+    return node->first_child;
+
+  return dom_next_preorder_skipping_children(node, root);
+}
+
+/* Reverse tree order ("preceding"); NULL past root */
+static inline struct dom_node *
+dom_prev_preorder(const struct dom_node *node, const struct dom_node *root)
+{
+  struct dom_node *prev;
+
+  if (node == root)
+    return NULL;
+
+  if ((prev = node->prev_sibling) == NULL)
+    return node->parent;
+
+  while (prev->last_child != NULL)
+    prev = prev->last_child;
+
+  return prev;
+}
+
+static inline struct dom_node *
+dom_first_postorder(const struct dom_node *root)
+{
+  while (root->first_child != NULL)
+    root = root->first_child;
+
+  return (struct dom_node *) root;
+}
+
+/* Children before their parent; root comes last */
+static inline struct dom_node *
+dom_next_postorder(const struct dom_node *node, const struct dom_node *root)
+{
+  if (node == root)
+    return NULL;
+
+  if (node->next_sibling != NULL)
+    return dom_first_postorder(node->next_sibling);
+
+  return node->parent;
+}
+
+#define DOM_FOREACH_PREORDER(root, node) \
+  for (struct dom_node *node = (struct dom_node *) (root); \
+       node != NULL; node = dom_next_preorder(node, (root)))
+
+#define DOM_FOREACH_POSTORDER(root, node) \
+  for (struct dom_node *node = dom_first_postorder((root)); \
+       node != NULL; node = dom_next_postorder(node, (root)))
+
+/* 6.3 Interface NodeFilter */
+enum DOMFilterResult : uint8_t {
+  DOM_FILTER_ACCEPT = 1,
+  DOM_FILTER_REJECT,
+  DOM_FILTER_SKIP,
+};
+
+/* whatToShow: 1 << (nodeType - 1) */
+#define DOM_SHOW_ALL                    0xFFFFFFFFu
+#define DOM_SHOW_ELEMENT                (1u << (DOM_ELEMENT_NODE - 1))
+#define DOM_SHOW_TEXT                   (1u << (DOM_TEXT_NODE - 1))
+#define DOM_SHOW_COMMENT                (1u << (DOM_COMMENT_NODE - 1))
+#define DOM_SHOW_DOCUMENT               (1u << (DOM_DOCUMENT_NODE - 1))
+#define DOM_SHOW_DOCUMENT_TYPE          (1u << (DOM_DOCUMENT_TYPE_NODE - 1))
+#define DOM_SHOW_DOCUMENT_FRAGMENT      (1u << (DOM_DOCUMENT_FRAGMENT_NODE - 1))
+
+typedef struct DOMNodeFilter_s {
+  uint32_t what_to_show;
+
+  /* if nonzero, elements must also be this interned tag in namespace */
+  uint16_t local_name;
+  enum InfraNamespace namespace;
+
+  /* consulted last, may be NULL */
+  enum DOMFilterResult (*accept) (struct dom_node *node, void *user_data);
+  void *user_data;
+} DOMNodeFilter;
+
+enum DOMFilterResult dom_filter_node(const DOMNodeFilter *filter,
+                                     struct dom_node *node);
+
+/*
+ * 6.1 Interface NodeIterator. Lives wherever the caller puts it, but is
+ * linked into root's document between init and detach so that removing
+ * nodes keeps it valid (the "NodeIterator pre-removing steps"). Iterators
+ * over a frozen document are not linked, so any thread may create them;
+ * they must not outlive a thaw that is followed by removals.
+ */
+typedef struct DOMNodeIterator_s {
+  struct dom_node *root;
+  struct dom_node *reference;
+  bool pointer_before_reference;
+  DOMNodeFilter filter;
+
+  struct dom_document *document;
+  struct DOMNodeIterator_s *prev;
+  struct DOMNodeIterator_s *next;
+} DOMNodeIterator;
+
+void dom_node_iterator_init(DOMNodeIterator *iterator, struct dom_node *root,
+                            const DOMNodeFilter *filter);
+/* Must be called before iterator goes away */
+void dom_node_iterator_detach(DOMNodeIterator *iterator);
+struct dom_node *dom_node_iterator_next(DOMNodeIterator *iterator);
+struct dom_node *dom_node_iterator_previous(DOMNodeIterator *iterator);
+
+/* Called by dom_remove_node() */
+void dom_node_iterators_pre_remove(struct dom_document *document,
+                                   struct dom_node *node);
+
+/* 6.2 Interface TreeWalker; nothing to tear down */
+typedef struct DOMTreeWalker_s {
+  struct dom_node *root;
+  struct dom_node *current;
+  DOMNodeFilter filter;
+} DOMTreeWalker;
+
+void dom_tree_walker_init(DOMTreeWalker *walker, struct dom_node *root,
+                          const DOMNodeFilter *filter);
+struct dom_node *dom_tree_walker_parent_node(DOMTreeWalker *walker);
+struct dom_node *dom_tree_walker_first_child(DOMTreeWalker *walker);
+struct dom_node *dom_tree_walker_last_child(DOMTreeWalker *walker);
+struct dom_node *dom_tree_walker_previous_sibling(DOMTreeWalker *walker);
+struct dom_node *dom_tree_walker_next_sibling(DOMTreeWalker *walker);
+struct dom_node *dom_tree_walker_previous_node(DOMTreeWalker *walker);
+struct dom_node *dom_tree_walker_next_node(DOMTreeWalker *walker);
+
+#endif /* _LIBWFS_DOM_TRAVERSAL_H */
@@ -2,10 +2,12 @@
 #define _LIBWFS_HTML_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <wfs/dom_core.h>
 #include <wfs/dom_html.h>
 
 #include <wfs/html_tags.h>
+#include <wfs/infra_namespace.h>
 
 typedef struct HTMLCustomElemDef_s {
   InfraString *name;
@@ -19,4 +21,104 @@ typedef struct HTMLCustomElemDef_s {
 
 void html_parse(struct dom_document *document, const char *input, size_t input_len);
 
+/*
+ * Time-sliced parsing. html_parser_run() parses until the input is
+ * exhausted or the budget runs out; in the latter case it stops between
+ * two tokens, fires the yield hook (if any) and returns
+ * HTML_PARSE_YIELDED. All tokenizer and tree builder state is kept in the
+ * parser, so calling html_parser_run() again resumes where it left off.
+ *
+ * A zero budget field means "no limit"; a NULL budget runs to completion.
+ * The nanosecond budget is sampled every few tokens, not after each one.
+ */
+typedef struct HTMLParser_s HTMLParser;
+
+typedef struct HTMLParseBudget_s {
+  size_t max_tokens;
+  size_t max_bytes;
+  uint64_t max_nsecs;
+} HTMLParseBudget;
+
+enum HTMLParseStatus : uint8_t {
+  HTML_PARSE_DONE = 0,
+  HTML_PARSE_YIELDED,
+};
+
+typedef void (*HTMLParseYieldHook) (HTMLParser *parser,
+                                    struct dom_document *document,
+                                    void *user_data);
+
+HTMLParser *html_parser_create(struct dom_document *document,
+                               const char *input, size_t input_len);
+void html_parser_destroy(HTMLParser *parser);
+void html_parser_set_yield_hook(HTMLParser *parser,
+                                HTMLParseYieldHook hook, void *user_data);
+enum HTMLParseStatus html_parser_run(HTMLParser *parser,
+                                     const HTMLParseBudget *budget);
+
+/*
+ * Callback ("SAX") mode. Tree construction runs as it does for a DOM, but
+ * instead of building one the parser reports its stack of open elements:
+ * an element is started when it is pushed and ended when it is popped,
+ * adjacent characters are coalesced into a single on_text() call. All
+ * pointers are borrowed and only valid for the duration of the callback;
+ * names are NUL-terminated.
+ *
+ * Events follow the stack, not the tree: nodes the algorithm inserts
+ * somewhere other than the current node, such as comments after </body>
+ * or </html> (and foster-parented content, once tables are parsed), are
+ * reported inside whatever element is open at the time.
+ *
+ * Elements and their attributes still exist while they are open (the
+ * algorithm inspects them), but are never inserted into a tree and are
+ * freed once popped. Text, comment, DOCTYPE and Attr nodes are never
+ * allocated.
+ */
+typedef struct HTMLSinkAttr_s {
+  const char *prefix; /* NULL if none */
+  const char *local_name;
+  const char *value;
+  size_t value_len;
+  enum InfraNamespace namespace;
+} HTMLSinkAttr;
+
+typedef struct HTMLSink_s {
+  void (*on_start_element) (void *user_data, enum InfraNamespace namespace,
+                            const char *local_name,
+                            const HTMLSinkAttr *attrs, size_t num_attrs);
+  void (*on_end_element) (void *user_data, enum InfraNamespace namespace,
+                          const char *local_name);
+  void (*on_text) (void *user_data, const char *data, size_t len);
+  void (*on_comment) (void *user_data, const char *data, size_t len);
+  /* missing identifiers are NULL */
+  void (*on_doctype) (void *user_data, const char *name,
+                      const char *public_id, const char *system_id);
+
+  void *user_data;
+} HTMLSink;
+
+void html_parse_sink(const HTMLSink *sink, const char *input, size_t input_len);
+
+/* Must be called before the first html_parser_run(); any callback may be NULL */
+void html_parser_set_sink(HTMLParser *parser, const HTMLSink *sink);
+
+/*
+ * 13.3 Serializing HTML fragments. Output goes through a buffer of a few
+ * KiB and reaches write() in large chunks; the tree is walked iteratively,
+ * template contents included. Scripting is considered disabled, so
+ * <noscript> contents are escaped.
+ *
+ * inner serializes node's children (innerHTML), outer node itself
+ * (outerHTML).
+ */
+typedef void (*HTMLSerializeWriteFunc) (void *user_data,
+                                        const char *data, size_t len);
+
+void html_serialize(struct dom_node *node, bool outer,
+                    HTMLSerializeWriteFunc write, void *user_data);
+
+/* Appending to out */
+void html_serialize_inner(struct dom_node *node, InfraString *out);
+void html_serialize_outer(struct dom_node *node, InfraString *out);
+
 #endif /* _LIBWFS_HTML_H */
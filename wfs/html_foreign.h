@@ -0,0 +1,156 @@
+#ifndef _LIBWFS_HTML_FOREIGN_H
+#define _LIBWFS_HTML_FOREIGN_H
+
+#include <stddef.h>
+
+#include <wfs/dom.h>
+#include <wfs/infra_namespace.h>
+
+/*
+ * Interned local names of elements in the SVG and MathML namespaces.
+ * A dom_element's local_name is one of these when its namespace is
+ * INFRA_NAMESPACE_SVG or INFRA_NAMESPACE_MATHML respectively.
+ */
+
+enum SVGTag : uint16_t {
+  _SVG_TAG_NONE = 0,
+  _SVG_TAG_FIRST,
+
+  SVG_TAG_A = _SVG_TAG_FIRST,
+  SVG_TAG_ALTGLYPH,
+  SVG_TAG_ALTGLYPHDEF,
+  SVG_TAG_ALTGLYPHITEM,
+  SVG_TAG_ANIMATE,
+  SVG_TAG_ANIMATECOLOR,
+  SVG_TAG_ANIMATEMOTION,
+  SVG_TAG_ANIMATETRANSFORM,
+  SVG_TAG_CIRCLE,
+  SVG_TAG_CLIPPATH,
+  SVG_TAG_DEFS,
+  SVG_TAG_DESC,
+  SVG_TAG_DISCARD,
+  SVG_TAG_ELLIPSE,
+  SVG_TAG_FEBLEND,
+  SVG_TAG_FECOLORMATRIX,
+  SVG_TAG_FECOMPONENTTRANSFER,
+  SVG_TAG_FECOMPOSITE,
+  SVG_TAG_FECONVOLVEMATRIX,
+  SVG_TAG_FEDIFFUSELIGHTING,
+  SVG_TAG_FEDISPLACEMENTMAP,
+  SVG_TAG_FEDISTANTLIGHT,
+  SVG_TAG_FEDROPSHADOW,
+  SVG_TAG_FEFLOOD,
+  SVG_TAG_FEFUNCA,
+  SVG_TAG_FEFUNCB,
+  SVG_TAG_FEFUNCG,
+  SVG_TAG_FEFUNCR,
+  SVG_TAG_FEGAUSSIANBLUR,
+  SVG_TAG_FEIMAGE,
+  SVG_TAG_FEMERGE,
+  SVG_TAG_FEMERGENODE,
+  SVG_TAG_FEMORPHOLOGY,
+  SVG_TAG_FEOFFSET,
+  SVG_TAG_FEPOINTLIGHT,
+  SVG_TAG_FESPECULARLIGHTING,
+  SVG_TAG_FESPOTLIGHT,
+  SVG_TAG_FETILE,
+  SVG_TAG_FETURBULENCE,
+  SVG_TAG_FILTER,
+  SVG_TAG_FOREIGNOBJECT,
+  SVG_TAG_G,
+  SVG_TAG_GLYPHREF,
+  SVG_TAG_IMAGE,
+  SVG_TAG_LINE,
+  SVG_TAG_LINEARGRADIENT,
+  SVG_TAG_MARKER,
+  SVG_TAG_MASK,
+  SVG_TAG_METADATA,
+  SVG_TAG_MPATH,
+  SVG_TAG_PATH,
+  SVG_TAG_PATTERN,
+  SVG_TAG_POLYGON,
+  SVG_TAG_POLYLINE,
+  SVG_TAG_RADIALGRADIENT,
+  SVG_TAG_RECT,
+  SVG_TAG_SCRIPT,
+  SVG_TAG_SET,
+  SVG_TAG_STOP,
+  SVG_TAG_STYLE,
+  SVG_TAG_SVG,
+  SVG_TAG_SWITCH,
+  SVG_TAG_SYMBOL,
+  SVG_TAG_TEXT,
+  SVG_TAG_TEXTPATH,
+  SVG_TAG_TITLE,
+  SVG_TAG_TSPAN,
+  SVG_TAG_USE,
+  SVG_TAG_VIEW,
+
+  NUM_SVG_TAG
+};
+
+enum MathMLTag : uint16_t {
+  _MATHML_TAG_NONE = 0,
+  _MATHML_TAG_FIRST,
+
+  MATHML_TAG_ANNOTATION = _MATHML_TAG_FIRST,
+  MATHML_TAG_ANNOTATION_XML,
+  MATHML_TAG_MACTION,
+  MATHML_TAG_MALIGNMARK,
+  MATHML_TAG_MATH,
+  MATHML_TAG_MERROR,
+  MATHML_TAG_MFRAC,
+  MATHML_TAG_MGLYPH,
+  MATHML_TAG_MI,
+  MATHML_TAG_MMULTISCRIPTS,
+  MATHML_TAG_MN,
+  MATHML_TAG_MO,
+  MATHML_TAG_MOVER,
+  MATHML_TAG_MPADDED,
+  MATHML_TAG_MPHANTOM,
+  MATHML_TAG_MPRESCRIPTS,
+  MATHML_TAG_MROOT,
+  MATHML_TAG_MROW,
+  MATHML_TAG_MS,
+  MATHML_TAG_MSPACE,
+  MATHML_TAG_MSQRT,
+  MATHML_TAG_MSTYLE,
+  MATHML_TAG_MSUB,
+  MATHML_TAG_MSUBSUP,
+  MATHML_TAG_MSUP,
+  MATHML_TAG_MTABLE,
+  MATHML_TAG_MTD,
+  MATHML_TAG_MTEXT,
+  MATHML_TAG_MTR,
+  MATHML_TAG_MUNDER,
+  MATHML_TAG_MUNDEROVER,
+  MATHML_TAG_NONE,
+  MATHML_TAG_SEMANTICS,
+
+  NUM_MATHML_TAG
+};
+
+/* Properly cased, i.e. after "adjust SVG tag name" */
+extern const char *k_svg_tag_names[NUM_SVG_TAG];
+extern const char *k_mathml_tag_names[NUM_MATHML_TAG];
+
+/* 13.2.6.3 Creating and inserting nodes (adjust foreign attributes) */
+typedef struct HTMLForeignAttr_s {
+  const char *prefix; /* NULL if none */
+  const char *local_name;
+  enum InfraNamespace namespace;
+} HTMLForeignAttr;
+
+/*
+ * All lookups take a (lowercased) token name and are O(1): each is backed
+ * by a perfect hash over the static tables in src/html_foreign.c.
+ */
+uint16_t html_svg_tag_lookup(const char *name, size_t len);
+uint16_t html_mathml_tag_lookup(const char *name, size_t len);
+
+/* Return the adjusted name, or NULL if the attribute needs no adjustment */
+const char *html_adjust_svg_attr(const char *name, size_t len);
+const char *html_adjust_mathml_attr(const char *name, size_t len);
+const HTMLForeignAttr *html_adjust_foreign_attr(const char *name, size_t len);
+
+#endif /* _LIBWFS_HTML_FOREIGN_H */
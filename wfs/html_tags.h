@@ -178,4 +178,7 @@ enum HTMLTag : uint16_t {
 extern const char *k_html_tag_names[NUM_HTML_TAG];
 extern const DOMInterface *k_html_element_interfaces[NUM_HTML_TAG];
 
+/* O(1); returns _HTML_TAG_NONE for names that are not interned */
+uint16_t html_tag_lookup(const char *name, size_t len);
+
 #endif /* _LIBWFS_HTML_TAGS_H */
@@ -0,0 +1,35 @@
+#ifndef _LIBWFS_INFRA_ARENA_H
+#define _LIBWFS_INFRA_ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Bump allocator with size-class free lists. Blocks given back with
+ * infra_arena_free() are recycled; infra_arena_destroy() releases
+ * everything at once, in time proportional to the number of chunks.
+ *
+ * A NULL arena stands for the C heap, so callers never need to special-case
+ * it. Returned blocks are always zeroed. Frees and reallocs must pass the
+ * size the block was allocated with.
+ */
+typedef struct InfraArena_s InfraArena;
+
+InfraArena *infra_arena_create(void);
+void infra_arena_destroy(InfraArena *arena);
+
+void *infra_arena_alloc(InfraArena *arena, size_t size);
+void *infra_arena_realloc(InfraArena *arena, void *ptr,
+                          size_t old_size, size_t new_size);
+void infra_arena_free(InfraArena *arena, void *ptr, size_t size);
+
+/*
+ * The arena infra_string_create(), infra_stack_create() and
+ * dom_alloc_object() allocate from; per thread, NULL (the heap) by
+ * default. infra_arena_enter() returns the arena to restore with
+ * infra_arena_leave().
+ */
+InfraArena *infra_arena_current(void);
+InfraArena *infra_arena_enter(InfraArena *arena);
+void infra_arena_leave(InfraArena *previous);
+
+#endif /* _LIBWFS_INFRA_ARENA_H */
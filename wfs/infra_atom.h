@@ -0,0 +1,29 @@
+#ifndef _LIBWFS_INFRA_ATOM_H
+#define _LIBWFS_INFRA_ATOM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <wfs/infra_string.h>
+
+/*
+ * An atom is an InfraString interned once per process: two atoms are
+ * equal iff they are the same pointer. Atoms are immutable, carry their
+ * hash and ignore infra_string_ref()/infra_string_unref(), so they may be
+ * shared freely between documents and threads.
+ */
+typedef InfraString InfraAtom;
+
+/* Thread-safe; the contents are copied on first use */
+InfraAtom *infra_atom_intern(const char *ptr, size_t len);
+
+/* Same, reusing string's cached hash; string itself is left untouched */
+InfraAtom *infra_atom_from_string(InfraString *string);
+
+static inline bool
+infra_string_is_atom(const InfraString *string)
+{
+  return string->is_atom;
+}
+
+#endif /* _LIBWFS_INFRA_ATOM_H */
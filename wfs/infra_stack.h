@@ -4,17 +4,33 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <wfs/infra_arena.h>
+
+/* Items stored in the stack itself before the first heap allocation */
+#define INFRA_STACK_INLINE_CAP 4
+
 typedef struct InfraStack_s {
-  void **  items;
+  void **  items; /* inline_items or a separate buffer */
   uint32_t  size;
   uint32_t  cap;
+  InfraArena *arena; /* NULL if heap-allocated */
+  void *   inline_items[INFRA_STACK_INLINE_CAP];
 } InfraStack;
 
+/* Allocated from infra_arena_current() */
 InfraStack *infra_stack_create(void);
 void infra_stack_free(InfraStack *stack);
 void *infra_stack_push(InfraStack *stack, void *item);
 void *infra_stack_pop(InfraStack *stack);
 
+/* Capacity grows geometrically; these only ever touch the buffer */
+void infra_stack_reserve(InfraStack *stack, uint32_t cap);
+void infra_stack_shrink_to_fit(InfraStack *stack);
+
+void infra_stack_push_n(InfraStack *stack, void *const *items, uint32_t count);
+/* Remove count items starting at index, keeping the order of the rest */
+void infra_stack_erase(InfraStack *stack, uint32_t index, uint32_t count);
+
 static inline void *
 infra_stack_peek(InfraStack *stack)
 {
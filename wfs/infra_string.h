@@ -1,24 +1,35 @@
 #ifndef _LIBWFS_INFRA_STRING_H
 #define _LIBWFS_INFRA_STRING_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 
+#include <wfs/infra_arena.h>
+
+/* Bytes stored in the string itself before the first heap allocation */
+#define INFRA_STRING_INLINE_CAP 16
+
 typedef struct InfraString_s {
-  char *data;
+  char *data; /* inline_data or a separate buffer; always NUL-terminated */
   int_least32_t refcnt;
   uint32_t size;
   uint32_t cap;
+  uint32_t hash; /* see infra_string_hash() */
+  bool has_hash;
+  bool is_atom; /* immutable and never freed, see wfs/infra_atom.h */
+  InfraArena *arena; /* NULL if heap-allocated */
+  char inline_data[INFRA_STRING_INLINE_CAP];
 } InfraString;
 
-/* Has an initial reference! */
+/* Has an initial reference! Allocated from infra_arena_current() */
 InfraString *infra_string_create(void);
 void infra_string_free(InfraString *string);
 
 static inline InfraString *
 infra_string_ref(InfraString *string)
 {
-  if (string != NULL)
+  if (string != NULL && !string->is_atom)
     string->refcnt++;
 
   return string;
@@ -27,18 +38,49 @@ infra_string_ref(InfraString *string)
 static inline void
 infra_string_unref(InfraString *string)
 {
-  if (string != NULL && --string->refcnt <= 0)
+  if (string != NULL && !string->is_atom && --string->refcnt <= 0)
     infra_string_free(string);
 }
 
 static inline void
 infra_string_zero(InfraString *string)
 {
-  if (string != NULL && string->size != 0)
+  if (string != NULL && string->size != 0) {
     memset(string->data, 0, string->cap);
+    string->has_hash = false;
+  }
+}
+
+static inline void
+infra_string_clear(InfraString *string)
+{
+  string->data[0] = '\0';
+  string->size = 0;
+  string->has_hash = false;
 }
 
 void infra_string_put_char(InfraString *string, char c);
 void infra_string_put_codepoint(InfraString *string, uint32_t c);
+void infra_string_append(InfraString *string, const char *ptr, size_t len);
+
+/* Capacity grows geometrically; these only ever touch the buffer */
+void infra_string_reserve(InfraString *string, size_t len);
+void infra_string_shrink_to_fit(InfraString *string);
+
+/* FNV-1a over the contents, computed once per modification */
+uint32_t infra_string_hash(InfraString *string);
+
+static inline uint32_t
+infra_hash_bytes(const char *ptr, size_t len)
+{
+  uint32_t h = 2166136261u;
+
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char) ptr[i];
+    h *= 16777619u;
+  }
+
+  return h;
+}
 
 #endif /* _LIBWFS_INFRA_STRING_H */